@@ -0,0 +1,253 @@
+#include "alloc.h"
+#include "bytecode.h"
+
+/* How much memory to get for each new slab (not counting the header).
+ * Pools with objects bigger than this get at least 16 per slab. */
+#define SLAB_BYTES 16384
+
+#define POOL_INIT(poolname, size) \
+    { poolname, size, 0, NULL, NULL, 0, 0, 0, 0 }
+
+APool value_pool = POOL_INIT("values", sizeof(AValue));
+APool list_pool = POOL_INIT("lists", sizeof(AList));
+APool listbuf_pool = POOL_INIT("list buffers", sizeof(AListBuffer));
+APool varbuf_pool = POOL_INIT("var-buffers", sizeof(AVarBuffer));
+APool varslot_pools[VARSLOT_POOLS] = {
+    POOL_INIT("var slots (1)", 1 * sizeof(AValue*)),
+    POOL_INIT("var slots (2)", 2 * sizeof(AValue*)),
+    POOL_INIT("var slots (3)", 3 * sizeof(AValue*)),
+    POOL_INIT("var slots (4)", 4 * sizeof(AValue*)),
+};
+
+/* Fill in the sizes of a pool the first time it's used. */
+static
+void pool_setup(APool *pool) {
+    /* Every object has to be big enough to hold the free-list link,
+     * and a multiple of 8 bytes so that tagged pointers (see value.h)
+     * never clash with real ones. */
+    size_t size = pool->obj_size;
+    if (size < sizeof(void*)) size = sizeof(void*);
+    size = (size + 7) & ~(size_t)7;
+    pool->obj_size = size;
+    pool->per_slab = SLAB_BYTES / size;
+    if (pool->per_slab < 16) pool->per_slab = 16;
+}
+
+#ifndef ALMA_NO_POOL
+/* Get a new slab for a pool and put all its objects
+ * on the free list. */
+static
+int pool_grow(APool *pool) {
+    if (pool->per_slab == 0) pool_setup(pool);
+
+    APoolSlab *slab = malloc(sizeof(APoolSlab) + pool->per_slab * pool->obj_size);
+    if (slab == NULL) {
+        fprintf(stderr, "error: couldn't allocate new slab for pool of %s: "
+                        "out of memory\n", pool->name);
+        return 0;
+    }
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count ++;
+
+    /* thread the free list through the new objects, in order */
+    char *objs = (char*)(slab + 1);
+    for (unsigned int i = 0; i < pool->per_slab; i++) {
+        void *obj = objs + i * pool->obj_size;
+        *(void**)obj = (i + 1 < pool->per_slab)
+                       ? objs + (i + 1) * pool->obj_size
+                       : pool->free_list;
+    }
+    pool->free_list = objs;
+    return 1;
+}
+#endif
+
+/* Get an object from a pool. */
+void *pool_alloc(APool *pool) {
+#ifdef ALMA_NO_POOL
+    /* for valgrind and friends, which can't see inside the pools */
+    pool->live ++;
+    pool->allocs ++;
+    if (pool->live > pool->peak) pool->peak = pool->live;
+    return malloc(pool->obj_size);
+#else
+    if (pool->free_list == NULL && !pool_grow(pool)) {
+        return NULL;
+    }
+    void *obj = pool->free_list;
+    pool->free_list = *(void**)obj;
+
+    pool->live ++;
+    pool->allocs ++;
+    if (pool->live > pool->peak) pool->peak = pool->live;
+    return obj;
+#endif
+}
+
+/* Give an object back to the pool it came from. */
+void pool_free(APool *pool, void *obj) {
+    if (obj == NULL) return;
+    pool->live --;
+#ifdef ALMA_NO_POOL
+    free(obj);
+#else
+    *(void**)obj = pool->free_list;
+    pool->free_list = obj;
+#endif
+}
+
+/* Print the stats line for a single pool. */
+static
+void fprint_pool(FILE *out, APool *pool) {
+    if (pool->per_slab == 0) pool_setup(pool);
+    fprintf(out, "%-16s %6lu %10lu %10lu %12lu %10lu\n",
+            pool->name, (unsigned long)pool->obj_size,
+            pool->live, pool->peak, pool->allocs,
+            pool->slab_count * (sizeof(APoolSlab) + pool->per_slab * pool->obj_size));
+}
+
+/* Print out how many objects each pool has, etc. */
+void fprint_pool_stats(FILE *out) {
+    fprintf(out, "%-16s %6s %10s %10s %12s %10s\n",
+            "pool", "size", "live", "peak", "allocs", "bytes");
+    fprint_pool(out, &value_pool);
+    fprint_pool(out, &list_pool);
+    fprint_pool(out, &listbuf_pool);
+    fprint_pool(out, &varbuf_pool);
+    for (int i = 0; i < VARSLOT_POOLS; i++) {
+        fprint_pool(out, &varslot_pools[i]);
+    }
+}
+
+/* With --alloc-stats, every value gets counted by type when it's made
+ * and freed, and so does everything values point to that gets
+ * allocated while the program runs (see AAllocKind). A value's free is
+ * counted under the type it was made as, even if compiling has changed
+ * it since (a proto block into a block, say), so that they balance.
+ * Allocations are also put down to the file and line of code that made
+ * them: the interpreter keeps alloc_site pointing at the instruction
+ * it's on whenever it calls out to something that might allocate,
+ * which is cheap enough to do all the time. And the list operations that can change a list
+ * in place if nothing else is using it count how often they get to,
+ * and how often they have to copy it instead. */
+
+int alloc_stats = 0;
+AInstruction *alloc_site = NULL;
+
+/* The counts so far, by kind. */
+static AAllocCount alloc_counts[alloc_kind_count];
+
+/* The counts so far, by kind and line. */
+static AAllocSite *alloc_sites = NULL;
+
+/* How many times each list operation reused its list [1], or had to
+ * copy it [0]. */
+static unsigned long reuse_counts[reuse_path_count][2];
+
+/* What each kind is called in the report. (The value types have to
+ * be in the same order as in AValueType.) */
+static const char *const alloc_kind_names[alloc_kind_count] = {
+    "int", "float", "str", "sym", "proto block", "block", "free block",
+    "bound block", "proto list", "list", "seq",
+    "AList", "AListBuffer", "AVarBuffer", "AUserFunc", "AUstr",
+};
+
+/* What each list operation is called in the report. */
+static const char *const reuse_path_names[reuse_path_count] = {
+    "tail", "init", "cons", "append", "list_reserve", "list_val_unshared",
+};
+
+/* Start counting allocations. */
+void alloc_stats_start(void) {
+    alloc_stats = 1;
+}
+
+/* Count an allocation of <bytes> bytes of the AAllocKind (or
+ * AValueType) <kind>, made by the line of alloc_site. */
+void note_alloc(int kind, size_t bytes) {
+    AAllocCount *count = &alloc_counts[kind];
+    count->allocs ++;
+    count->live ++;
+    count->bytes += bytes;
+    if (count->live > count->peak) count->peak = count->live;
+
+    AAllocSite key;
+    memset(&key, 0, sizeof(key));
+    key.key.kind = kind;
+    key.key.file = alloc_site ? alloc_site->file : 0;
+    key.key.linenum = alloc_site ? alloc_site->linenum : 0;
+    AAllocSite *site = NULL;
+    HASH_FIND(hh, alloc_sites, &key.key, sizeof(key.key), site);
+    if (site == NULL) {
+        site = malloc(sizeof(AAllocSite));
+        *site = key;
+        HASH_ADD(hh, alloc_sites, key, sizeof(site->key), site);
+    }
+    site->allocs ++;
+    site->bytes += bytes;
+}
+
+/* Count a free of something of the AAllocKind <kind>. */
+void note_free(int kind) {
+    AAllocCount *count = &alloc_counts[kind];
+    count->frees ++;
+    /* (things made before counting started can still get freed) */
+    if (count->live > 0) count->live --;
+}
+
+/* Count a list being changed in place (if <reused>) or copied at
+ * <path>. */
+void note_reuse(AReusePath path, int reused) {
+    reuse_counts[path][reused ? 1 : 0] ++;
+}
+
+/* For sorting the lines that allocated the most bytes first. */
+static
+int by_bytes(AAllocSite *a, AAllocSite *b) {
+    if (a->bytes != b->bytes) return (a->bytes > b->bytes) ? -1 : 1;
+    if (a->key.file != b->key.file) return (a->key.file < b->key.file) ? -1 : 1;
+    if (a->key.linenum != b->key.linenum) return (a->key.linenum < b->key.linenum) ? -1 : 1;
+    return a->key.kind - b->key.kind;
+}
+
+/* Print out everything --alloc-stats has counted: by kind, by line
+ * (the <limit> lines that allocated the most), and how often each
+ * list operation reused its list or had to copy it. */
+void fprint_alloc_stats(FILE *out, unsigned int limit) {
+    fprintf(out, "-- allocations by type --\n");
+    fprintf(out, "%-12s %12s %12s %10s %10s %14s\n",
+            "type", "allocs", "frees", "live", "peak", "bytes");
+    for (int kind = 0; kind < alloc_kind_count; kind++) {
+        AAllocCount *count = &alloc_counts[kind];
+        if (count->allocs == 0 && count->frees == 0) continue;
+        fprintf(out, "%-12s %12lu %12lu %10lu %10lu %14llu\n",
+                alloc_kind_names[kind], count->allocs, count->frees,
+                count->live, count->peak, count->bytes);
+    }
+
+    fprintf(out, "-- lines that allocated the most --\n");
+    fprintf(out, "%6s  %-12s %12s %14s  %s\n", "line", "type", "allocs", "bytes", "file");
+    HASH_SORT(alloc_sites, by_bytes);
+    unsigned int shown = 0;
+    for (AAllocSite *site = alloc_sites; site != NULL && shown < limit;
+            site = site->hh.next, shown++) {
+        if (site->key.linenum == 0) {
+            /* (made while loading the program, not running it) */
+            fprintf(out, "%6s  ", "-");
+        } else {
+            fprintf(out, "%6u  ", site->key.linenum);
+        }
+        const char *file = code_file_name(site->key.file);
+        fprintf(out, "%-12s %12lu %14llu", alloc_kind_names[site->key.kind],
+                site->allocs, site->bytes);
+        fprintf(out, file ? "  %s\n" : "\n", file);
+    }
+
+    fprintf(out, "-- lists changed in place vs. copied --\n");
+    fprintf(out, "%-18s %12s %12s\n", "operation", "in place", "copied");
+    for (int path = 0; path < reuse_path_count; path++) {
+        fprintf(out, "%-18s %12lu %12lu\n", reuse_path_names[path],
+                reuse_counts[path][1], reuse_counts[path][0]);
+    }
+}
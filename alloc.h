@@ -0,0 +1,67 @@
+#ifndef _AL_ALLOC_H__
+#define _AL_ALLOC_H__
+
+#include "alma.h"
+
+/* Var-buffers with this many slots or fewer get their slot
+ * array from a pool; bigger ones use malloc. */
+#define VARSLOT_POOLS 4
+
+/* The pools for each kind of small, short-lived object. */
+extern APool value_pool;
+extern APool list_pool;
+extern APool listbuf_pool;
+extern APool varbuf_pool;
+extern APool varslot_pools[VARSLOT_POOLS];
+
+/* Get an object from a pool. */
+void *pool_alloc(APool *pool);
+
+/* Give an object back to the pool it came from. */
+void pool_free(APool *pool, void *obj);
+
+/* Print out how many objects each pool has, etc. */
+void fprint_pool_stats(FILE *out);
+
+/* Whether --alloc-stats is on. Everything that gets counted checks
+ * this first (see COUNT_ALLOC etc.), so it's cheap when off. */
+extern int alloc_stats;
+
+/* The instruction being run, as of the last time the interpreter
+ * called out to something that might allocate (or NULL, outside of
+ * running the program), so allocations can be put down to a line. */
+extern AInstruction *alloc_site;
+
+#define COUNT_ALLOC(kind, bytes) \
+    do { \
+        if (alloc_stats) note_alloc((kind), (bytes)); \
+    } while (0)
+#define COUNT_FREE(kind) \
+    do { \
+        if (alloc_stats) note_free(kind); \
+    } while (0)
+#define COUNT_REUSE(path, reused) \
+    do { \
+        if (alloc_stats) note_reuse((path), (reused)); \
+    } while (0)
+
+/* Start counting allocations. */
+void alloc_stats_start(void);
+
+/* Count an allocation of <bytes> bytes of the AAllocKind (or
+ * AValueType) <kind>, made by the line of alloc_site. */
+void note_alloc(int kind, size_t bytes);
+
+/* Count a free of something of the AAllocKind <kind>. */
+void note_free(int kind);
+
+/* Count a list being changed in place (if <reused>) or copied at
+ * <path>. */
+void note_reuse(AReusePath path, int reused);
+
+/* Print out everything --alloc-stats has counted: by kind, by line
+ * (the <limit> lines that allocated the most), and how often each
+ * list operation reused its list or had to copy it. */
+void fprint_alloc_stats(FILE *out, unsigned int limit);
+
+#endif
@@ -6,6 +6,9 @@
 #include "lib.h"
 #include "compile.h"
 #include "registry.h"
+#include "alloc.h"
+#include "ngram.h"
+#include "profile.h"
 
 #define STDLIB_MODULE "std"
 
@@ -14,8 +17,54 @@ ACompileStatus compile_file(ADeclSeqNode *program, ASymbolTable symtab,
         AScope *scope, AFuncRegistry *reg);
 AFunc *finalize_compilation(AScope *scope, ASymbolTable symtab, AFuncRegistry *reg);
 int run_main(AFunc *mainfunc);
+void print_pool_stats(void);
+void print_alloc_stats(void);
+void print_profile(void);
+
+/* Whether to print out the most-run instruction sequences. */
+static int ngram_stats = 0;
+
+/* How --profile=<format> asked for the profile to be printed:
+ * "" (a table), "json", or "folded" (samples, for flame graphs). */
+static const char *profile_format = "";
 
 int main (int argc, char **argv) {
+    /* Pull out any --options, leaving just the file arguments. */
+    int nargs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pool-stats")) {
+            /* print at exit, so we catch every way out */
+            atexit(&print_pool_stats);
+        } else if (!strcmp(argv[i], "--alloc-stats")) {
+            alloc_stats_start();
+            atexit(&print_alloc_stats);
+        } else if (!strcmp(argv[i], "--ngram-stats")) {
+            /* not at exit: the code has to still be around */
+            ngram_stats = 1;
+        } else if (!strncmp(argv[i], "--profile", 9)
+                && (argv[i][9] == '\0' || argv[i][9] == '=')) {
+            profile_format = argv[i] + 9 + (argv[i][9] == '=');
+            if (!strcmp(profile_format, "folded")) {
+                if (!profile_start_sampling()) {
+                    perror("Couldn't start the sampling timer");
+                    exit(1);
+                }
+            } else if (!strcmp(profile_format, "") || !strcmp(profile_format, "json")) {
+                profile_start();
+            } else {
+                fprintf(stderr, "Unknown profile format ‘%s’ "
+                                "(try json or folded).\n", profile_format);
+                exit(1);
+            }
+            /* at exit, like --pool-stats, so quitting early still
+             * gets a report */
+            atexit(&print_profile);
+        } else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    argc = nargs;
+
     /* Import standard library. */
     ALMA_PATH = getenv("ALMA_PATH");
 
@@ -50,6 +99,7 @@ int main (int argc, char **argv) {
         }
 
         interact(&symtab, comp.scope, comp.reg);
+        if (ngram_stats) fprint_ngrams(stderr, 20);
         exit(0);
     } else if (argc == 2) {
         ACompileStatus file_stat = put_file_into_scope(argv[1], &symtab, comp.scope, comp.reg);
@@ -62,9 +112,11 @@ int main (int argc, char **argv) {
 
         if (file_stat == compile_success) {
             run_main(mainfunc);
+            if (ngram_stats) fprint_ngrams(stderr, 20);
         }
     } else if (argc == 1) {
         interact(&symtab, comp.scope, comp.reg);
+        if (ngram_stats) fprint_ngrams(stderr, 20);
         exit(0);
     } else {
         fprintf(stderr, "Please supply one file name.\n");
@@ -104,6 +156,26 @@ AFunc *finalize_compilation(AScope *scope, ASymbolTable symtab, AFuncRegistry *r
     return mainfunc;
 }
 
+/* Print the allocator statistics (for --pool-stats). */
+void print_pool_stats(void) {
+    fprint_pool_stats(stderr);
+}
+
+/* Print what got allocated, and where (for --alloc-stats). */
+void print_alloc_stats(void) {
+    fprint_alloc_stats(stderr, 20);
+}
+
+/* Print what each word took, or where the samples were taken (for
+ * --profile). */
+void print_profile(void) {
+    if (!strcmp(profile_format, "folded")) {
+        fprint_folded(stderr);
+    } else {
+        fprint_profile(stderr, !strcmp(profile_format, "json"));
+    }
+}
+
 int run_main(AFunc *mainfunc) {
     AStack *stack = stack_new(20);
 
@@ -46,6 +46,30 @@ typedef struct AUstr {
     uint32_t *data;
 } AUstr;
 
+/*-*-* alloc.h *-*-*/
+
+/* A block of memory carved up into objects for a pool. The
+ * objects start right after this header. */
+typedef struct APoolSlab {
+    struct APoolSlab *next;
+    size_t pad;             // keeps the objects after it aligned
+} APoolSlab;
+
+/* A pool of fixed-size objects. Freed objects go on a free list
+ * and get handed straight back out by the next allocation, so we
+ * only go to malloc for a whole slab at a time. */
+typedef struct APool {
+    const char *name;           // for printing stats
+    size_t obj_size;            // size of each object (rounded up)
+    unsigned int per_slab;      // number of objects in each slab
+    void *free_list;            // singly-linked through the objects
+    APoolSlab *slabs;
+    unsigned long live;         // objects handed out and not freed
+    unsigned long peak;         // highest that 'live' has been
+    unsigned long allocs;       // total objects ever handed out
+    unsigned long slab_count;
+} APool;
+
 /*-*-* value.h *-*-*/
 
 /* Possible types of values. */
@@ -74,10 +98,14 @@ typedef enum {
     proto_list,
         /* An unevaluated list that lives in the AST. Contains
          * AST nodes to evaluate, rather than values. */
-        /* (Future optimization: detect constant lists and skip
-         * this step for them.) */
+        /* (If all of them turn out to be constants, the compiler
+         * builds the list once instead; see AProtoList.) */
     list_val,
         /* A real, honest-to-god list. */
+    seq_val,
+        /* A lazy sequence (see seq.h): something that works out its
+         * elements one at a time as they're asked for, and only turns
+         * into a real list if something needs one. */
 } AValueType;
 
 /* Struct representing a value.
@@ -95,31 +123,60 @@ typedef struct AValue {
         struct AUserFunc *uf;
         struct AProtoList *pl;
         struct AList *list;
+        struct ASeq *seq;
     } data;
     int refs;         // refcounting
+    AValueType made_as; // its type when it was made (compiling changes
+                        //   some), which --alloc-stats counts it as
 } AValue;
 
 /*-*-* list.h *-*-*/
 
-/* A struct holding an element in a list.
- * (An element of a double-linked list -- points
- * to the value and the next and previous elements) */
-typedef struct AListElem {
-    AValue *val;
-    struct AListElem *next;
-    struct AListElem *prev;
-} AListElem;
-
-/* A linked list!
- * Maintains a pointer to the last element
- * for convenience. Dunno if that will actually
- * come in handy. */
+/* The storage behind one or more lists: a growable array with
+ * free space left at both ends. The slots items[lo] .. items[hi - 1]
+ * are in use, and the buffer holds a reference to each of those
+ * values. Lists never change a slot once it's in use (unless they're
+ * the only list looking at the buffer), so any number of them can
+ * share one buffer, each looking at its own stretch of it.
+ *
+ * Since ints are stored right in the AValue* (see value.h), a buffer
+ * full of them is already a packed array of 64-bit words. <all_ints>
+ * keeps track of that, so list words can hand the whole array to the
+ * vector kernels in vector.c instead of going one value at a time. */
+typedef struct AListBuffer {
+    AValue **items;
+    unsigned int lo;            // first slot in use
+    unsigned int hi;            // one past the last slot in use
+    unsigned int capacity;      // total number of slots in <items>
+    unsigned int refs;          // number of lists looking at this buffer
+    unsigned int all_ints;      // is every slot in use an immediate int?
+} AListBuffer;
+
+/* A list! It's a window onto an AListBuffer: its elements are
+ * buf->items[start] .. buf->items[start + length - 1].
+ * Taking the tail or init of a list just makes a narrower window,
+ * and adding to the end of one that reaches the edge of the used
+ * part of its buffer just claims the next slot, so none of those
+ * have to copy anything even when the list is shared. */
 typedef struct AList {
-    AListElem *first;
-    AListElem *last;
+    AListBuffer *buf;
+    unsigned int start;
     unsigned int length;
 } AList;
 
+/*-*-* vector.h *-*-*/
+
+/* Which comparison a vector comparison kernel does
+ * (element on the left, scalar on the right). */
+typedef enum {
+    vec_lt,
+    vec_gt,
+    vec_le,
+    vec_ge,
+    vec_eq,
+    vec_ne,
+} AVecCompare;
+
 /*-*-* vars.h *-*-*/
 
 /* A struct representing the vars bound to names at a given point
@@ -131,8 +188,17 @@ typedef struct AVarBuffer {
     unsigned int base;          // number of vars below this one (for looking up in scopes below)
     struct AVarBuffer *parent;  // where to find more vars
     unsigned int refs;          // refcount to know whether closures point to it
+    unsigned int on_stack;      // is it on the frame stack (not the heap)?
 } AVarBuffer;
 
+/* Where to find a variable at runtime, worked out at compile time:
+ * go <up> buffers along the parent chain from the current one, and
+ * it's at <slot> in that one. */
+typedef struct AVarRef {
+    unsigned int up;
+    unsigned int slot;
+} AVarRef;
+
 /* An instruction telling the interpreter to place the top <count>
  * elements from the stack into a var-buffer while executing the
  * word-sequence <words>. compile() replaces* BindNodes with this. */
@@ -175,12 +241,14 @@ typedef struct AWordSeqNode {
     AAstNode *first;
     AAstNode *last;
     struct AWordSeqNode *next; // for when they're in a list
+    struct ACode *code;        // flattened bytecode (filled in by compile)
 } AWordSeqNode;
 
 /* Struct representing a list yet-to-be-evaluated. */
 typedef struct AProtoList {
     AWordSeqNode *first;    // first thing *evaluated* (last thing in list)
     AWordSeqNode *last;     // (not sure exec. order matters here but w/e)
+    AValue *constant;       // the whole list, if its elements are all constants
 } AProtoList;
 
 /* Possible types of declarations. */
@@ -276,6 +344,9 @@ typedef struct ABindInfo {
         /* We keep track of the last block depth so that we know
          * which variables are created inside the block, and which
          * ones need to be closed over from the outside. */
+    unsigned int bind_depth; // How many binds are we inside?
+        /* Each bind makes one var-buffer at runtime, so this is
+         * how far down the chain of buffers we are. */
 } ABindInfo;
 
 /* Stuff allocated by compile_file (in alma.c); returned so
@@ -303,6 +374,11 @@ struct AScope;
 /* Typedef for built-in functions. */
 typedef void (*APrimitiveFunc)(AStack *, struct AVarBuffer*);
 
+/* The form of a built-in operator that the interpreter can call on the
+ * top two values of the stack itself: it takes over the references to
+ * the second and top values, and returns a new reference to the result. */
+typedef AValue *(*ABinaryFunc)(AValue *, AValue *);
+
 /* Tag for user functions: have we compiled them yet? */
 typedef enum {
     dummy_func,     // function found in scope but not yet compiled
@@ -327,6 +403,9 @@ typedef struct AUserFunc {
          * name in running code, it's important to have only
          * as many variables in scope as there were when the
          * function was declared. */
+    unsigned int bind_depth;        // how many binds deep it was declared
+        /* A call from n binds deep finds the function's
+         * var-buffer n - bind_depth steps up the chain. */
 } AUserFunc;
 
 /* Builtin or declared function bound to symbol? */
@@ -348,7 +427,11 @@ typedef struct AFunc {
                     // as the thing they were first named...
                     // maybe something to change later
     union {
-        int varindex; // if var_push, which var to push?
+        struct {
+            int index;          // if var_push, which var to push?
+            unsigned int depth; // ...from the buffer made by which bind,
+            unsigned int slot;  // ...and where in that buffer
+        } var;
         APrimitiveFunc primitive;
         AUserFunc *userfunc;
             /* using a UserFunc here rather than just a WordSeq
@@ -359,6 +442,7 @@ typedef struct AFunc {
              * that call each other and need to know their
              * types though :( */
     } data;
+    ABinaryFunc binary; // if it's an operator, its form that skips the stack
 } AFunc;
 
 /* Struct representing a mapping between symbols and functions */
@@ -379,6 +463,198 @@ typedef struct AScope {
     AScopeEntry *content;
 } AScope;
 
+/*-*-* types.h *-*-*/
+
+/* A set of AValueTypes, as a bitmask with bit (1 << t) set for each
+ * type t a value might have. The type pass works with these rather
+ * than single types, so that "could be anything" is just all ones. */
+typedef unsigned int AType;
+
+/* What the type pass knows about one slot on the stack. */
+typedef struct ASlotType {
+    AType type;             // what it might be
+    int input;              // which of the code's inputs it is (0 = top), or -1
+    struct ACode *block;    // the code of the block it is, if that's known
+} ASlotType;
+
+/* What running a piece of code does to the stack, as the type pass
+ * worked it out: ( needs[in-1] .. needs[0] -- gives[out-1] .. gives[0] ). */
+typedef struct AStackEffect {
+    int known;              // 0 if it does something the pass can't follow
+    unsigned int in;        // how many values it takes off the stack
+    unsigned int out;       // how many it leaves in their place
+    int max;                // how far above where it started the stack gets
+    AType *needs;           // what each input has to be (0 = top)
+    ASlotType *gives;       // what each output is (0 = top)
+    int pure;               // 1 if it's proven to do nothing but change the stack
+} AStackEffect;
+
+/* The types of the variables in one var-buffer, as far as the type
+ * pass knows, linked up the same way the var-buffers will be. */
+typedef struct ATypeEnv {
+    ASlotType *vars;
+    unsigned int count;
+    struct ATypeEnv *parent;
+} ATypeEnv;
+
+/* The type pass's picture of the stack partway through some code. */
+typedef struct ATypeState {
+    ASlotType *slots;       // what the code has pushed and not popped, bottom first
+    unsigned int size;
+    unsigned int capacity;
+    AStackEffect effect;    // what it's done so far
+    ATypeEnv *env;          // the variables it can see
+    unsigned int errors;
+} ATypeState;
+
+/*-*-* bytecode.h *-*-*/
+
+/* Possible bytecode instructions. */
+typedef enum {
+    op_push_const,      // push a constant value (arg.val)
+    op_call_prim,       // call a built-in function (arg.func)
+    op_call_user,       // call a user-defined word (arg.func)
+    op_push_var,        // push a bound variable (arg.var)
+    op_bind,            // move the top <arg.count> values into a new var-buffer
+    op_bind_local,      // same, but nothing can keep it past its unbind
+    op_unbind,          // drop the innermost var-buffer
+    op_make_closure,    // create a bound block from a free block (arg.val)
+    op_reify_list,      // create a real list from a proto-list (arg.pl)
+    op_apply,           // run the block on top of the stack
+    op_dip,             // run the block on top, under the value below it
+    op_if,              // run a condition block, then one of two branches
+    op_ifstar,          // same, but keep the value under the condition
+    op_dup,             // the stack shuffles (arg.func), which the
+    op_swap,            //   interpreter does itself, so it can keep
+    op_over,            //   the top value where it is
+    op_drop,
+    op_add_int,         // the arithmetic and comparison built-ins (arg.func),
+    op_sub_int,         //   where the type pass has proven both arguments are
+    op_mul_int,         //   ints, so the interpreter can do it itself
+    op_div_int,
+    op_mod_int,
+    op_lt_int,
+    op_gt_int,
+    op_le_int,
+    op_ge_int,
+    op_eq_int,
+    op_ne_int,
+    op_add_const,       // superinstructions: an int constant (arg.val)
+    op_sub_const,       //   followed by a call to +, -, =, < or >, which
+    op_eq_const,        //   is the next instruction, and gets skipped
+    op_lt_const,
+    op_gt_const,
+    op_dup_call,        // dup, then the built-in in the next instruction
+    op_swap_call,       // swap, then the built-in in the next instruction
+    op_dip2,            // 'dip dip: run the block under the top value,
+                        //   under the value below it (skips the next one)
+    op_return,          // end of the sequence
+} AOpcode;
+
+/* A single bytecode instruction. */
+typedef struct AInstruction {
+    AOpcode op;
+    unsigned int file;      // which file it came from (see code_file_name)
+    union {
+        AValue *val;
+        struct AFunc *func;
+        AVarRef var;
+        int count;
+        struct AProtoList *pl;
+    } arg;
+    unsigned int linenum;   // where it came from, for error messages
+    unsigned char tail;     // call with nothing but unbinds/return after it
+    unsigned short depth;   // how many binds deep a call (or a new bind) is
+#ifdef ALMA_NGRAMS
+    unsigned long count;    // how many times it's been run (see ngram.c)
+#endif
+} AInstruction;
+
+/* A word-sequence lowered into a flat array of instructions.
+ * Nested let and bind bodies are spliced in directly, so
+ * the only things that need their own ACode are function
+ * bodies, blocks, and the elements of proto-lists. */
+typedef struct ACode {
+    AInstruction *instrs;
+    unsigned int length;
+    unsigned int capacity;
+    AVarRef *captures;          // for a flat closure, the vars it copies
+    unsigned int capture_count; //   (NULL if it keeps the whole chain)
+    int typed;                  // has it been through the type pass?
+    AStackEffect effect;        //   if so, what it does to the stack
+#ifdef ALMA_NGRAMS
+    unsigned int live_index;    // where it is in the list of code to count up
+#endif
+} ACode;
+
+/*-*-* ngram.h *-*-*/
+
+/* How many times a sequence of instructions was run (see ngram.c). */
+typedef struct ANgram {
+    char *key;              // the instructions' names, separated by spaces
+    unsigned int length;    // how many instructions
+    unsigned long count;
+    UT_hash_handle hh;
+} ANgram;
+
+/*-*-* eval.h *-*-*/
+
+/* What to do when the interpreter returns into a frame. */
+typedef enum {
+    frame_call,     // just carry on from the return address
+    frame_dip,      // push the saved value back first
+    frame_dip2,     // push both saved values back first
+    frame_if,       // pop a condition and run one of the branches
+    frame_ifstar,   // same, but push the saved value back first
+} AFrameKind;
+
+/* An entry on the interpreter's return stack. Holds everything
+ * about the caller that is needed to resume it once the callee
+ * returns. */
+typedef struct AFrame {
+    AFrameKind kind;
+    AInstruction *ip;       // where to pick up again
+    AVarBuffer *buf;        // the caller's var-buffer
+    AValue *held;           // block the caller was running, if any
+    int reserved;           // whether the caller made room for its pushes
+    AValue *saved;          // value put aside by dip / if*
+    AValue *saved2;         // the one on top of it, for 'dip dip
+    AValue *then;           // branches of if / if*
+    AValue *otherwise;
+} AFrame;
+
+/*-*-* seq.h *-*-*/
+
+/* The kinds of lazy sequence. */
+typedef enum {
+    range_seq,      // the ints from <from> up to (not including) <to>
+    iterate_seq,    // <seed>, <gen> applied to that, etc., while <pred> says so
+    map_seq,        // <block> applied to each element of <source>
+    filter_seq,     // the elements of <source> that <block> says to keep
+} ASeqKind;
+
+/* A lazy sequence. Doesn't hold its elements, just what it needs to
+ * work them out, so it takes the same space however long it is. */
+typedef struct ASeq {
+    ASeqKind kind;
+    long from;                  // range bounds
+    long to;
+    AValue *seed;               // first element of an iterate
+    AValue *block;              // map/filter block, or iterate's <gen>
+    AValue *pred;               // iterate's test
+    int until;                  // does the iterate stop once <pred> is true?
+    AValue *source;             // the sequence a map or filter looks at
+} ASeq;
+
+/* A cursor going through a lazy sequence. */
+typedef struct ASeqIter {
+    ASeq *seq;
+    long next;                  // next int in a range
+    AValue *current;            // next value of an iterate, or NULL once done
+    struct ASeqIter *source;    // cursor going through a map/filter's source
+    AStack *stack;              // stack to run blocks on
+} ASeqIter;
+
 /* Struct that keeps track of all user-defined functions, so that
  * we can free them at the end without keeping track of the number
  * of references to them. */
@@ -388,4 +664,114 @@ typedef struct AFuncRegistry {
     int capacity;
 } AFuncRegistry;
 
+/*-*-* import.h *-*-*/
+
+/* A module that's already been compiled this run, so importing it
+ * again can reuse its scope rather than compiling it all over. */
+typedef struct AModule {
+    char *path;             // the file it came from (the hash key)
+    uint64_t hash;          // the hash of what was in it when it was compiled
+    struct AScope *scope;   // everything it defines
+    UT_hash_handle hh;
+} AModule;
+
+/*-*-* cache.h *-*-*/
+
+/* Bytes being put together to write out to a cache file. */
+typedef struct ACacheBuffer {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} ACacheBuffer;
+
+/* How far we've got reading a cache file back in. Running off the
+ * end sets <failed>, and everything after that reads as zero. */
+typedef struct ACacheReader {
+    const unsigned char *pos;
+    const unsigned char *end;
+    int failed;
+    ASymbolTable *symtab;   // where to look up the symbols it names
+} ACacheReader;
+
+
+/*-*-* profile.h *-*-*/
+
+/* What --profile has found out about one piece of code: a word's
+ * body, or a block (see profile.c). */
+typedef struct AProfileEntry {
+    struct ACode *code;     // what ran (the hash key)
+    char *name;             // the word's name, or NULL for a block
+    char *owner;            // for a block, the word it's written in (if known)
+    unsigned int index;     //   and which of the blocks in there it is
+    unsigned int linenum;   // where it starts
+    unsigned long calls;
+    uint64_t inclusive;     // nanoseconds, counting what it called
+    uint64_t exclusive;     //   and not counting that
+    unsigned int active;    // how many calls to it haven't returned yet
+    UT_hash_handle hh;
+} AProfileEntry;
+
+/* A call that hasn't returned yet, on profile.c's shadow call stack. */
+typedef struct AProfileFrame {
+    AProfileEntry *entry;
+    uint64_t start;         // when it was called
+    uint64_t children;      // time spent in what it called since
+} AProfileFrame;
+
+/* How many times the sampling profiler caught the program with the
+ * same calls on the shadow call stack. */
+typedef struct AProfileSample {
+    char *stack;            // the calls, outermost first, separated by ;
+    unsigned long count;
+    UT_hash_handle hh;
+} AProfileSample;
+
+
+/*-*-* alloc.h (--alloc-stats) *-*-*/
+
+/* What --alloc-stats counts the allocations of. The first ones are
+ * values (made by alloc_val), one for each AValueType, in the same
+ * order; the rest are the things values point to. */
+typedef enum {
+    alloc_list = seq_val + 1,   // AList
+    alloc_list_buffer,          // AListBuffer, with its slots
+    alloc_varbuf,               // AVarBuffer, with its slots (not on-stack ones)
+    alloc_userfunc,             // AUserFunc, for a bound block
+    alloc_ustr,                 // AUstr, with its characters
+    alloc_kind_count,
+} AAllocKind;
+
+/* How many of one kind of thing have been allocated and freed. */
+typedef struct AAllocCount {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long live;
+    unsigned long peak;
+    unsigned long long bytes;   // allocated in total
+} AAllocCount;
+
+/* The allocations of one kind of thing made by one line of code. */
+typedef struct AAllocSite {
+    struct {
+        int kind;               // an AAllocKind (or AValueType)
+        unsigned int file;      //   and the file (see code_file_name)
+        unsigned int linenum;   //   and the line (the hash key)
+    } key;
+    unsigned long allocs;
+    unsigned long long bytes;
+    UT_hash_handle hh;
+} AAllocSite;
+
+/* The places that can change a list in place when nothing else is
+ * using it, but have to copy it otherwise. */
+typedef enum {
+    reuse_tail,         // tail_list_val
+    reuse_init,         // init_list_val
+    reuse_cons,         // cons_list_val
+    reuse_append,       // append_list_val
+    reuse_reserve,      // list_reserve, making room at either end
+    reuse_unshared,     // list_val_unshared, for the list kernels
+    reuse_path_count,
+} AReusePath;
+
 #endif
@@ -1,5 +1,7 @@
 #include "ast.h"
 
+extern AValue *ref(AValue*);
+
 /* Allocate a new AST node with no information */
 static
 AAstNode *ast_newnode(void) {
@@ -67,7 +69,7 @@ AAstNode *ast_valnode(unsigned int location, AValue *val) {
      * doesn't get freed. Because it lives in the AST, it
      * will get freed at program end, as opposed to being
      * created dynamically. */
-    val->refs ++;
+    ref(val);
 
     return newnode;
 }
@@ -151,6 +153,7 @@ AWordSeqNode *ast_wordseq_new(void) {
     newnode->first = NULL;
     newnode->last = NULL;
     newnode->next = NULL;
+    newnode->code = NULL;
     return newnode;
 }
 
@@ -285,6 +288,7 @@ AProtoList *ast_protolist_new(void) {
     AProtoList *newlist = malloc(sizeof(AProtoList));
     newlist->first = NULL;
     newlist->last = NULL;
+    newlist->constant = NULL;
     return newlist;
 }
 
@@ -433,6 +437,7 @@ void fprint_decl_seq(FILE *out, ADeclSeqNode *x) {
 
 //extern void free_symbol(ASymbol*);
 extern void delete_ref(AValue*);
+extern void free_code(ACode*);
 
 void free_wordseq_node(AWordSeqNode *to_free);
 void free_let(ALetNode *to_free);
@@ -465,6 +470,8 @@ void free_ast_node(AAstNode *to_free) {
 
 /* Free a protolist. */
 void free_protolist(AProtoList *to_free) {
+    /* (the list goes first, since it points at the values in the AST) */
+    if (to_free->constant != NULL) delete_ref(to_free->constant);
     AWordSeqNode *current = to_free->first;
     while (current != NULL) {
         AWordSeqNode *next = current->next;
@@ -483,6 +490,7 @@ void free_wordseq_node(AWordSeqNode *to_free) {
         free_ast_node(current);
         current = next;
     }
+    free_code(to_free->code);
     free(to_free);
 }
 
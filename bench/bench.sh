@@ -0,0 +1,156 @@
+#!/bin/sh
+# Time the Alma programs in the tree and compare against a baseline.
+#
+# usage: bench/bench.sh [-n runs] [-o results.json] [-b baseline.json]
+#                       [-t percent] [-s] [program...]
+#
+# Runs each program (by default projecteuler/*.alma, examples/*.alma
+# and the workloads in bench/) once to warm up the module cache, then
+# <runs> more times (default 5), and prints the median and fastest
+# wall-clock time, the spread between fastest and slowest (as a
+# percentage of the median), and the peak RSS. Programs that exit
+# with an error are listed as failing and not timed.
+#
+# The results are written as JSON to <results.json> (default
+# bench/results.json). If the baseline (default bench/baseline.json)
+# exists, each median is compared against it, and anything more than
+# <percent> (default 10) slower, or that has started failing, is
+# flagged as a regression, and the script exits with status 1. -s
+# saves these results as the new baseline.
+#
+# `make bench` and `make bench-baseline` build everything and run
+# this. Set ALMA to use some other alma binary than ./alma.
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=5
+RESULTS=bench/results.json
+BASELINE=bench/baseline.json
+THRESHOLD=10
+SAVE=
+while getopts n:o:b:t:s opt; do
+    case $opt in
+        n) RUNS=$OPTARG ;;
+        o) RESULTS=$OPTARG ;;
+        b) BASELINE=$OPTARG ;;
+        t) THRESHOLD=$OPTARG ;;
+        s) SAVE=1 ;;
+        *) sed -n '4,5s/^# //p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+PROGRAMS=${*:-projecteuler/*.alma examples/*.alma bench/*.alma}
+ALMA=${ALMA:-./alma}
+RUN=bench/run
+TMP=${TMPDIR:-/tmp}/alma-bench.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+export ALMA_PATH=${ALMA_PATH:-lib}
+
+for exe in "$ALMA" "$RUN"; do
+    if [ ! -x "$exe" ]; then
+        echo "$exe isn't built (try \`make bench\`)" >&2
+        exit 2
+    fi
+done
+
+# JSON objects for each program, one per line (so that awk can read
+# the baseline back in).
+: > "$TMP/programs"
+
+printf "%-40s %10s %10s %8s %9s\n" program median min spread "peak rss"
+for prog in $PROGRAMS; do
+    # (the warm-up run, also to see whether it works at all)
+    set -- $("$RUN" "$ALMA" "$prog" < /dev/null 2> "$TMP/stderr")
+    if [ "$3" != 0 ]; then
+        printf "%-40s %10s (exit status %s)\n" "$prog" FAILED "$3"
+        printf '    {"program": "%s", "status": "failed", "exit": %s}\n' \
+            "$prog" "$3" >> "$TMP/programs"
+        continue
+    fi
+
+    : > "$TMP/times"
+    rss=0
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        set -- $("$RUN" "$ALMA" "$prog" < /dev/null 2> /dev/null)
+        echo "$1" >> "$TMP/times"
+        if [ "$2" -gt $rss ]; then rss=$2; fi
+        i=$((i + 1))
+    done
+
+    # median, min, max in ms, then the spread as a % of the median
+    set -- $(sort -n "$TMP/times" | awk '
+        { t[NR] = $1 / 1e6 }
+        END {
+            median = (NR % 2) ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+            spread = median > 0 ? 100 * (t[NR] - t[1]) / median : 0
+            printf "%.3f %.3f %.3f %.1f\n", median, t[1], t[NR], spread
+        }')
+    printf "%-40s %8.1fms %8.1fms %7.1f%% %7dkB\n" "$prog" "$1" "$2" "$4" "$rss"
+    printf '    {"program": "%s", "status": "ok", "median_ms": %s, "min_ms": %s, "max_ms": %s, "spread_pct": %s, "peak_rss_kb": %s}\n' \
+        "$prog" "$1" "$2" "$3" "$4" "$rss" >> "$TMP/programs"
+done
+
+{
+    printf '{\n  "runs": %s,\n  "alma": "%s",\n  "programs": [\n' "$RUNS" "$ALMA"
+    sed '$!s/$/,/' "$TMP/programs"
+    printf '  ]\n}\n'
+} > "$RESULTS"
+echo "results written to $RESULTS"
+
+status=0
+if [ -f "$BASELINE" ] && [ "$BASELINE" != "$RESULTS" ]; then
+    echo
+    echo "compared to $BASELINE (flagging anything over $THRESHOLD% slower):"
+    awk -v threshold="$THRESHOLD" '
+        # the value of <key> in a line of the programs list
+        function field(line, key,    s) {
+            if (!match(line, "\"" key "\": *(\"[^\"]*\"|[^,}]*)")) return ""
+            s = substr(line, RSTART, RLENGTH)
+            sub(/^[^:]*: */, "", s)
+            gsub(/"/, "", s)
+            return s
+        }
+        !/"program":/ { next }
+        FNR == NR {
+            base[field($0, "program")] = field($0, "status") == "ok" ? field($0, "median_ms") : "failed"
+            next
+        }
+        {
+            prog = field($0, "program")
+            if (!(prog in base)) {
+                printf "  %-40s %s\n", prog, "new"
+                next
+            }
+            if (field($0, "status") != "ok") {
+                if (base[prog] != "failed") {
+                    printf "  %-40s %s\n", prog, "REGRESSION: now failing"
+                    regressions++
+                }
+                next
+            }
+            if (base[prog] == "failed") {
+                printf "  %-40s %s\n", prog, "now working"
+                next
+            }
+            now = field($0, "median_ms")
+            change = base[prog] > 0 ? 100 * (now - base[prog]) / base[prog] : 0
+            printf "  %-40s %8.1fms -> %8.1fms %+7.1f%%%s\n", prog, base[prog], now, change,
+                   (change > threshold) ? "  REGRESSION" : ""
+            if (change > threshold) regressions++
+        }
+        END {
+            if (regressions) {
+                printf "%d regression%s\n", regressions, regressions == 1 ? "" : "s"
+                exit 1
+            }
+        }' "$BASELINE" "$RESULTS" || status=1
+fi
+
+if [ -n "$SAVE" ]; then
+    cp "$RESULTS" "$BASELINE" && echo "saved as the baseline in $BASELINE"
+fi
+exit $status
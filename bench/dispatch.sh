@@ -0,0 +1,71 @@
+#!/bin/sh
+# Compare the portable switch interpreter loop against the
+# computed-goto one (`make THREADED=1`).
+#
+# usage: bench/dispatch.sh [runs]
+#
+# Builds alma both ways (from a clean tree each time), then runs
+# examples/quicksort.alma and each of the projecteuler programs
+# <runs> times (default 5) with each binary, and prints the best
+# wall-clock time for each. Set ALMA_SWITCH and ALMA_THREADED to
+# already-built binaries to skip the build step.
+
+cd "$(dirname "$0")/.." || exit 1
+
+RUNS=${1:-5}
+PROGRAMS="examples/quicksort.alma projecteuler/*.alma"
+TMP=${TMPDIR:-/tmp}/alma-dispatch.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+export ALMA_PATH=${ALMA_PATH:-lib}
+
+build() {
+    make clean > /dev/null
+    make alma THREADED=$1 > "$TMP/build.log" 2>&1 || {
+        cat "$TMP/build.log"
+        echo "build failed (THREADED=$1)" >&2
+        exit 1
+    }
+    cp alma "$2"
+}
+
+if [ -z "$ALMA_SWITCH" ]; then
+    ALMA_SWITCH=$TMP/alma-switch
+    build 0 "$ALMA_SWITCH"
+fi
+if [ -z "$ALMA_THREADED" ]; then
+    ALMA_THREADED=$TMP/alma-threaded
+    build 1 "$ALMA_THREADED"
+fi
+
+# Milliseconds since the epoch (needs GNU date).
+now() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# best <binary> <program>: fastest of $RUNS runs, in ms
+best() {
+    min=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(now)
+        "$1" "$2" > /dev/null 2>&1
+        t=$(( $(now) - start ))
+        if [ -z "$min" ] || [ $t -lt $min ]; then min=$t; fi
+        i=$((i + 1))
+    done
+    echo $min
+}
+
+printf "%-32s %10s %10s %8s\n" program switch threaded speedup
+for prog in $PROGRAMS; do
+    s=$(best "$ALMA_SWITCH" "$prog")
+    t=$(best "$ALMA_THREADED" "$prog")
+    if [ "$t" -gt 0 ]; then
+        speedup=$(awk "BEGIN { printf \"%.2fx\", $s / $t }")
+    else
+        speedup=-
+    fi
+    printf "%-32s %8dms %8dms %8s\n" "$prog" "$s" "$t" "$speedup"
+done
@@ -0,0 +1,76 @@
+/* Run a program once for bench/bench.sh, and say how it went.
+ *
+ * usage: bench/run <program> [args...]
+ *
+ * Runs <program> with its output thrown away (errors still go to
+ * stderr), and prints one line: the wall-clock time it took in
+ * nanoseconds, its peak resident set size in kilobytes, and its exit
+ * status (or 128 plus the signal that killed it). The shell can't get
+ * at the peak RSS of something it ran without GNU time, which isn't
+ * always around, so that's what this is for. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* The time now, in nanoseconds from some fixed point. */
+static
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <program> [args...]\n", argv[0]);
+        return 2;
+    }
+
+    uint64_t start = now_ns();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 2;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            close(null);
+        }
+        execvp(argv[1], argv + 1);
+        perror(argv[1]);
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            perror("waitpid");
+            return 2;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    /* (ru_maxrss is already in kilobytes on Linux and the BSDs, but in
+     * bytes on macOS) */
+    long maxrss = usage.ru_maxrss;
+#ifdef __APPLE__
+    maxrss /= 1024;
+#endif
+    printf("%llu %ld %d\n", (unsigned long long)elapsed, maxrss, code);
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "alma.h"
+#include "stack.h"
+#include "value.h"
+#include "list.h"
+#include "vars.h"
+#include "symbols.h"
+#include "scope.h"
+#include "ustrings.h"
+#include "lib.h"
+
+/* Microbenchmarks for the interpreter's innards: each one does some
+ * basic operation (pushing onto the stack, consing onto a list,
+ * looking up a variable...) over and over on its own, so that a change
+ * to value.c or list.c shows up as a change in what that one operation
+ * costs, rather than somewhere in the time a whole program takes.
+ *
+ * usage: bench_alma [-n iterations] [name...]
+ *
+ * Runs the benchmarks whose names start with any of the <name>s (or
+ * all of them), each BENCH_REPEATS times, and prints the best of those
+ * as cycles and nanoseconds per operation. On x86 the cycles are read
+ * from the time-stamp counter, which ticks at a fixed rate rather than
+ * the CPU's current clock speed, so they're only exact with frequency
+ * scaling off; elsewhere there's no cycle counter and that column is
+ * left out. */
+
+/* How many times to run each benchmark (keeping the fastest). */
+#define BENCH_REPEATS 5
+
+/* How many operations each run does, unless -n says otherwise. */
+#define BENCH_ITERATIONS 1000000
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_CYCLES
+#endif
+
+/* Results get written here, so the compiler can't throw away the
+ * work that made them. */
+static volatile uintptr_t sink;
+
+/* The symbol table and scopes from lib_init, for the lookups. */
+static ASymbolTable symtab = NULL;
+static AScope *lib_scope = NULL;
+
+/* The time now, in nanoseconds from some fixed point. */
+static
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The cycle counter now (or 0 if there isn't one). */
+static
+uint64_t now_cycles(void) {
+#ifdef BENCH_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* Push <n> values and pop them again, a few at a time. */
+static
+void bench_stack_push_pop(unsigned long n) {
+    AStack *st = stack_new(20);
+    AValue *v = val_int(1);
+    for (unsigned long i = 0; i < n; i += 8) {
+        for (int j = 0; j < 8; j++) {
+            stack_push(st, v);
+        }
+        stack_pop(st, 8);
+    }
+    free_stack(st);
+}
+
+/* Take a reference to a heap value and let it go again, <n> times. */
+static
+void bench_ref_delete_ref(unsigned long n) {
+    AValue *v = ref(val_list(list_new()));
+    for (unsigned long i = 0; i < n; i++) {
+        AValue *r = ref(v);
+        sink = (uintptr_t)r;
+        delete_ref(r);
+    }
+    delete_ref(v);
+}
+
+/* Cons <n> ints onto the front of a list, 1000 at a time. */
+static
+void bench_list_cons(unsigned long n) {
+    for (unsigned long i = 0; i < n; i += 1000) {
+        AList *l = list_new();
+        for (int j = 0; j < 1000; j++) {
+            list_cons(val_int(j), l);
+        }
+        sink = l->length;
+        free_list(l);
+    }
+}
+
+/* Append <n> ints onto the end of a list, 1000 at a time. */
+static
+void bench_list_append(unsigned long n) {
+    for (unsigned long i = 0; i < n; i += 1000) {
+        AList *l = list_new();
+        for (int j = 0; j < 1000; j++) {
+            list_append(l, val_int(j));
+        }
+        sink = l->length;
+        free_list(l);
+    }
+}
+
+/* Take the tail of a list <n> times, 1000 at a time. (Nothing else
+ * has hold of the list, so it can reuse it each time.) */
+static
+void bench_tail_list_val(unsigned long n) {
+    AList *l = list_new();
+    for (int j = 0; j < 1000; j++) {
+        list_append(l, val_int(j));
+    }
+    for (unsigned long i = 0; i < n; i += 1000) {
+        AValue *v = ref(val_list(list_slice(l, 0, 1000)));
+        for (int j = 0; j < 1000; j++) {
+            AValue *tail = tail_list_val(v);
+            delete_ref(v);
+            v = tail;
+        }
+        sink = (uintptr_t)v;
+        delete_ref(v);
+    }
+    free_list(l);
+}
+
+/* Get a variable <depth> var-buffers up from the current one, <n>
+ * times. */
+static
+void bench_varbuf_get_at(unsigned long n, unsigned int depth) {
+    AVarBuffer *buf = varbuf_new(NULL, 1);
+    varbuf_put(buf, 0, ref(val_list(list_new())));
+    varbuf_ref(buf);
+    for (unsigned int d = 0; d < depth; d++) {
+        AVarBuffer *inner = varbuf_new(buf, 1);
+        varbuf_put(inner, 0, val_int(d));
+        varbuf_ref(inner);
+        varbuf_unref(buf);
+        buf = inner;
+    }
+    for (unsigned long i = 0; i < n; i++) {
+        AValue *v = varbuf_get(buf, 0);
+        sink = (uintptr_t)v;
+        delete_ref(v);
+    }
+    varbuf_unref(buf);
+}
+
+static void bench_varbuf_get_0(unsigned long n)  { bench_varbuf_get_at(n, 0); }
+static void bench_varbuf_get_1(unsigned long n)  { bench_varbuf_get_at(n, 1); }
+static void bench_varbuf_get_4(unsigned long n)  { bench_varbuf_get_at(n, 4); }
+static void bench_varbuf_get_16(unsigned long n) { bench_varbuf_get_at(n, 16); }
+
+/* Look up names that are already in the symbol table, <n> times. */
+static
+void bench_get_symbol(unsigned long n) {
+    static const char *names[] = { "dup", "swap", "while", "map", "concat", "say", "if*", "len" };
+    for (unsigned long i = 0; i < n; i++) {
+        sink = (uintptr_t)get_symbol(&symtab, names[i & 7]);
+    }
+}
+
+/* Look up built-in words from a scope <depth> scopes inside the
+ * library one, <n> times. */
+static
+void bench_scope_lookup_at(unsigned long n, unsigned int depth) {
+    static const char *names[] = { "dup", "swap", "while", "map", "concat", "say", "if*", "len" };
+    ASymbol *syms[8];
+    for (int j = 0; j < 8; j++) {
+        syms[j] = get_symbol(&symtab, names[j]);
+    }
+    AScope *sc = lib_scope;
+    for (unsigned int d = 0; d < depth; d++) {
+        sc = scope_new(sc);
+    }
+    for (unsigned long i = 0; i < n; i++) {
+        sink = (uintptr_t)scope_lookup(sc, syms[i & 7]);
+    }
+    while (sc != lib_scope) {
+        AScope *parent = sc->parent;
+        free_scope(sc);
+        sc = parent;
+    }
+}
+
+static void bench_scope_lookup_0(unsigned long n) { bench_scope_lookup_at(n, 0); }
+static void bench_scope_lookup_4(unsigned long n) { bench_scope_lookup_at(n, 4); }
+
+/* Parse a short string literal (with an escape and a non-ASCII
+ * character in it) <n> times. */
+static
+void bench_parse_string(unsigned long n) {
+    static const char text[] = "hello, w\xc3\xb6rld!\\n";
+    for (unsigned long i = 0; i < n; i++) {
+        AUstr *s = parse_string(text, sizeof(text) - 1);
+        sink = s->length;
+        free_ustring(s);
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*run)(unsigned long n);
+} benchmarks[] = {
+    { "stack_push+pop",     bench_stack_push_pop },
+    { "ref+delete_ref",     bench_ref_delete_ref },
+    { "list_cons",          bench_list_cons },
+    { "list_append",        bench_list_append },
+    { "tail_list_val",      bench_tail_list_val },
+    { "varbuf_get/0",       bench_varbuf_get_0 },
+    { "varbuf_get/1",       bench_varbuf_get_1 },
+    { "varbuf_get/4",       bench_varbuf_get_4 },
+    { "varbuf_get/16",      bench_varbuf_get_16 },
+    { "get_symbol",         bench_get_symbol },
+    { "scope_lookup/0",     bench_scope_lookup_0 },
+    { "scope_lookup/4",     bench_scope_lookup_4 },
+    { "parse_string",       bench_parse_string },
+};
+
+#define BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* Is <name> one of the ones asked for on the command line? */
+static
+int wanted(const char *name, int argc, char **argv) {
+    if (argc == 0) return 1;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(name, argv[i], strlen(argv[i])) == 0) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long iterations = BENCH_ITERATIONS;
+    argc --; argv ++;
+    if (argc >= 2 && strcmp(argv[0], "-n") == 0) {
+        iterations = strtoul(argv[1], NULL, 10);
+        argc -= 2; argv += 2;
+    }
+    if (iterations == 0 || (argc > 0 && argv[0][0] == '-')) {
+        fprintf(stderr, "usage: bench_alma [-n iterations] [name...]\n");
+        return 1;
+    }
+
+    lib_scope = scope_new(NULL);
+    lib_init(&symtab, lib_scope, 0);
+
+#ifdef BENCH_CYCLES
+    printf("%-20s %12s %12s\n", "operation", "cycles/op", "ns/op");
+#else
+    printf("%-20s %12s\n", "operation", "ns/op");
+#endif
+    for (unsigned int b = 0; b < BENCH_COUNT; b++) {
+        if (!wanted(benchmarks[b].name, argc, argv)) continue;
+        uint64_t best_ns = UINT64_MAX;
+        uint64_t best_cycles = UINT64_MAX;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            uint64_t start_ns = now_ns();
+            uint64_t start_cycles = now_cycles();
+            benchmarks[b].run(iterations);
+            uint64_t cycles = now_cycles() - start_cycles;
+            uint64_t ns = now_ns() - start_ns;
+            if (ns < best_ns) best_ns = ns;
+            if (cycles < best_cycles) best_cycles = cycles;
+        }
+#ifdef BENCH_CYCLES
+        printf("%-20s %12.2f %12.2f\n", benchmarks[b].name,
+               (double)best_cycles / iterations, (double)best_ns / iterations);
+#else
+        printf("%-20s %12.2f\n", benchmarks[b].name, (double)best_ns / iterations);
+#endif
+    }
+
+    free_lib_scope(lib_scope);
+    free_symbol_table(&symtab);
+    return 0;
+}
@@ -0,0 +1,583 @@
+#include "bytecode.h"
+#include "ngram.h"
+#include "profile.h"
+
+/* The files that code has been lowered from, so instructions can say
+ * which one they came from by its index in here. (0 is for code that
+ * didn't come from a file.) */
+static char **code_files = NULL;
+static unsigned int code_file_count = 0;
+
+/* The file the code being lowered right now came from. */
+unsigned int lowering_file = 0;
+
+/* The index that instructions from the file <path> get. */
+unsigned int code_file_index(const char *path) {
+    for (unsigned int i = 0; i < code_file_count; i++) {
+        if (strcmp(code_files[i], path) == 0) return i + 1;
+    }
+    code_files = realloc(code_files, (code_file_count + 1) * sizeof(char*));
+    /* (copied, since the reports that use it come at exit) */
+    code_files[code_file_count] = malloc(strlen(path) + 1);
+    strcpy(code_files[code_file_count], path);
+    return ++ code_file_count;
+}
+
+/* The name of the file with the index <file>, or NULL for 0. */
+const char *code_file_name(unsigned int file) {
+    if (file == 0 || file > code_file_count) return NULL;
+    return code_files[file - 1];
+}
+
+/* Allocate a new, empty bytecode array. */
+ACode *code_new(unsigned int initial_capacity) {
+    ACode *code = malloc(sizeof(ACode));
+    if (initial_capacity == 0) initial_capacity = 1;
+    code->instrs = malloc(initial_capacity * sizeof(AInstruction));
+    code->length = 0;
+    code->capacity = initial_capacity;
+    code->captures = NULL;
+    code->capture_count = 0;
+    code->typed = 0;
+    code->effect.known = 0;
+    code->effect.pure = 0;
+    code->effect.needs = NULL;
+    code->effect.gives = NULL;
+#ifdef ALMA_NGRAMS
+    ngram_track(code);
+#endif
+    return code;
+}
+
+/* Append an instruction to the end of a bytecode array, and
+ * return a pointer to it so the caller can fill in its argument. */
+AInstruction *code_emit(ACode *code, AOpcode op, unsigned int linenum) {
+    if (code->length == code->capacity) {
+        AInstruction *new_array = realloc(code->instrs,
+                code->capacity * 2 * sizeof(AInstruction));
+        if (new_array == NULL) {
+            fprintf(stderr, "Error: couldn't grow bytecode array to %d instructions. "
+                            "Out of memory.\n", code->capacity * 2);
+            return NULL;
+        }
+        code->instrs = new_array;
+        code->capacity *= 2;
+    }
+    AInstruction *instr = &code->instrs[code->length];
+    instr->op = op;
+    instr->file = lowering_file;
+    instr->linenum = linenum;
+    instr->tail = 0;
+    instr->depth = 0;
+#ifdef ALMA_NGRAMS
+    instr->count = 0;
+#endif
+    code->length ++;
+    return instr;
+}
+
+/* Built-ins with no effects besides replacing their arguments with
+ * their result, so that when all the arguments are constant ints we
+ * can work it out right away. */
+static const struct {
+    APrimitiveFunc prim;
+    unsigned int arity;
+} pure_ops[] = {
+    { &lib_add, 2 }, { &lib_subtract, 2 }, { &lib_multiply, 2 },
+    { &lib_div, 2 }, { &lib_mod, 2 },
+    { &lib_lessthan, 2 }, { &lib_greaterthan, 2 },
+    { &lib_lessthanequal, 2 }, { &lib_greaterthanequal, 2 },
+    { &lib_equal, 2 }, { &lib_notequal, 2 }, { &lib_not, 1 },
+};
+
+/* If calling <prim> at the end of <code> is just doing arithmetic on
+ * int constants pushed right before it, replace the pushes with one
+ * push of the answer and return 1. (So 3 4 + comes out as 7, and
+ * 1 neg, once neg is inlined, as -1.) Otherwise return 0. */
+static
+int fold_constants(ACode *code, APrimitiveFunc prim) {
+    unsigned int arity = 0;
+    for (unsigned int i = 0; i < sizeof(pure_ops) / sizeof(pure_ops[0]); i++) {
+        if (pure_ops[i].prim == prim) arity = pure_ops[i].arity;
+    }
+    if (arity == 0 || code->length < arity) return 0;
+
+    AInstruction *args = &code->instrs[code->length - arity];
+    for (unsigned int i = 0; i < arity; i++) {
+        if (args[i].op != op_push_const || !val_is_imm_int(args[i].arg.val)) return 0;
+    }
+    /* leave dividing by zero to complain at runtime */
+    if ((prim == &lib_div || prim == &lib_mod) && val_get_int(args[1].arg.val) == 0) return 0;
+
+    /* run it for real, so the answer is exactly what it would be */
+    AStack *tmp = stack_new(2);
+    for (unsigned int i = 0; i < arity; i++) {
+        stack_push(tmp, args[i].arg.val);
+    }
+    prim(tmp, NULL);
+    AValue *result = stack_get(tmp, 0);
+    free_stack(tmp);
+    if (!val_is_imm_int(result)) {
+        /* (too big to keep around as a constant) */
+        delete_ref(result);
+        return 0;
+    }
+    code->length -= arity - 1;
+    args[0].arg.val = result;
+    return 1;
+}
+
+/* Words whose code is at most this many instructions long get it
+ * copied in wherever they're called, rather than being called.
+ * (-DALMA_INLINE_MAX=0 turns that off.) */
+#ifndef ALMA_INLINE_MAX
+#define ALMA_INLINE_MAX 4
+#endif
+
+/* Can calls to <uf> be replaced with a copy of its code? It has to be
+ * compiled already (so a word can't inline itself), short, and not need
+ * the var-buffers it was declared in, since its code will run in the
+ * caller's instead. Nothing is inlined with --profile on, since the
+ * copies would never show up in the profile as calls to the word. */
+static
+int inlinable(AUserFunc *uf) {
+    if (profiling) return 0;
+    if (uf->type != const_func || uf->free_var_index < uf->vars_below) return 0;
+    if (uf->words == NULL || uf->words->code == NULL) return 0;
+    return uf->words->code->length - 1 <= ALMA_INLINE_MAX;
+}
+
+/* Copy the code of <uf> (apart from its op_return) onto the end of
+ * <code>, where it's <depth> binds deep. Its variables are found
+ * relative to its own binds, so they work wherever it goes; only the
+ * depths written on its binds and calls need moving. */
+static
+void inline_code(ACode *code, AUserFunc *uf, unsigned int depth) {
+    ACode *body = uf->words->code;
+    for (unsigned int i = 0; i + 1 < body->length; i++) {
+        /* (superinstructions get fused again once it's all in place) */
+        AOpcode op = code_base_op(body->instrs[i].op);
+        if ((op == op_call_prim || op_is_int_op(op))
+                && fold_constants(code, body->instrs[i].arg.func->data.primitive)) {
+            continue;
+        }
+        AInstruction *instr = code_emit(code, op, body->instrs[i].linenum);
+        instr->file = body->instrs[i].file;
+        instr->arg = body->instrs[i].arg;
+        instr->depth = body->instrs[i].depth + depth - uf->bind_depth;
+    }
+}
+
+/* Append the instructions for a single word-sequence onto <code>.
+ * let..in and bind nodes don't get their own code; their bodies
+ * are spliced in right where they occur. <depth> is how many binds
+ * deep we are, which is what tells a variable how far up the chain
+ * of var-buffers it lives. */
+static
+void lower_into(ACode *code, AWordSeqNode *seq, unsigned int depth) {
+    if (seq == NULL) return;
+    AAstNode *current = seq->first;
+    while (current != NULL) {
+        AInstruction *instr;
+        if (current->type == func_node) {
+            AFunc *f = current->data.func;
+            if (f->type == primitive_func) {
+                /* Block-running built-ins get their own instructions so
+                 * the interpreter can run the block without recursing,
+                 * and so do the stack shuffles, so it can do them
+                 * without putting the top value back on the stack. */
+                AOpcode op = op_call_prim;
+                if (f->data.primitive == &lib_apply) op = op_apply;
+                else if (f->data.primitive == &lib_dip) op = op_dip;
+                else if (f->data.primitive == &lib_if) op = op_if;
+                else if (f->data.primitive == &lib_ifstar) op = op_ifstar;
+                else if (f->data.primitive == &lib_dup) op = op_dup;
+                else if (f->data.primitive == &lib_swap) op = op_swap;
+                else if (f->data.primitive == &lib_over) op = op_over;
+                else if (f->data.primitive == &lib_drop) op = op_drop;
+                else if (fold_constants(code, f->data.primitive)) {
+                    current = current->next;
+                    continue;
+                }
+                instr = code_emit(code, op, current->linenum);
+                instr->arg.func = f;
+            } else if (f->type == user_func && inlinable(f->data.userfunc)) {
+                inline_code(code, f->data.userfunc, depth);
+            } else if (f->type == user_func) {
+                /* We point at the AFunc rather than the code itself, since
+                 * the function might not have been compiled yet. */
+                instr = code_emit(code, op_call_user, current->linenum);
+                instr->arg.func = f;
+                instr->depth = depth;
+            } else if (f->type == var_push) {
+                instr = code_emit(code, op_push_var, current->linenum);
+                instr->arg.var.up = depth - f->data.var.depth;
+                instr->arg.var.slot = f->data.var.slot;
+            } else {
+                fprintf(stderr, "internal error: unrecognized word type %d "
+                                "while generating bytecode\n", f->type);
+            }
+        } else if (current->type == value_node) {
+            AValue *val = current->data.val;
+            if (val_type(val) == free_block_val) {
+                /* Needs to close over the current var-buffer when pushed. */
+                instr = code_emit(code, op_make_closure, current->linenum);
+                instr->arg.val = val;
+            } else if (val_type(val) == proto_list && val->data.pl->constant != NULL) {
+                /* It's been built already. */
+                instr = code_emit(code, op_push_const, current->linenum);
+                instr->arg.val = val->data.pl->constant;
+            } else if (val_type(val) == proto_list) {
+                instr = code_emit(code, op_reify_list, current->linenum);
+                instr->arg.pl = val->data.pl;
+            } else {
+                instr = code_emit(code, op_push_const, current->linenum);
+                instr->arg.val = val;
+            }
+        } else if (current->type == let_node) {
+            /* Declarations were already handled at compile time. */
+            lower_into(code, current->data.let->words, depth);
+        } else if (current->type == var_bind) {
+            instr = code_emit(code, op_bind, current->linenum);
+            instr->arg.count = current->data.vbind->count;
+            instr->depth = depth + 1;
+            lower_into(code, current->data.vbind->words, depth + 1);
+            code_emit(code, op_unbind, current->linenum);
+        } else {
+            /* Word nodes, bind nodes, and paren nodes should have been
+             * replaced during compilation. */
+            fprintf(stderr, "internal error: can't generate bytecode for "
+                            "AST node type %d\n", current->type);
+        }
+        current = current->next;
+    }
+}
+
+/* Could anything in the instructions from <from> up to <to> keep
+ * hold of a var-buffer that's <level> binds deep, after they're done?
+ * Only a block that closes over the whole chain of buffers can --
+ * whether it's made right there, in one of the elements of a list,
+ * or in a word declared that deep or deeper (which gets called with
+ * the buffers it was declared in). */
+static
+int holds_buffer(AInstruction *from, AInstruction *to, unsigned int level) {
+    for (AInstruction *p = from; p < to; p++) {
+        if (p->op == op_make_closure) {
+            ACode *block_code = p->arg.val->data.ast->code;
+            if (block_code == NULL || block_code->captures == NULL) return 1;
+        } else if (p->op == op_call_user) {
+            AUserFunc *uf = p->arg.func->data.userfunc;
+            if (uf->free_var_index < uf->vars_below && uf->bind_depth >= level) return 1;
+        } else if (p->op == op_reify_list) {
+            for (AWordSeqNode *elem = p->arg.pl->first; elem != NULL; elem = elem->next) {
+                ACode *c = elem->code;
+                if (c != NULL && holds_buffer(c->instrs, c->instrs + c->length, level)) return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Pairs of instructions that get run one after the other often enough
+ * (going by --ngram-stats on examples/ and projecteuler/) to be worth
+ * an instruction of their own: an int constant and then a built-in
+ * that uses it, like 1 + or 0 =, and dup or swap and then a built-in,
+ * like dup * or swap mod. */
+static const struct {
+    APrimitiveFunc prim;
+    AOpcode op;
+} const_ops[] = {
+    { &lib_add, op_add_const }, { &lib_subtract, op_sub_const },
+    { &lib_equal, op_eq_const },
+    { &lib_lessthan, op_lt_const }, { &lib_greaterthan, op_gt_const },
+};
+
+/* Which instruction a superinstruction (see fuse_superinstructions)
+ * started out as. Anything else is just itself. Passes that look at
+ * the code should go by this; the instruction after a superinstruction
+ * is still there, as it was. */
+AOpcode code_base_op(AOpcode op) {
+    switch (op) {
+        case op_add_const: case op_sub_const: case op_eq_const:
+        case op_lt_const: case op_gt_const: case op_dip2:
+            return op_push_const;
+        case op_dup_call:
+            return op_dup;
+        case op_swap_call:
+            return op_swap;
+        default:
+            return op;
+    }
+}
+
+/* Is <val> the block ['dip]? */
+static
+int is_dip_block(AValue *val) {
+    if (val_type(val) != block_val || val->data.ast == NULL) return 0;
+    AAstNode *only = val->data.ast->first;
+    return only != NULL && only->next == NULL && only->type == func_node
+        && only->data.func->type == primitive_func
+        && only->data.func->data.primitive == &lib_dip;
+}
+
+/* Replace common pairs of instructions with superinstructions. The
+ * first of each pair gets the new opcode, and the interpreter runs
+ * both halves in one go, taking what it needs from the second and
+ * carrying on after it; the second stays where it is, so nothing
+ * moves and the other passes can still see what the pair does.
+ * (Builds that count instruction sequences, and `make SUPER=0` ones,
+ * leave them out.) */
+static
+void fuse_superinstructions(ACode *code) {
+#if defined(ALMA_NGRAMS) || defined(ALMA_NO_SUPERINSTRUCTIONS)
+    return;
+#endif
+    for (unsigned int i = 0; i + 1 < code->length; i++) {
+        AInstruction *first = &code->instrs[i];
+        AInstruction *second = &code->instrs[i + 1];
+        AOpcode fused = first->op;
+        if (first->op == op_push_const && second->op == op_dip
+                && is_dip_block(first->arg.val)) {
+            fused = op_dip2;
+        } else if (second->op != op_call_prim) {
+            continue;
+        } else if (first->op == op_push_const && val_is_imm_int(first->arg.val)) {
+            for (unsigned int j = 0; j < sizeof(const_ops) / sizeof(const_ops[0]); j++) {
+                if (const_ops[j].prim == second->arg.func->data.primitive) {
+                    fused = const_ops[j].op;
+                }
+            }
+        } else if (first->op == op_dup) {
+            fused = op_dup_call;
+        } else if (first->op == op_swap) {
+            fused = op_swap_call;
+        }
+        if (fused != first->op) {
+            first->op = fused;
+            /* the second half doesn't start another pair */
+            i++;
+        }
+    }
+}
+
+/* Lower a compiled word-sequence into a flat bytecode array.
+ * The sequence must have been through compile_wordseq already,
+ * so that all its words are resolved to AFunc*s. <depth> is how
+ * many binds it's inside. */
+ACode *code_lower_wordseq(AWordSeqNode *seq, unsigned int depth) {
+    ACode *code = code_new(8);
+    lower_into(code, seq, depth);
+    /* The sentinel at the end means the interpreter loop never
+     * has to check whether it's run off the end of the array. */
+    code_emit(code, op_return, 0);
+
+    /* Mark the calls in tail position (i.e. followed only by the
+     * unbinds of the enclosing binds) so the interpreter can reuse
+     * the current frame for them. dip has to come back to push its
+     * value, so it never counts. */
+    for (unsigned int i = 0; i < code->length; i++) {
+        AOpcode op = code->instrs[i].op;
+        if (op != op_call_user && op != op_apply
+                && op != op_if && op != op_ifstar) continue;
+        unsigned int j = i + 1;
+        while (code->instrs[j].op == op_unbind) j++;
+        code->instrs[i].tail = (code->instrs[j].op == op_return);
+    }
+
+    /* Binds that nothing inside can keep hold of can take their
+     * var-buffers from the frame stack rather than the heap. */
+    for (unsigned int i = 0; i < code->length; i++) {
+        if (code->instrs[i].op != op_bind) continue;
+        unsigned int j = i + 1;
+        int nesting = 0;
+        while (code->instrs[j].op != op_unbind || nesting > 0) {
+            if (code->instrs[j].op == op_bind) nesting ++;
+            if (code->instrs[j].op == op_unbind) nesting --;
+            j++;
+        }
+        if (!holds_buffer(&code->instrs[i + 1], &code->instrs[j], code->instrs[i].depth)) {
+            code->instrs[i].op = op_bind_local;
+        }
+    }
+
+    fuse_superinstructions(code);
+    return code;
+}
+
+/* Point <var> (which is <depth> binds into a flat closure, and reaches
+ * outside it) at its copy in the closure's own buffer, adding it to
+ * <captures> if it isn't there yet. */
+static
+void capture(AVarRef *var, unsigned int depth, AVarRef *captures, unsigned int *n) {
+    /* where it is from where the block gets made */
+    AVarRef outer = { var->up - depth, var->slot };
+    unsigned int j = 0;
+    while (j < *n && (captures[j].up != outer.up || captures[j].slot != outer.slot)) {
+        j++;
+    }
+    if (j == *n) captures[(*n)++] = outer;
+    var->up = depth;
+    var->slot = j;
+}
+
+/* Try to make the code of a free block into a flat closure: instead
+ * of keeping the whole chain of var-buffers it was made in alive, it
+ * copies just the variables it uses into a buffer of its own when it's
+ * made, and looks them up there. Each variable from outside the block
+ * becomes a capture, and its push-var gets pointed at the captured
+ * copy. Flat blocks inside it are fine too -- their captures from
+ * outside just become captures of this one. This only works if the
+ * variables are all the block reaches outside for -- so not if it
+ * makes lists or chained closures of its own, or calls a word that
+ * needs the buffers it was declared in -- and if not, the code is
+ * left alone. Returns whether it worked. */
+int code_flatten_closure(ACode *code) {
+    unsigned int depth = 0;
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < code->length; i++) {
+        AInstruction *instr = &code->instrs[i];
+        if (instr->op == op_make_closure) {
+            ACode *inner = instr->arg.val->data.ast->code;
+            if (inner == NULL || inner->captures == NULL) return 0;
+            count += inner->capture_count;
+        } else if (instr->op == op_reify_list) {
+            return 0;
+        } else if (instr->op == op_call_user) {
+            AUserFunc *uf = instr->arg.func->data.userfunc;
+            if (uf->free_var_index < uf->vars_below) return 0;
+        } else if (instr->op == op_push_var && instr->arg.var.up >= depth) {
+            count ++;
+        } else if (instr->op == op_bind || instr->op == op_bind_local) {
+            depth ++;
+        } else if (instr->op == op_unbind) {
+            depth --;
+        }
+    }
+    if (count == 0) return 0;
+
+    AVarRef *captures = malloc(count * sizeof(AVarRef));
+    unsigned int n = 0;
+    depth = 0;
+    for (unsigned int i = 0; i < code->length; i++) {
+        AInstruction *instr = &code->instrs[i];
+        if (instr->op == op_bind || instr->op == op_bind_local) {
+            depth ++;
+        } else if (instr->op == op_unbind) {
+            depth --;
+        } else if (instr->op == op_push_var && instr->arg.var.up >= depth) {
+            capture(&instr->arg.var, depth, captures, &n);
+        } else if (instr->op == op_make_closure) {
+            ACode *inner = instr->arg.val->data.ast->code;
+            for (unsigned int j = 0; j < inner->capture_count; j++) {
+                if (inner->captures[j].up >= depth) {
+                    capture(&inner->captures[j], depth, captures, &n);
+                }
+            }
+        }
+    }
+    if (n == 0) {
+        /* (everything it used came from its own binds after all) */
+        free(captures);
+        return 0;
+    }
+    code->captures = captures;
+    code->capture_count = n;
+    return 1;
+}
+
+/* Print out a bytecode array, one instruction per line. */
+void fprint_code(FILE *out, ACode *code) {
+    for (unsigned int i = 0; i < code->length; i++) {
+        AInstruction *instr = &code->instrs[i];
+        fprintf(out, "%4u  ", i);
+        switch (instr->op) {
+            case op_push_const:
+                fprintf(out, "push-const   ");
+                fprint_val(out, instr->arg.val);
+                break;
+            case op_call_prim:
+                fprintf(out, "call-prim    %s", instr->arg.func->sym->name);
+                break;
+            case op_call_user:
+                fprintf(out, "call-user    %s", instr->arg.func->sym->name);
+                break;
+            case op_push_var:
+                fprintf(out, "push-var     %u:%u", instr->arg.var.up, instr->arg.var.slot);
+                break;
+            case op_bind:
+                fprintf(out, "bind         %d", instr->arg.count);
+                break;
+            case op_bind_local:
+                fprintf(out, "bind-local   %d", instr->arg.count);
+                break;
+            case op_unbind:
+                fprintf(out, "unbind");
+                break;
+            case op_make_closure:
+                fprintf(out, "make-closure ");
+                fprint_val(out, instr->arg.val);
+                break;
+            case op_reify_list:
+                fprintf(out, "reify-list   { ");
+                fprint_protolist(out, instr->arg.pl);
+                fprintf(out, " }");
+                break;
+            case op_apply:
+                fprintf(out, "apply");
+                break;
+            case op_dip:
+                fprintf(out, "dip");
+                break;
+            case op_if:
+                fprintf(out, "if");
+                break;
+            case op_ifstar:
+                fprintf(out, "if*");
+                break;
+            case op_dup: case op_swap: case op_over: case op_drop:
+                fprintf(out, "%s", instr->arg.func->sym->name);
+                break;
+            case op_add_int: case op_sub_int: case op_mul_int:
+            case op_div_int: case op_mod_int:
+            case op_lt_int: case op_gt_int: case op_le_int:
+            case op_ge_int: case op_eq_int: case op_ne_int:
+                fprintf(out, "int-op       %s", instr->arg.func->sym->name);
+                break;
+            case op_add_const: case op_sub_const: case op_eq_const:
+            case op_lt_const: case op_gt_const:
+                fprintf(out, "const-op     ");
+                fprint_val(out, instr->arg.val);
+                break;
+            case op_dup_call:
+                fprintf(out, "dup-call");
+                break;
+            case op_swap_call:
+                fprintf(out, "swap-call");
+                break;
+            case op_dip2:
+                fprintf(out, "dip2");
+                break;
+            case op_return:
+                fprintf(out, "return");
+                break;
+            default:
+                fprintf(out, "?%d", instr->op);
+        }
+        if (instr->tail) fprintf(out, " (tail)");
+        fprintf(out, "\n");
+    }
+}
+
+/* Free a bytecode array. (Doesn't touch the values it points
+ * to; those still belong to the AST.) */
+void free_code(ACode *code) {
+    if (code == NULL) return;
+#ifdef ALMA_NGRAMS
+    ngram_forget(code);
+#endif
+    free(code->instrs);
+    free(code->captures);
+    free(code->effect.needs);
+    free(code->effect.gives);
+    free(code);
+}
@@ -0,0 +1,59 @@
+#ifndef _AL_BYTECODE_H__
+#define _AL_BYTECODE_H__
+
+#include "alma.h"
+#include "ast.h"
+#include "value.h"
+#include "lib.h"
+
+/* Is <op> one of the int-only versions of the arithmetic built-ins
+ * (see types.c)? They still point at the built-in in arg.func. */
+#define op_is_int_op(op) ((op) >= op_add_int && (op) <= op_ne_int)
+
+/* Is <op> one of the stack shuffles the interpreter does itself? They
+ * also point at their built-in in arg.func. */
+#define op_is_shuffle(op) ((op) >= op_dup && (op) <= op_drop)
+
+/* Which instruction a superinstruction (see fuse_superinstructions)
+ * started out as. Anything else is just itself. Passes that look at
+ * the code should go by this; the instruction after a superinstruction
+ * is still there, as it was. */
+AOpcode code_base_op(AOpcode op);
+
+/* The file the code being lowered right now came from, as an index
+ * from code_file_index (or 0 if it didn't come from a file). Whatever
+ * compiles a file sets this while it does. */
+extern unsigned int lowering_file;
+
+/* The index that instructions from the file <path> get. */
+unsigned int code_file_index(const char *path);
+
+/* The name of the file with the index <file>, or NULL for 0. */
+const char *code_file_name(unsigned int file);
+
+/* Allocate a new, empty bytecode array. */
+ACode *code_new(unsigned int initial_capacity);
+
+/* Append an instruction to the end of a bytecode array, and
+ * return a pointer to it so the caller can fill in its argument. */
+AInstruction *code_emit(ACode *code, AOpcode op, unsigned int linenum);
+
+/* Lower a compiled word-sequence into a flat bytecode array.
+ * The sequence must have been through compile_wordseq already,
+ * so that all its words are resolved to AFunc*s. <depth> is how
+ * many binds it's inside. */
+ACode *code_lower_wordseq(AWordSeqNode *seq, unsigned int depth);
+
+/* Try to make the code of a free block into a flat closure, which
+ * copies the variables it uses when it's made, rather than keeping
+ * the whole chain of var-buffers alive. Returns whether it worked. */
+int code_flatten_closure(ACode *code);
+
+/* Print out a bytecode array, one instruction per line. */
+void fprint_code(FILE *out, ACode *code);
+
+/* Free a bytecode array. (Doesn't touch the values it points
+ * to; those still belong to the AST.) */
+void free_code(ACode *code);
+
+#endif
@@ -0,0 +1,593 @@
+#include "cache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Parsing the source is most of the work of loading a module (more
+ * than compiling it), and every run loads the standard library. So
+ * the parse of each file gets saved in the cache directory, in a
+ * compact binary form that can be read straight back into an AST with
+ * one mmap and no lexing. A cache file is named after a hash of the
+ * source's full path, and starts with a header saying which file it's
+ * for and a hash of what was in that file when it was parsed. The
+ * source gets hashed every time it's loaded (which takes far less time
+ * than parsing it), so an edit is always noticed, even one that leaves
+ * the size and the mtime as they were, while touching a file (or
+ * checking it out again) doesn't throw its cache away. It's hashed
+ * before it's parsed and again afterwards, and the parse is only saved
+ * if nothing changed in between, so the hash is always of exactly what
+ * was parsed. The rest of the cache file is hashed too, so one that's
+ * been cut short or scribbled on just gets ignored.
+ *
+ * The cache lives in $ALMA_CACHE, or else $XDG_CACHE_HOME/alma, or
+ * else ~/.cache/alma. Setting ALMA_CACHE to nothing turns it off. */
+
+#define CACHE_MAGIC     "ALMC"
+/* (change this whenever the format below changes) */
+#define CACHE_VERSION   2
+
+/* A tag for a node's or value's type that can't come up otherwise. */
+#define CACHE_NONE      0xFF
+
+/* Hash <length> bytes of <data> (64-bit FNV-1a), carrying on from <h>. */
+static
+uint64_t hash_bytes(const unsigned char *data, size_t length, uint64_t h) {
+    for (size_t i = 0; i < length; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define HASH_START 0xcbf29ce484222325ULL
+
+/*** Writing ***/
+
+static
+void put_bytes(ACacheBuffer *b, const void *data, size_t n) {
+    if (b->length + n > b->capacity) {
+        while (b->length + n > b->capacity) {
+            b->capacity = b->capacity ? b->capacity * 2 : 1024;
+        }
+        b->data = realloc(b->data, b->capacity);
+    }
+    memcpy(b->data + b->length, data, n);
+    b->length += n;
+}
+
+static
+void put_u8(ACacheBuffer *b, uint8_t x) {
+    put_bytes(b, &x, sizeof(x));
+}
+
+static
+void put_u32(ACacheBuffer *b, uint32_t x) {
+    put_bytes(b, &x, sizeof(x));
+}
+
+static
+void put_i64(ACacheBuffer *b, int64_t x) {
+    put_bytes(b, &x, sizeof(x));
+}
+
+/* Put a string, length first; NULL gets a length of all ones. */
+static
+void put_str(ACacheBuffer *b, const char *s) {
+    if (s == NULL) {
+        put_u32(b, UINT32_MAX);
+        return;
+    }
+    uint32_t length = strlen(s);
+    put_u32(b, length);
+    put_bytes(b, s, length);
+}
+
+static void put_wordseq(ACacheBuffer *b, AWordSeqNode *seq);
+static void put_declseq(ACacheBuffer *b, ADeclSeqNode *seq);
+
+/* Put a name-sequence (or NULL). */
+static
+void put_nameseq(ACacheBuffer *b, ANameSeqNode *seq) {
+    if (seq == NULL) {
+        put_u32(b, UINT32_MAX);
+        return;
+    }
+    put_u32(b, seq->length);
+    for (ANameNode *n = seq->first; n != NULL; n = n->next) {
+        put_str(b, n->sym->name);
+        put_u32(b, n->linenum);
+    }
+}
+
+/* Put one of the values the parser makes. */
+static
+void put_value(ACacheBuffer *b, AValue *val) {
+    AValueType type = val_type(val);
+    put_u8(b, type);
+    if (type == int_val) {
+        put_i64(b, val_get_int(val));
+    } else if (type == float_val) {
+        double d = val_get_float(val);
+        put_bytes(b, &d, sizeof(d));
+    } else if (type == str_val) {
+        AUstr *str = val->data.str;
+        put_u32(b, str->length);
+        put_u32(b, str->byte_length);
+        put_bytes(b, str->data, str->length * sizeof(uint32_t));
+    } else if (type == sym_val) {
+        put_str(b, val_get_sym(val)->name);
+    } else if (type == proto_block) {
+        put_wordseq(b, val->data.ast);
+    } else if (type == proto_list) {
+        uint32_t count = 0;
+        for (AWordSeqNode *s = val->data.pl->first; s != NULL; s = s->next) count ++;
+        put_u32(b, count);
+        for (AWordSeqNode *s = val->data.pl->first; s != NULL; s = s->next) {
+            put_wordseq(b, s);
+        }
+    }
+}
+
+/* Put an AST node. */
+static
+void put_node(ACacheBuffer *b, AAstNode *node) {
+    put_u8(b, node->type);
+    put_u32(b, node->linenum);
+    switch (node->type) {
+        case value_node:
+            put_value(b, node->data.val);
+            break;
+        case word_node:
+            put_str(b, node->data.sym->name);
+            break;
+        case paren_node:
+            put_wordseq(b, node->data.inside);
+            break;
+        case let_node:
+            put_declseq(b, node->data.let->decls);
+            put_wordseq(b, node->data.let->words);
+            break;
+        case bind_node:
+            put_nameseq(b, node->data.bind->names);
+            put_wordseq(b, node->data.bind->words);
+            break;
+        default:
+            /* (the parser doesn't make anything else) */
+            break;
+    }
+}
+
+/* Put a word-sequence (or NULL). */
+static
+void put_wordseq(ACacheBuffer *b, AWordSeqNode *seq) {
+    if (seq == NULL) {
+        put_u32(b, UINT32_MAX);
+        return;
+    }
+    uint32_t count = 0;
+    for (AAstNode *n = seq->first; n != NULL; n = n->next) count ++;
+    put_u32(b, count);
+    for (AAstNode *n = seq->first; n != NULL; n = n->next) {
+        put_node(b, n);
+    }
+}
+
+/* Put a declaration-sequence (or NULL). */
+static
+void put_declseq(ACacheBuffer *b, ADeclSeqNode *seq) {
+    if (seq == NULL) {
+        put_u32(b, UINT32_MAX);
+        return;
+    }
+    uint32_t count = 0;
+    for (ADeclNode *d = seq->first; d != NULL; d = d->next) count ++;
+    put_u32(b, count);
+    for (ADeclNode *d = seq->first; d != NULL; d = d->next) {
+        put_u8(b, d->type);
+        put_u32(b, d->linenum);
+        if (d->type == func_decl) {
+            put_str(b, d->data.func->sym->name);
+            put_wordseq(b, d->data.func->node);
+        } else if (d->type == import_decl) {
+            AImportStmt *imp = d->data.imp;
+            put_str(b, imp->module);
+            put_u8(b, imp->just_string);
+            put_str(b, imp->as ? imp->as->name : NULL);
+            put_nameseq(b, imp->names);
+        }
+    }
+}
+
+/*** Reading ***/
+
+static
+const void *get_bytes(ACacheReader *r, size_t n) {
+    static const unsigned char zeros[8];
+    if (r->failed || (size_t)(r->end - r->pos) < n) {
+        r->failed = 1;
+        return zeros;
+    }
+    const void *p = r->pos;
+    r->pos += n;
+    return p;
+}
+
+static
+uint8_t get_u8(ACacheReader *r) {
+    uint8_t x;
+    memcpy(&x, get_bytes(r, sizeof(x)), sizeof(x));
+    return x;
+}
+
+static
+uint32_t get_u32(ACacheReader *r) {
+    uint32_t x;
+    memcpy(&x, get_bytes(r, sizeof(x)), sizeof(x));
+    return x;
+}
+
+static
+int64_t get_i64(ACacheReader *r) {
+    int64_t x;
+    memcpy(&x, get_bytes(r, sizeof(x)), sizeof(x));
+    return x;
+}
+
+/* Get a count of things, each of which takes at least <min_size>
+ * bytes, so a bad count can't make us loop for ages. */
+static
+uint32_t get_count(ACacheReader *r, size_t min_size) {
+    uint32_t count = get_u32(r);
+    if (count == UINT32_MAX) return count;
+    if ((size_t)(r->end - r->pos) / min_size < count) {
+        r->failed = 1;
+        return 0;
+    }
+    return count;
+}
+
+/* Get a string, as a new one (or NULL). */
+static
+char *get_str(ACacheReader *r) {
+    uint32_t length = get_count(r, 1);
+    if (length == UINT32_MAX) return NULL;
+    char *s = malloc(length + 1);
+    memcpy(s, get_bytes(r, length), r->failed ? 0 : length);
+    s[r->failed ? 0 : length] = '\0';
+    return s;
+}
+
+/* Get a string, and return the symbol it names. */
+static
+ASymbol *get_sym(ACacheReader *r) {
+    char *name = get_str(r);
+    if (name == NULL) return NULL;
+    ASymbol *sym = get_symbol(r->symtab, name);
+    free(name);
+    return sym;
+}
+
+static AWordSeqNode *get_wordseq(ACacheReader *r);
+static ADeclSeqNode *get_declseq(ACacheReader *r);
+
+static
+ANameSeqNode *get_nameseq(ACacheReader *r) {
+    uint32_t count = get_count(r, 8);
+    if (count == UINT32_MAX) return NULL;
+    ANameSeqNode *seq = ast_nameseq_new();
+    for (uint32_t i = 0; i < count; i++) {
+        ASymbol *sym = get_sym(r);
+        ast_nameseq_append(seq, ast_namenode(get_u32(r), sym));
+    }
+    return seq;
+}
+
+static
+AValue *get_value(ACacheReader *r) {
+    uint8_t type = get_u8(r);
+    if (type == int_val) {
+        return val_int(get_i64(r));
+    } else if (type == float_val) {
+        double d;
+        memcpy(&d, get_bytes(r, sizeof(d)), sizeof(d));
+        return val_float(d);
+    } else if (type == str_val) {
+        uint32_t length = get_count(r, sizeof(uint32_t));
+        if (length == UINT32_MAX) length = 0;
+        AUstr *str = ustr_new(length);
+        str->byte_length = get_u32(r);
+        for (uint32_t i = 0; i < length; i++) {
+            ustr_append(str, get_u32(r));
+        }
+        ustr_finish(str);
+        return val_str(str);
+    } else if (type == sym_val) {
+        return val_sym(get_sym(r));
+    } else if (type == proto_block) {
+        AWordSeqNode *block = get_wordseq(r);
+        return val_block(block ? block : ast_wordseq_new());
+    } else if (type == proto_list) {
+        AProtoList *pl = ast_protolist_new();
+        uint32_t count = get_count(r, 4);
+        if (count == UINT32_MAX) count = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            ast_protolist_append(pl, get_wordseq(r));
+        }
+        return val_protolist(pl);
+    }
+    r->failed = 1;
+    return val_int(0);
+}
+
+static
+AAstNode *get_node(ACacheReader *r) {
+    uint8_t type = get_u8(r);
+    unsigned int linenum = get_u32(r);
+    AWordSeqNode *words;
+    switch (type) {
+        case value_node:
+            return ast_valnode(linenum, get_value(r));
+        case word_node:
+            return ast_wordnode(linenum, get_sym(r));
+        case paren_node:
+            words = get_wordseq(r);
+            return ast_parennode(linenum, words ? words : ast_wordseq_new());
+        case let_node: {
+            ADeclSeqNode *decls = get_declseq(r);
+            words = get_wordseq(r);
+            return ast_letnode(linenum, decls, words);
+        }
+        case bind_node: {
+            ANameSeqNode *names = get_nameseq(r);
+            words = get_wordseq(r);
+            return ast_bindnode(linenum, names ? names : ast_nameseq_new(),
+                                words ? words : ast_wordseq_new());
+        }
+        default:
+            r->failed = 1;
+            return ast_valnode(linenum, val_int(0));
+    }
+}
+
+static
+AWordSeqNode *get_wordseq(ACacheReader *r) {
+    uint32_t count = get_count(r, 5);
+    if (count == UINT32_MAX) return NULL;
+    AWordSeqNode *seq = ast_wordseq_new();
+    for (uint32_t i = 0; i < count && !r->failed; i++) {
+        ast_wordseq_append(seq, get_node(r));
+    }
+    return seq;
+}
+
+static
+ADeclSeqNode *get_declseq(ACacheReader *r) {
+    uint32_t count = get_count(r, 5);
+    if (count == UINT32_MAX) return NULL;
+    ADeclSeqNode *seq = ast_declseq_new();
+    for (uint32_t i = 0; i < count && !r->failed; i++) {
+        uint8_t type = get_u8(r);
+        unsigned int linenum = get_u32(r);
+        if (type == func_decl) {
+            ASymbol *sym = get_sym(r);
+            AWordSeqNode *body = get_wordseq(r);
+            ast_declseq_append(seq, ast_funcdeclnode(linenum, sym,
+                        body ? body : ast_wordseq_new()));
+        } else if (type == import_decl) {
+            char *module = get_str(r);
+            int just_string = get_u8(r);
+            ASymbol *as = get_sym(r);
+            ANameSeqNode *names = get_nameseq(r);
+            ast_declseq_append(seq, ast_importdeclnode(linenum, just_string,
+                        module ? module : "", as, names));
+        } else {
+            r->failed = 1;
+        }
+    }
+    return seq;
+}
+
+/*** Finding the cache file ***/
+
+/* The directory the cache goes in, as a new string, or NULL if
+ * caching is turned off. */
+static
+char *cache_dir(void) {
+    const char *dir = getenv("ALMA_CACHE");
+    const char *suffix = "";
+    if (dir != NULL) {
+        if (dir[0] == '\0') return NULL;
+    } else if ((dir = getenv("XDG_CACHE_HOME")) != NULL && dir[0] != '\0') {
+        suffix = "/alma";
+    } else if ((dir = getenv("HOME")) != NULL && dir[0] != '\0') {
+        suffix = "/.cache/alma";
+    } else {
+        return NULL;
+    }
+    char *result = malloc(strlen(dir) + strlen(suffix) + 1);
+    strcpy(result, dir);
+    strcat(result, suffix);
+    return result;
+}
+
+/* The full path of <path>, as a new string. */
+static
+char *full_path(const char *path) {
+    if (path[0] == '/') {
+        char *result = malloc(strlen(path) + 1);
+        strcpy(result, path);
+        return result;
+    }
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) return NULL;
+    char *result = malloc(strlen(cwd) + strlen(path) + 2);
+    strcpy(result, cwd);
+    strcat(result, "/");
+    strcat(result, path);
+    return result;
+}
+
+/* Where the cache file for <fullpath> goes (in <dir>), as a new string. */
+static
+char *cache_file(const char *dir, const char *fullpath) {
+    uint64_t h = hash_bytes((const unsigned char *)fullpath, strlen(fullpath), HASH_START);
+    char *result = malloc(strlen(dir) + 1 + 16 + 6 + 1);
+    sprintf(result, "%s/%016llx.almac", dir, (unsigned long long)h);
+    return result;
+}
+
+/* Hash what's in <file> right now, or give 0 if it can't be hashed
+ * (because it isn't a regular file, say). Nothing with a hash of 0
+ * gets cached. */
+uint64_t cache_source_hash(FILE *file) {
+    struct stat info;
+    if (fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)) return 0;
+    if (info.st_size == 0) return HASH_START;
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (data == MAP_FAILED) return 0;
+    uint64_t h = hash_bytes(data, info.st_size, HASH_START);
+    munmap(data, info.st_size);
+    return h;
+}
+
+/*** Loading and saving ***/
+
+/* Load the cached parse of the file at <path>, if there is one and it
+ * was saved when the file's contents hashed to <source_hash> (so
+ * they're the same now). Otherwise NULL. */
+ADeclSeqNode *cache_load(const char *path, uint64_t source_hash, ASymbolTable *symtab) {
+    if (source_hash == 0) return NULL;
+    char *dir = cache_dir();
+    if (dir == NULL) return NULL;
+    char *fullpath = full_path(path);
+    if (fullpath == NULL) {
+        free(dir);
+        return NULL;
+    }
+    char *cachepath = cache_file(dir, fullpath);
+    free(dir);
+
+    ADeclSeqNode *result = NULL;
+    struct stat cached;
+    int fd = open(cachepath, O_RDONLY);
+    free(cachepath);
+    if (fd < 0 || fstat(fd, &cached) != 0 || cached.st_size == 0) {
+        if (fd >= 0) close(fd);
+        free(fullpath);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, cached.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        free(fullpath);
+        return NULL;
+    }
+
+    ACacheReader r = { data, (const unsigned char *)data + cached.st_size, 0, symtab };
+    const char *magic = get_bytes(&r, 4);
+    uint32_t version = get_u32(&r);
+    uint64_t parsed_hash = (uint64_t)get_i64(&r);
+    uint64_t payload_hash = (uint64_t)get_i64(&r);
+    char *cached_path = get_str(&r);
+
+    int ok = !r.failed && memcmp(magic, CACHE_MAGIC, 4) == 0
+        && version == CACHE_VERSION
+        && parsed_hash == source_hash
+        && cached_path != NULL && strcmp(cached_path, fullpath) == 0
+        && hash_bytes(r.pos, r.end - r.pos, HASH_START) == payload_hash;
+    if (ok) {
+        result = get_declseq(&r);
+        if (r.failed) {
+            /* (can only happen if the format changed without the
+             * version changing; some of it leaks, but it's rare) */
+            free_decl_seq(result);
+            result = NULL;
+        }
+    }
+
+    free(cached_path);
+    free(fullpath);
+    munmap(data, cached.st_size);
+    return result;
+}
+
+/* Save <program>, the parse of the file at <path>, in the cache.
+ * <source_hash> has to be the hash of exactly what was parsed.
+ * Returns whether it worked. */
+int cache_save(const char *path, uint64_t source_hash, ADeclSeqNode *program) {
+    if (source_hash == 0) return 0;
+    char *dir = cache_dir();
+    if (dir == NULL) return 0;
+    char *fullpath = full_path(path);
+    if (fullpath == NULL) {
+        free(dir);
+        return 0;
+    }
+
+    ACacheBuffer payload = { NULL, 0, 0 };
+    put_declseq(&payload, program);
+
+    ACacheBuffer b = { NULL, 0, 0 };
+    put_bytes(&b, CACHE_MAGIC, 4);
+    put_u32(&b, CACHE_VERSION);
+    put_i64(&b, (int64_t)source_hash);
+    put_i64(&b, (int64_t)hash_bytes(payload.data, payload.length, HASH_START));
+    put_str(&b, fullpath);
+    put_bytes(&b, payload.data, payload.length);
+    free(payload.data);
+
+    /* (make the directory if it isn't there; ~/.cache might not be either) */
+    char *slash = strrchr(dir, '/');
+    if (slash != NULL && slash != dir) {
+        *slash = '\0';
+        mkdir(dir, 0777);
+        *slash = '/';
+    }
+    mkdir(dir, 0777);
+
+    /* write it somewhere else first, so nobody ever loads half of it */
+    char *cachepath = cache_file(dir, fullpath);
+    char *tmppath = malloc(strlen(cachepath) + 32);
+    sprintf(tmppath, "%s.%ld.tmp", cachepath, (long)getpid());
+    int ok = 0;
+    FILE *out = fopen(tmppath, "wb");
+    if (out != NULL) {
+        ok = fwrite(b.data, 1, b.length, out) == b.length;
+        ok = (fclose(out) == 0) && ok;
+        ok = ok && rename(tmppath, cachepath) == 0;
+        if (!ok) remove(tmppath);
+    }
+
+    free(b.data);
+    free(tmppath);
+    free(cachepath);
+    free(fullpath);
+    free(dir);
+    return ok;
+}
+
+/* Parse <file> (which was opened from <path>), going through the
+ * module cache: if there's a cached parse of it that's still up to
+ * date, load that instead, and if not, parse it and save one for next
+ * time. Returns NULL if it has a syntax error, like parse_file. If
+ * <hash> isn't NULL, it gets the hash of what was parsed, or 0 if
+ * that isn't known (like if the file changed while it was parsed). */
+ADeclSeqNode *parse_file_cached(const char *path, FILE *file, ASymbolTable *symtab,
+                                uint64_t *hash) {
+    uint64_t source_hash = cache_source_hash(file);
+    ADeclSeqNode *program = cache_load(path, source_hash, symtab);
+    if (program == NULL) {
+        program = parse_file(file, symtab);
+        if (program != NULL && source_hash != 0) {
+            if (cache_source_hash(file) == source_hash) {
+                cache_save(path, source_hash, program);
+            } else {
+                /* it changed under us, so who knows which one got parsed */
+                source_hash = 0;
+            }
+        }
+    }
+    if (hash != NULL) *hash = source_hash;
+    return program;
+}
@@ -0,0 +1,35 @@
+#ifndef _AL_CACHE_H__
+#define _AL_CACHE_H__
+
+#include "alma.h"
+#include "ast.h"
+#include "value.h"
+#include "symbols.h"
+#include "ustrings.h"
+#include "parse.h"
+
+/* Parse <file> (which was opened from <path>), going through the
+ * module cache: if there's a cached parse of it that's still up to
+ * date, load that instead, and if not, parse it and save one for next
+ * time. Returns NULL if it has a syntax error, like parse_file. If
+ * <hash> isn't NULL, it gets the hash of what was parsed, or 0 if
+ * that isn't known (like if the file changed while it was parsed). */
+ADeclSeqNode *parse_file_cached(const char *path, FILE *file, ASymbolTable *symtab,
+                                uint64_t *hash);
+
+/* Hash what's in <file> right now, or give 0 if it can't be hashed
+ * (because it isn't a regular file, say). Nothing with a hash of 0
+ * gets cached. */
+uint64_t cache_source_hash(FILE *file);
+
+/* Load the cached parse of the file at <path>, if there is one and it
+ * was saved when the file's contents hashed to <source_hash> (so
+ * they're the same now). Otherwise NULL. */
+ADeclSeqNode *cache_load(const char *path, uint64_t source_hash, ASymbolTable *symtab);
+
+/* Save <program>, the parse of the file at <path>, in the cache.
+ * <source_hash> has to be the hash of exactly what was parsed.
+ * Returns whether it worked. */
+int cache_save(const char *path, uint64_t source_hash, ADeclSeqNode *program);
+
+#endif
@@ -4,6 +4,46 @@
  * be in scope at a time to 100,000. I think that is a reasonable restriction. */
 unsigned int NOFREEVARS = 100000;
 
+/* Lower a freshly-compiled word-sequence into bytecode. We only do this
+ * for sequences that get run on their own -- function bodies, blocks,
+ * and the elements of lists. (let..in and bind bodies are spliced
+ * into the code of whatever contains them.) <bind_depth> is how many
+ * binds the sequence is inside, so variables can be found relative
+ * to wherever it runs. */
+static
+void lower_wordseq(AWordSeqNode *seq, unsigned int bind_depth) {
+    if (seq == NULL) return;
+    free_code(seq->code);
+    seq->code = code_lower_wordseq(seq, bind_depth);
+}
+
+/* Run the type pass over a freshly-lowered word-sequence (see
+ * types.c), along with the blocks and lists inside it. Returns how
+ * many type errors it found. */
+static
+unsigned int type_wordseq(AWordSeqNode *seq) {
+    if (seq == NULL) return 0;
+    return type_code(seq->code);
+}
+
+/* If every element of <pl> has come out as just a constant, build the
+ * list now, once, so running the code only has to push it rather than
+ * reify it every time. Nothing can change it in place, since the
+ * proto-list always keeps a reference to it. */
+static
+void hoist_constant_list(AProtoList *pl) {
+    AWordSeqNode *current;
+    for (current = pl->first; current != NULL; current = current->next) {
+        ACode *code = current->code;
+        if (code == NULL || code->length != 2 || code->instrs[0].op != op_push_const) return;
+    }
+    AList *list = list_new();
+    for (current = pl->first; current != NULL; current = current->next) {
+        list_append(list, ref(current->code->instrs[0].arg.val));
+    }
+    pl->constant = ref(val_list(list));
+}
+
 /* Mutate an AWordSeqNode by replacing compile-time-resolvable words
  * by their corresponding AFunc*s found in scope. (var_depth is how
  * many variables are in scopes below, so we can pass the correct indices
@@ -22,22 +62,29 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
     AAstNode *current = seq->first;
     while (current != NULL) {
         if (current->type == value_node) {
-            if (current->data.val->type == proto_block) {
+            if (val_type(current->data.val) == proto_block) {
                 /* Block values need special extra compilation. */
                 /* Set the last-block-depth to the current var depth. (so any variables from
                  * outside the block will be correctly recognized as 'free' variables.) */
-                ABindInfo bindinfo_block = {bindinfo.var_depth, bindinfo.var_depth};
+                ABindInfo bindinfo_block = {bindinfo.var_depth, bindinfo.var_depth,
+                                            bindinfo.bind_depth};
                 ACompileResult blockstat = compile_wordseq(scope, symtab,
                         reg, current->data.val->data.ast, bindinfo_block);
                 if (blockstat.status == compile_fail) {
                     errors ++;
                 } else if (blockstat.status == compile_success) {
+                    lower_wordseq(current->data.val->data.ast, bindinfo.bind_depth);
                     if (blockstat.lowest_free == NOFREEVARS) {
                         /* The block is compiled. */
                         current->data.val->type = block_val;
                     } else {
                         /* The block is compiled, but it'll need to hold onto a closure. */
                         current->data.val->type = free_block_val;
+#ifndef ALMA_CHAINED_CLOSURES
+                        /* If we can, have it copy just the variables it
+                         * uses, rather than keeping the whole chain. */
+                        code_flatten_closure(current->data.val->data.ast->code);
+#endif
                         if (blockstat.lowest_free < free_variable_index) {
                             free_variable_index = blockstat.lowest_free;
                         }
@@ -47,14 +94,16 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
                                     "while compiling a block.\n", blockstat.status);
                     errors ++;
                 }
-            } else if (current->data.val->type == proto_list) {
+            } else if (val_type(current->data.val) == proto_list) {
                 /* Compile the things in the protolist. */
                 AWordSeqNode *plcurrent = current->data.val->data.pl->first;
+                unsigned int errors_before = errors;
                 while (plcurrent != NULL) {
                     ACompileResult plstat = compile_wordseq(scope, symtab, reg, plcurrent, bindinfo);
                     if (plstat.status == compile_fail) {
                         errors ++;
                     } else if (plstat.status == compile_success) {
+                        lower_wordseq(plcurrent, bindinfo.bind_depth);
                         if (plstat.lowest_free == NOFREEVARS) {
                             /* Great! */
                         } else {
@@ -70,6 +119,9 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
                     }
                     plcurrent = plcurrent->next;
                 }
+                if (errors == errors_before) {
+                    hoist_constant_list(current->data.val->data.pl);
+                }
             }
             /* For now, we otherwise just assume the value is fine as is. */
         } else if (current->type == func_node) {
@@ -91,12 +143,12 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
                 /* Change symbol pointer to function pointer. */
                 current->type = func_node;
                 current->data.func = e->func;
-                if (e->func->type == var_push && e->func->data.varindex < bindinfo.last_block_depth) {
+                if (e->func->type == var_push && e->func->data.var.index < bindinfo.last_block_depth) {
                     /* It's a free variable (comes from outside the innermost containing
                      * block.) Thus, this block needs to be closed over at runtime. */
                     /* So, update the 'lowest-index free variable' if necessary. */
-                    if (e->func->data.varindex < free_variable_index) {
-                        free_variable_index = e->func->data.varindex;
+                    if (e->func->data.var.index < free_variable_index) {
+                        free_variable_index = e->func->data.var.index;
                     }
                 }
                 if (e->func->type == user_func) {
@@ -115,7 +167,7 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
             /* We need to create a new closure for all functions being declared in this
              * node. (This lets us detect which variables are external to the
              * particular function declarations in the let..in part.) */
-            ABindInfo closed = {bindinfo.var_depth, bindinfo.var_depth};
+            ABindInfo closed = {bindinfo.var_depth, bindinfo.var_depth, bindinfo.bind_depth};
 
             /* Compile the declarations into this lexical scope. */
             ACompileStatus stat = compile(child_scope, symtab, reg, current->data.let->decls, closed);
@@ -160,7 +212,8 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
             for (int i = 0; i < newbind->count; i++) {
                 assert(currname != NULL);
                 stat = scope_create_push(scope_with_vars, reg, currname->sym,
-                                         bindinfo.var_depth + i, current->linenum);
+                                         bindinfo.var_depth + i, bindinfo.bind_depth + 1,
+                                         i, current->linenum);
                 if (stat == compile_fail) {
                     errors ++;
                 } else if (stat != compile_success) {
@@ -169,7 +222,9 @@ ACompileResult compile_wordseq(AScope *scope, ASymbolTable *symtab, AFuncRegistr
                 currname = currname->next;
             }
 
-            ABindInfo bindinfo_with_vars = {bindinfo.var_depth + newbind->count, bindinfo.last_block_depth};
+            ABindInfo bindinfo_with_vars = {bindinfo.var_depth + newbind->count,
+                                            bindinfo.last_block_depth,
+                                            bindinfo.bind_depth + 1};
 
             ACompileResult r = compile_wordseq(scope_with_vars, symtab, reg,
                    newbind->words, bindinfo_with_vars);
@@ -233,7 +288,8 @@ ACompileStatus compile(AScope *scope, ASymbolTable *symtab, AFuncRegistry *reg,
 
         if (current->type == func_decl) {
             /* Mark that the function will be compiled later. */
-            stat = scope_placehold(scope, reg, current->data.func->sym, current->linenum);
+            stat = scope_placehold(scope, reg, current->data.func->sym,
+                                   bindinfo.var_depth, bindinfo.bind_depth, current->linenum);
         } else if (current->type == import_decl) {
             stat = handle_import(scope, symtab, reg, current->data.imp);
         } else {
@@ -274,8 +330,14 @@ ACompileStatus compile(AScope *scope, ASymbolTable *symtab, AFuncRegistry *reg,
                 current = current->next;
                 continue;
             } else if (r.status == compile_success) {
+                lower_wordseq(current->data.func->node, bindinfo.bind_depth);
                 stat = scope_user_register(scope, current->data.func->sym, r.lowest_free,
-                        bindinfo.var_depth, current->data.func->node);
+                        current->data.func->node);
+                /* Words after it can check what they give it against
+                 * what it needs, once we know. */
+                if (stat == compile_success && type_wordseq(current->data.func->node) > 0) {
+                    stat = compile_fail;
+                }
             } else {
                 fprintf(stderr, "internal error: unrecognized compile status %d in pass 2.\n", r.status);
                 current = current->next;
@@ -283,9 +345,6 @@ ACompileStatus compile(AScope *scope, ASymbolTable *symtab, AFuncRegistry *reg,
                 continue;
             }
 
-            // This is also where we'll eventually typecheck stuff before registering it.
-            // .. Or will we do that in a third pass? Hmm.
-
             if (stat == compile_fail) {
                 fprintf(stderr, "Failed to compile word ‘%s’.\n", current->data.func->sym->name);
                 errors ++;
@@ -308,7 +367,7 @@ ACompileStatus compile(AScope *scope, ASymbolTable *symtab, AFuncRegistry *reg,
 ACompileStatus compile_in_context(ADeclSeqNode *program,
         ASymbolTable *symtab, AFuncRegistry *reg, AScope *scope) {
     /* We start with no variables! */
-    ABindInfo bi = {0, 0};
+    ABindInfo bi = {0, 0, 0};
     ACompileStatus stat = compile(scope, symtab, reg, program, bi);
 
     return stat;
@@ -318,8 +377,13 @@ ACompileStatus compile_in_context(ADeclSeqNode *program,
 ACompileStatus compile_seq_context(AWordSeqNode *seq, ASymbolTable *symtab,
         AFuncRegistry *reg, AScope *scope) {
     /* We start with no variables! */
-    ABindInfo bi = {0, 0};
+    ABindInfo bi = {0, 0, 0};
     ACompileResult r = compile_wordseq(scope, symtab, reg, seq, bi);
 
+    if (r.status == compile_success) {
+        lower_wordseq(seq, 0);
+        if (type_wordseq(seq) > 0) return compile_fail;
+    }
+
     return r.status;
 }
@@ -6,6 +6,8 @@
 #include "scope.h"
 #include "vars.h"
 #include "import.h"
+#include "bytecode.h"
+#include "types.h"
 
 /* Mutate an ADeclSeqNode by replacing compile-time-resolvable
  * symbol references with references to AFunc*'s. */
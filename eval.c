@@ -5,84 +5,730 @@
 void eval_sequence(AStack *st, AVarBuffer *buf, AWordSeqNode *seq) {
     if (seq == NULL) return;        // it doesn't exist
     if (seq->first == NULL) return; // it's empty
-    AAstNode *current = seq->first;
-    while (current != NULL) {
-        eval_node(st, buf, current);
-        current = current->next;
+    if (seq->code == NULL) {
+        /* Compilation normally lowers everything ahead of time, but
+         * anything that slipped through can be lowered now. */
+        seq->code = code_lower_wordseq(seq, 0);
     }
+    eval_code(st, buf, seq->code);
 }
 
-/* Evaluate a block (bound, constant, whatever) on the stack,
- * mutating the stack. */
-void eval_block(AStack *st, AVarBuffer *buf, AValue *block) {
-    assert(block->type != free_block_val && "can't apply a free block!");
-    if (block->type == block_val) {
-        /* It's fine, just evaluate it */
-        eval_sequence(st, buf, block->data.ast);
-    } else if (block->type == bound_block_val) {
-        /* It has an attached closure, so we need to load the closure
-         * and interpret its contents in light of that */
-        /* (Note how we pass block->data.uf->closure as the varbuffer
-         * rather than buf) */
-        eval_sequence(st, block->data.uf->closure, block->data.uf->words);
+/* The interpreter's return stack. Alma calls don't use the C stack:
+ * calling a word or running a block pushes an AFrame here and jumps,
+ * and returning pops it. eval_code can still be re-entered by
+ * built-ins like while, so each call to it only looks at the frames
+ * above where it started. */
+static AFrame *frames = NULL;
+static unsigned int frames_size = 0;
+static unsigned int frames_capacity = 0;
+
+/* Push a frame to resume at <ip> with <buf>, once the callee is done. */
+static
+AFrame *push_frame(AFrameKind kind, AInstruction *ip, AVarBuffer *buf, AValue *held,
+                   int reserved) {
+    if (frames_size == frames_capacity) {
+        unsigned int new_capacity = frames_capacity ? frames_capacity * 2 : 64;
+        AFrame *new_frames = realloc(frames, new_capacity * sizeof(AFrame));
+        if (new_frames == NULL) {
+            fprintf(stderr, "Error: couldn't grow return stack to %d frames. "
+                            "Out of memory.\n", new_capacity);
+            exit(1);
+        }
+        frames = new_frames;
+        frames_capacity = new_capacity;
+    }
+    AFrame *f = &frames[frames_size++];
+    f->kind = kind;
+    f->ip = ip;
+    f->buf = buf;
+    f->held = held;
+    f->reserved = reserved;
+    return f;
+}
+
+/* Find the code for a word-sequence, lowering it first
+ * if it hasn't been already. (Empty ones that haven't been can all
+ * share the same code; the ones that have keep their own, so that
+ * --profile can tell them apart.) */
+static
+ACode *seq_code(AWordSeqNode *seq) {
+    static AInstruction empty_instr = { op_return };
+    static ACode empty = { &empty_instr, 1, 1 };
+    if (seq == NULL || (seq->first == NULL && seq->code == NULL)) return &empty;
+    if (seq->code == NULL) {
+        seq->code = code_lower_wordseq(seq, 0);
+    }
+    return seq->code;
+}
+
+/* Work out where to jump to, and with what var-buffer, to run
+ * <block>. Returns 0 if it isn't a block at all. */
+static
+int block_target(AValue *block, AVarBuffer *buf,
+                 ACode **code, AVarBuffer **code_buf) {
+    AValueType type = val_type(block);
+    assert(type != free_block_val && "can't apply a free block!");
+    if (type == block_val) {
+        *code = seq_code(block->data.ast);
+        *code_buf = buf;
+    } else if (type == bound_block_val) {
+        /* use the block's closure rather than the current buffer */
+        *code = seq_code(block->data.uf->words);
+        *code_buf = block->data.uf->closure;
     } else {
         fprintf(stderr, "error: cannot apply non-block to stack\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* The name to give whatever <from> calls, in error messages. */
+static
+const char *callee_name(AInstruction *from) {
+    switch (from->op) {
+        case op_call_user:  return from->arg.func->sym->name;
+        case op_apply:      return "apply";
+        case op_dip:
+        case op_dip2:       return "dip";
+        case op_if:         return "if";
+        case op_ifstar:     return "if*";
+        default:            return "?";
+    }
+}
+
+/* Report that <code>, called from the instruction <from> (or NULL if
+ * it's what eval_code was given), needs more inputs than the <height>
+ * values on the stack. */
+static
+void report_underflow(ACode *code, AInstruction *from, unsigned int height) {
+    if (from != NULL) {
+        fprintf(stderr, "error: ‘%s’ at line %u", callee_name(from), from->linenum);
+    } else {
+        fprintf(stderr, "error: the code at line %u", code->instrs[0].linenum);
     }
+    fprintf(stderr, " needs %u value%s on the stack, but there %s only %u.\n",
+            code->effect.in, (code->effect.in == 1) ? "" : "s",
+            (height == 1) ? "is" : "are", height);
 }
 
-/* Evaluate a single AST node on a stack, mutating
- * the stack.  */
-void eval_node(AStack *st, AVarBuffer *buf, AAstNode *node) {
-    if (node->type == func_node) {
-        eval_word(st, buf, node->data.func);
-    } else if (node->type == value_node) {
-        AValue *put;
-        if (node->data.val->type == free_block_val) {
+/* The interpreter loop can be built two ways. By default it's a plain
+ * switch inside a loop, which any C99 compiler can handle. With
+ * ALMA_THREADED (`make THREADED=1`) it uses GCC's labels-as-values
+ * instead, so each handler jumps straight to the next one through a
+ * table, rather than everything funnelling through one indirect
+ * branch at the top of the switch. That gives the branch predictor
+ * one jump per opcode to learn from. */
+/* With ALMA_NGRAMS (`make NGRAMS=1`), each instruction also counts
+ * how many times it's been run, for --ngram-stats (see ngram.c). */
+#ifdef ALMA_NGRAMS
+#  define COUNT()       (ip->count ++)
+#else
+#  define COUNT()       ((void)0)
+#endif
+#ifdef ALMA_THREADED
+#  define DISPATCH()    goto *dispatch_table[(COUNT(), ip->op)]
+#  define JUMP()        DISPATCH()
+#  define CASE(op)      lbl_##op
+#else
+#  define DISPATCH()    switch ((COUNT(), ip->op))
+#  define JUMP()        goto dispatch
+#  define CASE(op)      case op
+#endif
+#define NEXT()          do { ip ++; JUMP(); } while (0)
+
+/* The value on top of the stack is usually kept in <tos> rather than
+ * on the stack itself (when <cached> says so), so that pushing a value
+ * and then using it, like 1 +, never writes it out. Anything that needs
+ * the whole stack to be there -- a call to a built-in, binding, running
+ * a block, returning from eval_code -- spills it back first. */
+#define SPILL() \
+    do { \
+        if (cached) { \
+            RAW_PUSH(tos); \
+            cached = 0; \
+        } \
+    } while (0)
+/* Get ready to run <code>, called from the instruction <from> with
+ * <height> values on the stack (counting <tos>). If the type pass
+ * worked out what the code does to the stack, check here, once, that
+ * it has all the inputs it needs, and make room for everything it will
+ * push; <reserved> then says its own pushes don't need to check. If
+ * it's short of inputs, the instructions are left to cope as they go. */
+#define ENTER(code, from, height) \
+    do { \
+        reserved = (code)->effect.known; \
+        if (reserved && (height) < (code)->effect.in) { \
+            report_underflow((code), (from), (height)); \
+            reserved = 0; \
+        } else if (reserved) { \
+            int room = (int)(height) - st->size + (code)->effect.max; \
+            if (st->size + room > st->capacity) stack_reserve(st, room); \
+        } \
+    } while (0)
+/* Put <val> on the stack itself. While <reserved>, the code being run
+ * has already made room for everything it pushes (see ENTER), so
+ * there's no need to check whether the stack has to grow. */
+#define RAW_PUSH(val) \
+    do { \
+        if (reserved) { \
+            assert(st->size < st->capacity); \
+            st->content[st->size++] = (val); \
+        } else { \
+            stack_push(st, (val)); \
+        } \
+    } while (0)
+/* Tell the profiler (see profile.c) about each call and return, if
+ * --profile is on. */
+#define PROFILE_ENTER(code, from) \
+    do { \
+        if (profiling) profile_enter((code), (from)); \
+    } while (0)
+#define PROFILE_LEAVE() \
+    do { \
+        if (profiling) profile_leave(); \
+    } while (0)
+/* Take the top value off the stack into <tos>, if it isn't already. */
+#define FILL() \
+    do { \
+        if (!cached && st->size > 0) { \
+            tos = st->content[--st->size]; \
+            cached = 1; \
+        } \
+    } while (0)
+/* Push <val> (a new reference) on top. */
+#define PUSH(val) \
+    do { \
+        SPILL(); \
+        tos = (val); \
+        cached = 1; \
+    } while (0)
+
+/* Call the built-in <func>. Operators with a form that works on values
+ * rather than the stack (see run_binary in lib_op.c) get called with the
+ * top value from <tos>, leaving the answer there, without the stack
+ * being touched apart from taking the second value off. Whatever it
+ * allocates is put down to this instruction (see alloc_site). */
+#define CALL_PRIM(func) \
+    do { \
+        ABinaryFunc binary = (func)->binary; \
+        alloc_site = ip; \
+        if (binary != NULL) FILL(); \
+        if (binary != NULL && cached && st->size > 0) { \
+            st->size --; \
+            tos = binary(st->content[st->size], tos); \
+        } else { \
+            SPILL(); \
+            (func)->data.primitive(st, buf); \
+        } \
+    } while (0)
+
+/* The int-only arithmetic instructions: the type pass has proven both
+ * arguments are ints, so there's no need to look at their types. When
+ * they both fit in the pointer (which is nearly always) the answer is
+ * worked out right here, without calling anything or touching any
+ * refcounts; otherwise the built-in does it as usual. <x> and <y> are
+ * the second and top values, and <ok> says whether the fast way works
+ * (so division can leave dividing by zero to the built-in). */
+#define INT_OP(ok, result) \
+    do { \
+        FILL(); \
+        if (cached && st->size > 0 && val_is_imm_int(tos) \
+                && val_is_imm_int(st->content[st->size - 1])) { \
+            long x = val_get_int(st->content[st->size - 1]); \
+            long y = val_get_int(tos); \
+            if (ok) { \
+                st->size --; \
+                tos = ref(val_int(result)); \
+                NEXT(); \
+            } \
+        } \
+        CALL_PRIM(ip->arg.func); \
+        NEXT(); \
+    } while (0)
+
+/* The superinstructions for an int constant followed by an arithmetic
+ * or comparison built-in, like 1 + or 0 =. If the value on top is an
+ * int that fits in the pointer too, it's replaced with the answer
+ * right here; otherwise the constant gets pushed and the built-in
+ * (the next instruction's) called as usual. Either way both halves
+ * are done. <x> is the value on top, and <y> the constant. */
+#define CONST_OP(result) \
+    do { \
+        FILL(); \
+        if (cached && val_is_imm_int(tos)) { \
+            long x = val_get_int(tos); \
+            long y = val_get_int(ip->arg.val); \
+            tos = ref(val_int(result)); \
+            ip += 2; \
+            JUMP(); \
+        } \
+        PUSH(ref(ip->arg.val)); \
+        ip ++; \
+        CALL_PRIM(ip->arg.func); \
+        NEXT(); \
+    } while (0)
+
+/* Run a flat bytecode array on a stack, mutating the stack.
+ * (This is the main interpreter loop.) */
+void eval_code(AStack *st, AVarBuffer *buf, ACode *code) {
+    unsigned int base = frames_size;
+    AInstruction *ip = code->instrs;
+    /* (put back on the way out, for whatever called us) */
+    AInstruction *outer_site = alloc_site;
+    /* Whether <code> has room made on the stack for what it pushes. */
+    int reserved;
+    ENTER(code, NULL, (unsigned int)st->size);
+    PROFILE_ENTER(code, NULL);
+    /* The block being run right now, if any - we hold a reference
+     * to it so that its closure stays alive until it returns. */
+    AValue *held = NULL;
+
+    /* Where a call is going; set before jumping to 'call'. */
+    ACode *target;
+    AVarBuffer *target_buf;
+    AValue *target_val;
+
+    /* The top of the stack, while it's kept out of it (see SPILL). */
+    AValue *tos = NULL;
+    int cached = 0;
+
+    /* Every frame owns a reference to its starting var-buffer,
+     * which it gives up at op_return. */
+    varbuf_ref(buf);
+
+#ifdef ALMA_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    /* must list every opcode in AOpcode */
+    static void *const dispatch_table[] = {
+        [op_push_const]     = &&lbl_op_push_const,
+        [op_call_prim]      = &&lbl_op_call_prim,
+        [op_call_user]      = &&lbl_op_call_user,
+        [op_push_var]       = &&lbl_op_push_var,
+        [op_bind]           = &&lbl_op_bind,
+        [op_bind_local]     = &&lbl_op_bind_local,
+        [op_unbind]         = &&lbl_op_unbind,
+        [op_make_closure]   = &&lbl_op_make_closure,
+        [op_reify_list]     = &&lbl_op_reify_list,
+        [op_apply]          = &&lbl_op_apply,
+        [op_dip]            = &&lbl_op_dip,
+        [op_if]             = &&lbl_op_if,
+        [op_ifstar]         = &&lbl_op_ifstar,
+        [op_dup]            = &&lbl_op_dup,
+        [op_swap]           = &&lbl_op_swap,
+        [op_over]           = &&lbl_op_over,
+        [op_drop]           = &&lbl_op_drop,
+        [op_add_int]        = &&lbl_op_add_int,
+        [op_sub_int]        = &&lbl_op_sub_int,
+        [op_mul_int]        = &&lbl_op_mul_int,
+        [op_div_int]        = &&lbl_op_div_int,
+        [op_mod_int]        = &&lbl_op_mod_int,
+        [op_lt_int]         = &&lbl_op_lt_int,
+        [op_gt_int]         = &&lbl_op_gt_int,
+        [op_le_int]         = &&lbl_op_le_int,
+        [op_ge_int]         = &&lbl_op_ge_int,
+        [op_eq_int]         = &&lbl_op_eq_int,
+        [op_ne_int]         = &&lbl_op_ne_int,
+        [op_add_const]      = &&lbl_op_add_const,
+        [op_sub_const]      = &&lbl_op_sub_const,
+        [op_eq_const]       = &&lbl_op_eq_const,
+        [op_lt_const]       = &&lbl_op_lt_const,
+        [op_gt_const]       = &&lbl_op_gt_const,
+        [op_dup_call]       = &&lbl_op_dup_call,
+        [op_swap_call]      = &&lbl_op_swap_call,
+        [op_dip2]           = &&lbl_op_dip2,
+        [op_return]         = &&lbl_op_return,
+    };
+    DISPATCH();
+#else
+dispatch:
+    DISPATCH() {
+#endif
+        CASE(op_push_const):
+            PUSH(ref(ip->arg.val));
+            NEXT();
+        CASE(op_call_prim):
+            CALL_PRIM(ip->arg.func);
+            NEXT();
+        CASE(op_dup):
+            FILL();
+            if (!cached) {
+                /* (let the built-in complain about the empty stack) */
+                lib_dup(st, buf);
+                NEXT();
+            }
+            RAW_PUSH(ref(tos));
+            NEXT();
+        CASE(op_swap): {
+            FILL();
+            if (!cached || st->size == 0) {
+                SPILL();
+                lib_swap(st, buf);
+                NEXT();
+            }
+            AValue *second = st->content[st->size - 1];
+            st->content[st->size - 1] = tos;
+            tos = second;
+            NEXT();
+        }
+        CASE(op_over):
+            FILL();
+            if (!cached || st->size == 0) {
+                SPILL();
+                lib_over(st, buf);
+                NEXT();
+            }
+            RAW_PUSH(tos);
+            tos = ref(st->content[st->size - 2]);
+            NEXT();
+        CASE(op_drop):
+            FILL();
+            if (!cached) {
+                lib_drop(st, buf);
+                NEXT();
+            }
+            delete_ref(tos);
+            cached = 0;
+            NEXT();
+        CASE(op_add_int): INT_OP(1, x + y);
+        CASE(op_sub_int): INT_OP(1, x - y);
+        CASE(op_mul_int): INT_OP(1, x * y);
+        CASE(op_div_int): INT_OP(y != 0, x / y);
+        CASE(op_mod_int): INT_OP(y != 0, x % y);
+        CASE(op_lt_int):  INT_OP(1, x < y);
+        CASE(op_gt_int):  INT_OP(1, x > y);
+        CASE(op_le_int):  INT_OP(1, x <= y);
+        CASE(op_ge_int):  INT_OP(1, x >= y);
+        CASE(op_eq_int):  INT_OP(1, x == y);
+        CASE(op_ne_int):  INT_OP(1, x != y);
+        CASE(op_add_const): CONST_OP(x + y);
+        CASE(op_sub_const): CONST_OP(x - y);
+        CASE(op_eq_const):  CONST_OP(x == y);
+        CASE(op_lt_const):  CONST_OP(x < y);
+        CASE(op_gt_const):  CONST_OP(x > y);
+        CASE(op_dup_call):
+            FILL();
+            if (cached) {
+                RAW_PUSH(ref(tos));
+            } else {
+                lib_dup(st, buf);
+            }
+            ip ++;
+            CALL_PRIM(ip->arg.func);
+            NEXT();
+        CASE(op_swap_call):
+            FILL();
+            if (cached && st->size > 0) {
+                AValue *second = st->content[st->size - 1];
+                st->content[st->size - 1] = tos;
+                tos = second;
+            } else {
+                SPILL();
+                lib_swap(st, buf);
+            }
+            ip ++;
+            CALL_PRIM(ip->arg.func);
+            NEXT();
+        CASE(op_call_user): {
+            /* jump back to the var-buffer the word was declared in */
+            AUserFunc *uf = ip->arg.func->data.userfunc;
+            assert(uf->type != dummy_func && "dummy-func in eval stage");
+            target = seq_code(uf->words);
+            if (uf->free_var_index < uf->vars_below) {
+                target_buf = varbuf_up(buf, ip->depth - uf->bind_depth);
+            } else {
+                /* it doesn't use any variables from outside itself */
+                target_buf = NULL;
+            }
+            target_val = NULL;
+            goto call;
+        }
+        CASE(op_push_var): {
+            AVarBuffer *owner = buf;
+            for (unsigned int up = ip->arg.var.up; up > 0; up--) {
+                owner = owner->parent;
+            }
+            PUSH(ref(owner->vars[ip->arg.var.slot]));
+            NEXT();
+        }
+        CASE(op_bind):
+        CASE(op_bind_local): {
+            SPILL();
+            alloc_site = ip;
+            int count = ip->arg.count;
+            /* (the code after this was compiled to look for all <count>
+             * of them, so if some are missing, they get filled in with
+             * zeroes rather than leaving the buffer short) */
+            int missing = 0;
+            if (count > st->size) {
+                fprintf(stderr, "Error: attempt to bind %d variables at line %d, "
+                                "but stack size is %d\n", count, ip->linenum, st->size);
+                missing = count - st->size;
+            }
+            AVarBuffer *newbuf = (ip->op == op_bind_local)
+                ? varbuf_new_local(buf, count)
+                : varbuf_new(buf, count);
+            varbuf_ref(newbuf);
+
+            /* move the variables from the stack into the var buffer
+             * (we just take over the stack's references to them) */
+            for (int i = 0; i < missing; i++) {
+                varbuf_put(newbuf, i, val_int(0));
+            }
+            for (int i = missing; i < count; i++) {
+                varbuf_put(newbuf, i, st->content[st->size - count + i]);
+            }
+            st->size -= count - missing;
+
+            buf = newbuf;
+            NEXT();
+        }
+        CASE(op_unbind): {
+            /* delete our reference to the innermost buffer - this will
+             * clear it if we didn't create any closures */
+            AVarBuffer *oldbuf = buf;
+            buf = buf->parent;
+            varbuf_unref(oldbuf);
+            NEXT();
+        }
+        CASE(op_make_closure): {
             /* If it's a block with free variables, we need to create
              * a new bound-block from this free block, which will
              * save the current set of variables. */
-            put = ref(val_boundblock(node->data.val, buf));
-        } else if (node->data.val->type == proto_list) {
+            alloc_site = ip;
+            ACode *block_code = ip->arg.val->data.ast->code;
+            if (block_code != NULL && block_code->captures != NULL) {
+                /* a flat closure only needs copies of the ones it uses */
+                unsigned int n = block_code->capture_count;
+                AVarBuffer *flat = varbuf_new(NULL, n);
+                for (unsigned int i = 0; i < n; i++) {
+                    varbuf_put(flat, i, varbuf_lookup(buf, block_code->captures[i]));
+                }
+                PUSH(ref(val_boundblock(ip->arg.val, flat)));
+            } else {
+                PUSH(ref(val_boundblock(ip->arg.val, buf)));
+            }
+            NEXT();
+        }
+        CASE(op_reify_list): {
             /* If it's a proto-list, we need to construct a new
              * actual-list from it. */
-            AList *l = list_reify(buf, node->data.val->data.pl, node->linenum);
-            put = ref(val_list(l));
-        } else {
-            /* If it's not anything special, we can just push its value
-             * onto the stack without doing anything */
-            put = ref(node->data.val);
+            alloc_site = ip;
+            AList *l = list_reify(buf, ip->arg.pl, ip->linenum);
+            PUSH(ref(val_list(l)));
+            NEXT();
+        }
+        CASE(op_apply): {
+            /* we take over the stack's reference to the block */
+            SPILL();
+            AValue *block = stack_pop_owned(st);
+            if (!block_target(block, buf, &target, &target_buf)) {
+                delete_ref(block);
+                NEXT();
+            }
+            target_val = block;
+            goto call;
+        }
+        CASE(op_dip): {
+            SPILL();
+            AValue *block = stack_pop_owned(st);
+            AValue *under = stack_pop_owned(st);
+            AValueType type = val_type(block);
+            if ((type != block_val && type != bound_block_val)
+                    || !block_target(block, buf, &target, &target_buf)) {
+                fprintf(stderr, "dip needs a block! (got %d)\n", type);
+                delete_ref(block);
+                delete_ref(under);
+                NEXT();
+            }
+            push_frame(frame_dip, ip + 1, buf, held, reserved)->saved = under;
+            ENTER(target, ip, (unsigned int)(st->size));
+            PROFILE_ENTER(target, ip);
+            varbuf_ref(target_buf);
+            held = block;
+            buf = target_buf;
+            ip = target->instrs;
+            JUMP();
+        }
+        CASE(op_dip2): {
+            /* the same as running ['dip] under the top value, without
+             * running ['dip] itself */
+            SPILL();
+            AValue *over = stack_pop_owned(st);
+            AValue *block = stack_pop_owned(st);
+            AValue *under = stack_pop_owned(st);
+            AValueType type = val_type(block);
+            if ((type != block_val && type != bound_block_val)
+                    || !block_target(block, buf, &target, &target_buf)) {
+                fprintf(stderr, "dip needs a block! (got %d)\n", type);
+                delete_ref(block);
+                delete_ref(under);
+                PUSH(over);
+                ip += 2;
+                JUMP();
+            }
+            AFrame *f = push_frame(frame_dip2, ip + 2, buf, held, reserved);
+            f->saved = under;
+            f->saved2 = over;
+            ENTER(target, ip, (unsigned int)(st->size));
+            PROFILE_ENTER(target, ip);
+            varbuf_ref(target_buf);
+            held = block;
+            buf = target_buf;
+            ip = target->instrs;
+            JUMP();
+        }
+        CASE(op_if):
+        CASE(op_ifstar): {
+            SPILL();
+            AValue *elsepart = stack_pop_owned(st);
+            AValue *thenpart = stack_pop_owned(st);
+            AValue *ifpart = stack_pop_owned(st);
+            if (!block_target(ifpart, buf, &target, &target_buf)) {
+                delete_ref(ifpart);
+                delete_ref(thenpart);
+                delete_ref(elsepart);
+                NEXT();
+            }
+            /* Run the condition first; the branch gets picked when
+             * it returns into this frame. */
+            AFrame *f;
+            if (ip->op == op_ifstar) {
+                /* don't pop off the value under the condition */
+                f = push_frame(frame_ifstar, ip + 1, buf, held, reserved);
+                f->saved = stack_get(st, 0);
+            } else {
+                f = push_frame(frame_if, ip + 1, buf, held, reserved);
+            }
+            f->then = thenpart;
+            f->otherwise = elsepart;
+            ENTER(target, ip, (unsigned int)(st->size));
+            PROFILE_ENTER(target, ip);
+            varbuf_ref(target_buf);
+            held = ifpart;
+            buf = target_buf;
+            ip = target->instrs;
+            JUMP();
+        }
+        CASE(op_return): {
+            PROFILE_LEAVE();
+            varbuf_unref(buf);
+            if (held) delete_ref(held);
+            if (frames_size == base) {
+                SPILL();
+                alloc_site = outer_site;
+                return;
+            }
+
+            AFrame f = frames[--frames_size];
+            ip = f.ip;
+            buf = f.buf;
+            held = f.held;
+            reserved = f.reserved;
+            if (f.kind == frame_call) {
+                JUMP();
+            } else if (f.kind == frame_dip) {
+                PUSH(f.saved);
+                JUMP();
+            } else if (f.kind == frame_dip2) {
+                PUSH(f.saved);
+                PUSH(f.saved2);
+                JUMP();
+            }
+
+            /* it's an if or if*, so pick a branch */
+            SPILL();
+            AValue *condition = stack_pop_owned(st);
+            if (f.kind == frame_ifstar) {
+                PUSH(f.saved);
+            }
+            AValue *branch;
+            if (val_get_int(condition)) {
+                branch = f.then;
+                delete_ref(f.otherwise);
+            } else {
+                branch = f.otherwise;
+                delete_ref(f.then);
+            }
+            delete_ref(condition);
+            if (!block_target(branch, buf, &target, &target_buf)) {
+                delete_ref(branch);
+                JUMP();
+            }
+            /* the branch is a call from the if instruction itself,
+             * so it's a tail call whenever the if was */
+            ip --;
+            target_val = branch;
+            goto call;
         }
-        stack_push(st, put);
-    } else if (node->type == let_node) {
-        /* We already handled all the declaration stuff in compilation,
-         * so all we have to do for a let..in node is to execute the
-         * 'in' part. */
-        eval_sequence(st, buf, node->data.let->words);
-    } else if (node->type == var_bind) {
-        AVarBuffer *newbuf = varbuf_new(buf, node->data.vbind->count);
-        varbuf_ref(newbuf);
-
-        /* get the variables from the stack and put them in the var buffer */
-        for (int i = 0; i < node->data.vbind->count; i++) {
-            AValue *var = stack_get(st, i);
-            varbuf_put(newbuf, node->data.vbind->count - i - 1, var);
+#ifndef ALMA_THREADED
+        default:
+            fprintf(stderr, "error: unrecognized opcode: %d\n", ip->op);
+            NEXT();
+    }
+#endif
+
+call:
+    /* Run <target> with <target_buf>, coming back to ip + 1. */
+    varbuf_ref(target_buf);
+    if (ip->tail) {
+        /* Nothing left to do here but drop the var-buffers we've bound,
+         * so do that now and let the callee return straight to our
+         * caller instead of pushing another frame. */
+        PROFILE_LEAVE();
+        for (AInstruction *p = ip + 1; p->op == op_unbind; p++) {
+            AVarBuffer *oldbuf = buf;
+            buf = buf->parent;
+            varbuf_unref(oldbuf);
         }
-        stack_pop(st, node->data.vbind->count);
+        varbuf_unref(buf);
+        if (held) delete_ref(held);
+    } else {
+        push_frame(frame_call, ip + 1, buf, held, reserved);
+    }
+    ENTER(target, ip, (unsigned int)(st->size + cached));
+    PROFILE_ENTER(target, ip);
+    held = target_val;
+    buf = target_buf;
+    ip = target->instrs;
+    JUMP();
+#ifdef ALMA_THREADED
+#pragma GCC diagnostic pop
+#endif
+}
 
-        /* evaluate it with this new var-buffer */
-        eval_sequence(st, newbuf, node->data.vbind->words);
+#undef COUNT
+#undef DISPATCH
+#undef JUMP
+#undef CASE
+#undef NEXT
+#undef SPILL
+#undef FILL
+#undef PUSH
+#undef ENTER
+#undef RAW_PUSH
+#undef PROFILE_ENTER
+#undef PROFILE_LEAVE
+#undef CALL_PRIM
+#undef INT_OP
+#undef CONST_OP
 
-        /* delete our reference to newbuf - this will clear it if we didn't
-         * create any closures */
-        varbuf_unref(newbuf);
+/* Evaluate a block (bound, constant, whatever) on the stack,
+ * mutating the stack. */
+void eval_block(AStack *st, AVarBuffer *buf, AValue *block) {
+    AValueType type = val_type(block);
+    assert(type != free_block_val && "can't apply a free block!");
+    if (type == block_val) {
+        /* It's fine, just evaluate it */
+        eval_sequence(st, buf, block->data.ast);
+    } else if (type == bound_block_val) {
+        /* It has an attached closure, so we need to load the closure
+         * and interpret its contents in light of that */
+        /* (Note how we pass block->data.uf->closure as the varbuffer
+         * rather than buf) */
+        eval_sequence(st, block->data.uf->closure, block->data.uf->words);
     } else {
-        /* Word nodes, bind nodes, and paren nodes should have been replaced
-         * during the compile stage. If they made it here, that means something
-         * has gone horribly wrong. */
-        assert(node->type != word_node);
-        assert(node->type != bind_node);
-        assert(node->type != paren_node);
-        fprintf(stderr, "error: unrecognized AST node type: %d\n", node->type);
+        fprintf(stderr, "error: cannot apply non-block to stack\n");
     }
 }
 
@@ -92,20 +738,17 @@ void eval_word(AStack *st, AVarBuffer *buf, AFunc *f) {
     if (f->type == primitive_func) {
         f->data.primitive(st, buf);
     } else if (f->type == user_func) {
-        if (f->data.userfunc->type == const_func) {
-            AVarBuffer *func_buffer = varbuf_findparent(buf, f->data.userfunc->vars_below);
-            varbuf_ref(func_buffer);
-            eval_sequence(st, func_buffer, f->data.userfunc->words);
-            varbuf_unref(func_buffer);
-        } else if (f->data.userfunc->type == dummy_func) {
-            assert(0 && "dummy-func in eval stage");
-        } else {
-            fprintf(stderr, "error: unrecognized userfunc type: %d\n",
-                    f->data.userfunc->type);
+        AUserFunc *uf = f->data.userfunc;
+        AVarBuffer *func_buffer = varbuf_findparent(buf, uf->vars_below);
+        varbuf_ref(func_buffer);
+        if (profiling && uf->words != NULL && uf->words->code != NULL) {
+            profile_name(uf->words->code, f);
         }
+        eval_sequence(st, func_buffer, uf->words);
+        varbuf_unref(func_buffer);
     } else if (f->type == var_push) {
         /* varbuf_get increments reference count */
-        AValue *var = varbuf_get(buf, f->data.varindex);
+        AValue *var = varbuf_get(buf, f->data.var.index);
         /* now put the variable on the stack */
         stack_push(st, var);
     } else {
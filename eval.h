@@ -8,19 +8,21 @@
 #include "scope.h"
 #include "ast.h"
 #include "list.h"
+#include "bytecode.h"
+#include "profile.h"
 
 /* Evaluate a sequence of commands on a stack,
  * mutating the stack. */
 void eval_sequence(AStack *st, AVarBuffer *buf, AWordSeqNode *seq);
 
+/* Run a flat bytecode array on a stack, mutating the stack.
+ * (This is the main interpreter loop.) */
+void eval_code(AStack *st, AVarBuffer *buf, ACode *code);
+
 /* Evaluate a block (bound, constant, whatever) on the stack,
  * mutating the stack. */
 void eval_block(AStack *st, AVarBuffer *buf, AValue *block);
 
-/* Evaluate a single AST node on a stack, mutating
- * the stack.  */
-void eval_node(AStack *st, AVarBuffer *buf, AAstNode *node);
-
 /* Evaluate a given word (whether declared or built-in)
  * on the stack. */
 void eval_word(AStack *st, AVarBuffer *buf, AFunc *f);
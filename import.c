@@ -1,9 +1,11 @@
 #include "import.h"
 
-/* Parse a file, compile it into scope using symtab and store its functions
- * in the User Func Registry. */
-ACompileStatus put_file_into_scope(const char *filename, ASymbolTable *symtab,
-        AScope *scope, AFuncRegistry *reg) {
+/* Same as put_file_into_scope, but also gives the hash of what was
+ * compiled in <hash> (or 0 if it isn't known; see parse_file_cached). */
+static
+ACompileStatus put_hashed_file_into_scope(const char *filename, ASymbolTable *symtab,
+        AScope *scope, AFuncRegistry *reg, uint64_t *hash) {
+    *hash = 0;
     FILE *file = fopen(filename, "r");
     if (!file) {
         char errbuf[512];
@@ -17,7 +19,7 @@ ACompileStatus put_file_into_scope(const char *filename, ASymbolTable *symtab,
         }
         return compile_fail;
     } else {
-        ADeclSeqNode *file_parsed = parse_file(file, symtab);
+        ADeclSeqNode *file_parsed = parse_file_cached(filename, file, symtab, hash);
         fclose(file);
 
         if (file_parsed == NULL) {
@@ -25,12 +27,26 @@ ACompileStatus put_file_into_scope(const char *filename, ASymbolTable *symtab,
             return compile_fail;
         }
 
+        /* (imports get compiled in the middle of this, so put back
+         * whichever file was being compiled before) */
+        unsigned int outer_file = lowering_file;
+        lowering_file = code_file_index(filename);
         ACompileStatus stat = compile_in_context(file_parsed, symtab, reg, scope);
+        lowering_file = outer_file;
         free_decl_seq_top(file_parsed);
         return stat;
     }
 }
 
+/* Parse a file, compile it into scope using symtab and store its functions
+ * in the User Func Registry. The parse comes from the module cache if
+ * the file hasn't changed since it was last parsed (see cache.c). */
+ACompileStatus put_file_into_scope(const char *filename, ASymbolTable *symtab,
+        AScope *scope, AFuncRegistry *reg) {
+    uint64_t hash;
+    return put_hashed_file_into_scope(filename, symtab, scope, reg, &hash);
+}
+
 /* Find the filename referred to by a module by searching ALMA_PATH
  * (and the current directory) */
 /* NOTE: allocates a new string! Don't forget to free it. */
@@ -125,11 +141,54 @@ char *extract_mod_prefix(const char *path, int strip_ext) {
     return result;
 }
 
+/* The modules compiled so far this run, by file. */
+static AModule *modules = NULL;
+
+/* Compile the module in <path> into a scope of its own (under
+ * <libscope>), and return that scope, or NULL if it didn't compile.
+ * A module that's been imported before (and hasn't changed since)
+ * just gets the scope it was compiled into then, so every import of
+ * it shares the one copy of its words. */
+static
+AScope *module_scope_for(const char *path, AScope *libscope,
+            ASymbolTable *symtab, AFuncRegistry *reg) {
+    AModule *module = NULL;
+    HASH_FIND_STR(modules, path, module);
+    if (module != NULL) {
+        /* (it's the contents that count: an edit within the same
+         * second as the last one wouldn't change the mtime) */
+        FILE *file = fopen(path, "r");
+        uint64_t hash = (file != NULL) ? cache_source_hash(file) : 0;
+        if (file != NULL) fclose(file);
+        if (hash != 0 && hash == module->hash) {
+            return module->scope;
+        }
+    }
+
+    AScope *module_scope = scope_new(libscope);
+    uint64_t hash;
+    if (put_hashed_file_into_scope(path, symtab, module_scope, reg, &hash) == compile_fail) {
+        return NULL;
+    }
+
+    if (module == NULL) {
+        module = malloc(sizeof(AModule));
+        module->path = malloc(strlen(path) + 1);
+        strcpy(module->path, path);
+        HASH_ADD_KEYPTR(hh, modules, module->path, strlen(module->path), module);
+    }
+    /* (if it's changed, the old scope still has to stay around, since
+     * whatever imported it before is still using its words) */
+    module->hash = hash;
+    module->scope = module_scope;
+    return module_scope;
+}
+
 /* Given an import declaration, import it into the current scope
  * (prefixing qualified declaration as appropriate.) */
 ACompileStatus handle_import (AScope *scope, ASymbolTable *symtab,
             AFuncRegistry *reg, AImportStmt *decl) {
-    AScope *module_scope = scope_new(scope->libscope);
+    AScope *module_scope = NULL;
 
     int has_suffix = decl->just_string
             || !strcmp(decl->module + strlen(decl->module) - 5, ".alma");
@@ -144,19 +203,20 @@ ACompileStatus handle_import (AScope *scope, ASymbolTable *symtab,
         strcat(filename, ".alma");
     }
 
-    ACompileStatus result = compile_fail;
     char *file_loc = resolve_import(filename, !has_suffix);
     if (file_loc == NULL) {
         fprintf(stderr, "Couldn't find ‘%s’ anywhere in ALMA_PATH\n"
                 "(ALMA_PATH is: %s)\n", filename, ALMA_PATH);
     } else {
-        result = put_file_into_scope(file_loc, symtab, module_scope, reg);
+        module_scope = module_scope_for(file_loc, scope->libscope, symtab, reg);
     }
     free(filename);
 
-    if (result == compile_fail) {
-        return result;
+    if (module_scope == NULL) {
+        free(file_loc);
+        return compile_fail;
     }
+    ACompileStatus result = compile_success;
 
     if (decl->names) {
         /* Iterate over the sequence of names, and import each of them
@@ -1,9 +1,11 @@
 #include "alma.h"
 #include "compile.h"
 #include "parse.h"
+#include "cache.h"
 
 /* Parse a file, compile it into scope using symtab and store its functions
- * in the User Func Registry. */
+ * in the User Func Registry. The parse comes from the module cache if
+ * the file hasn't changed since it was last parsed (see cache.c). */
 ACompileStatus put_file_into_scope(const char *filename, ASymbolTable *symtab,
         AScope *scope, AFuncRegistry *reg);
 
@@ -1,13 +1,30 @@
 #include "lib.h"
 
-/* Add built in func to scope by wrapping it in a newly allocated AFunc */
-void addlibfunc(AScope *sc, ASymbolTable *symtab, const char *name, APrimitiveFunc f) {
+/* Wrap a built-in function in a newly allocated AFunc, and add it to
+ * scope under <name>. */
+static
+AFunc *add_primitive(AScope *sc, ASymbolTable *symtab, const char *name,
+                     APrimitiveFunc f, ABinaryFunc binary) {
     ASymbol *sym = get_symbol(symtab, name);
     AFunc *newfunc = malloc(sizeof(AFunc));
     newfunc->type = primitive_func;
     newfunc->data.primitive = f;
+    newfunc->binary = binary;
     newfunc->sym = sym;
     scope_register(sc, sym, newfunc);
+    return newfunc;
+}
+
+/* Add built in func to scope by wrapping it in a newly allocated AFunc */
+void addlibfunc(AScope *sc, ASymbolTable *symtab, const char *name, APrimitiveFunc f) {
+    add_primitive(sc, symtab, name, f, NULL);
+}
+
+/* Add a built-in operator to scope, along with the form of it that
+ * the interpreter can call on the top two values directly. */
+void addbinaryfunc(AScope *sc, ASymbolTable *symtab, const char *name,
+                   APrimitiveFunc f, ABinaryFunc binary) {
+    add_primitive(sc, symtab, name, f, binary);
 }
 
 /* Initialize builtin library functions into scope sc. */
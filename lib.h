@@ -25,7 +25,41 @@ void controllib_init(ASymbolTable *symtab, AScope *sc);
 /* Initialize built-in control flow functions. */
 void listlib_init(ASymbolTable *symtab, AScope *sc);
 
+/* Built-ins that the interpreter loop runs itself when they show
+ * up directly in code (see lower_into); these are only used when
+ * they're called some other way. */
+void lib_apply(AStack *stack, AVarBuffer *buffer);
+void lib_dip(AStack *stack, AVarBuffer *buffer);
+void lib_if(AStack *stack, AVarBuffer *buffer);
+void lib_ifstar(AStack *stack, AVarBuffer *buffer);
+void lib_dup(AStack *stack, AVarBuffer *buffer);
+void lib_swap(AStack *stack, AVarBuffer *buffer);
+void lib_over(AStack *stack, AVarBuffer *buffer);
+void lib_drop(AStack *stack, AVarBuffer *buffer);
+
+/* Operators that map and filter look for in their blocks, so they
+ * can hand the whole list to a vector kernel (see lib_list.c), and
+ * that the compiler works out ahead of time when it can (see
+ * bytecode.c). */
+void lib_add(AStack *stack, AVarBuffer *buffer);
+void lib_subtract(AStack *stack, AVarBuffer *buffer);
+void lib_multiply(AStack *stack, AVarBuffer *buffer);
+void lib_div(AStack *stack, AVarBuffer *buffer);
+void lib_mod(AStack *stack, AVarBuffer *buffer);
+void lib_lessthan(AStack *stack, AVarBuffer *buffer);
+void lib_greaterthan(AStack *stack, AVarBuffer *buffer);
+void lib_lessthanequal(AStack *stack, AVarBuffer *buffer);
+void lib_greaterthanequal(AStack *stack, AVarBuffer *buffer);
+void lib_equal(AStack *stack, AVarBuffer *buffer);
+void lib_notequal(AStack *stack, AVarBuffer *buffer);
+void lib_not(AStack *stack, AVarBuffer *buffer);
+
 /* Add built in func to scope by wrapping it in a newly allocated AFunc */
 void addlibfunc(AScope *sc, ASymbolTable *symtab, const char *name, APrimitiveFunc f);
 
+/* Add a built-in operator to scope, along with the form of it that
+ * the interpreter can call on the top two values directly. */
+void addbinaryfunc(AScope *sc, ASymbolTable *symtab, const char *name,
+                   APrimitiveFunc f, ABinaryFunc binary);
+
 #endif
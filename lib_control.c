@@ -4,17 +4,15 @@
  * below B and C, take the top element, and run
  * B if truthy, C if falsy. (integerwise.) */
 void lib_if(AStack *stack, AVarBuffer *buffer) {
-    AValue *ifpart = stack_get(stack, 2);
-    AValue *thenpart = stack_get(stack, 1);
-    AValue *elsepart = stack_get(stack, 0);
-    stack_pop(stack, 3);
+    AValue *elsepart = stack_pop_owned(stack);
+    AValue *thenpart = stack_pop_owned(stack);
+    AValue *ifpart = stack_pop_owned(stack);
 
     eval_block(stack, buffer, ifpart);
 
-    AValue *condition = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *condition = stack_pop_owned(stack);
 
-    if (condition->data.i) {
+    if (val_get_int(condition)) {
         eval_block(stack, buffer, thenpart);
     } else {
         eval_block(stack, buffer, elsepart);
@@ -31,22 +29,20 @@ void lib_if(AStack *stack, AVarBuffer *buffer) {
  * B if truthy, C if falsy. But put the top element
  * of the stack back before running B or C. */
 void lib_ifstar(AStack *stack, AVarBuffer *buffer) {
-    AValue *ifpart = stack_get(stack, 2);
-    AValue *thenpart = stack_get(stack, 1);
-    AValue *elsepart = stack_get(stack, 0);
-    AValue *top = stack_get(stack, 3);
-
-    /* don't pop off 'top' */
-    stack_pop(stack, 3);
+    AValue *elsepart = stack_pop_owned(stack);
+    AValue *thenpart = stack_pop_owned(stack);
+    AValue *ifpart = stack_pop_owned(stack);
+    /* don't pop off 'top', but keep a reference of our own to
+     * put back, since the condition will use up the stack's */
+    AValue *top = stack_get(stack, 0);
 
     eval_block(stack, buffer, ifpart);
 
-    AValue *condition = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *condition = stack_pop_owned(stack);
 
     stack_push(stack, top);
 
-    if (condition->data.i) {
+    if (val_get_int(condition)) {
         eval_block(stack, buffer, thenpart);
     } else {
         eval_block(stack, buffer, elsepart);
@@ -62,25 +58,21 @@ void lib_ifstar(AStack *stack, AVarBuffer *buffer) {
  * the stack below B and apply B over and over
  * again until applying A gives a falsy value. */
 void lib_while (AStack *stack, AVarBuffer *buffer) {
-    AValue *condpart = stack_get(stack, 1);
-    AValue *looppart = stack_get(stack, 0);
-    stack_pop(stack, 2);
+    AValue *looppart = stack_pop_owned(stack);
+    AValue *condpart = stack_pop_owned(stack);
 
     eval_block(stack, buffer, condpart);
 
-    AValue *condition = stack_get(stack, 0);
-
-    stack_pop(stack, 1);
+    AValue *condition = stack_pop_owned(stack);
 
-    while (condition->data.i) {
+    while (val_get_int(condition)) {
         delete_ref(condition);
 
         eval_block(stack, buffer, looppart);
 
         eval_block(stack, buffer, condpart);
 
-        condition = stack_get(stack, 0);
-        stack_pop(stack, 1);
+        condition = stack_pop_owned(stack);
     }
 
     delete_ref(condpart);
@@ -94,18 +86,15 @@ void lib_while (AStack *stack, AVarBuffer *buffer) {
  * But keep the top value on the stack after
  * applying A each time. */
 void lib_whilestar(AStack *stack, AVarBuffer *buffer) {
-    AValue *condpart = stack_get(stack, 1);
-    AValue *looppart = stack_get(stack, 0);
-    AValue *top = stack_get(stack, 2);
-
-    stack_pop(stack, 2);
+    AValue *looppart = stack_pop_owned(stack);
+    AValue *condpart = stack_pop_owned(stack);
+    AValue *top = stack_get(stack, 0);
 
     eval_block(stack, buffer, condpart);
 
-    AValue *condition = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *condition = stack_pop_owned(stack);
 
-    while (condition->data.i) {
+    while (val_get_int(condition)) {
         delete_ref(condition);
 
         stack_push(stack, top);
@@ -116,8 +105,7 @@ void lib_whilestar(AStack *stack, AVarBuffer *buffer) {
 
         eval_block(stack, buffer, condpart);
 
-        condition = stack_get(stack, 0);
-        stack_pop(stack, 1);
+        condition = stack_pop_owned(stack);
     }
 
     stack_push(stack, top);
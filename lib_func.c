@@ -2,16 +2,14 @@
 
 /* Print out the top value on the stack. */
 void lib_print(AStack* stack, AVarBuffer *buffer) {
-    AValue *val = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *val = stack_pop_owned(stack);
     print_val_simple(val);
     delete_ref(val);
 }
 
 /* Print out the top value on the stack with newline. */
 void lib_println(AStack* stack, AVarBuffer *buffer) {
-    AValue *val = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *val = stack_pop_owned(stack);
     print_val_simple(val);
     delete_ref(val);
     printf("\n");
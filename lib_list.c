@@ -1,11 +1,24 @@
 #include "lib.h"
+#include "vector.h"
+
+/* If <val> is a lazy sequence, work out its elements and return
+ * them as a list instead (using up the reference to <val>). The
+ * words that don't know about sequences call this first. */
+static
+AValue *as_list(AValue *val, AStack *stack) {
+    if (val_type(val) != seq_val) return val;
+    AValue *list = ref(val_list(seq_force(val->data.seq, stack)));
+    delete_ref(val);
+    return list;
+}
 
 /* find length of list */
 void lib_len(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
 
-    AValue *len = ref(val_int(a->data.list->length));
+    AValue *len = (val_type(a) == seq_val)
+        ? ref(val_int(seq_length(a->data.seq, stack)))
+        : ref(val_int(a->data.list->length));
 
     stack_push(stack, len);
     delete_ref(a);
@@ -13,9 +26,9 @@ void lib_len(AStack* stack, AVarBuffer *buffer) {
 
 /* put a value onto front a list */
 void lib_cons(AStack* stack, AVarBuffer *buffer) {
-    AValue *vlist = stack_get(stack, 0);
-    AValue *a = stack_get(stack, 1);
-    stack_pop(stack, 2);
+    AValue *vlist = stack_pop_owned(stack);
+    AValue *a = stack_pop_owned(stack);
+    vlist = as_list(vlist, stack);
 
     AValue *result = cons_list_val(a, vlist);
     stack_push(stack, result);
@@ -27,9 +40,9 @@ void lib_cons(AStack* stack, AVarBuffer *buffer) {
 /* put a value onto the end of a list
  * (need better name) */
 void lib_append(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *vlist = stack_get(stack, 1);
-    stack_pop(stack, 2);
+    AValue *a = stack_pop_owned(stack);
+    AValue *vlist = stack_pop_owned(stack);
+    vlist = as_list(vlist, stack);
 
     AValue *result = append_list_val(vlist, a);
     stack_push(stack, result);
@@ -40,10 +53,20 @@ void lib_append(AStack* stack, AVarBuffer *buffer) {
 
 /* get head of list */
 void lib_head(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
 
-    AValue *head = head_list_val(a);
+    AValue *head;
+    if (val_type(a) == seq_val) {
+        /* only work out as much of it as we need */
+        ASeqIter *it = seq_iter_new(a->data.seq, stack);
+        head = seq_iter_next(it);
+        free_seq_iter(it);
+        if (head == NULL) {
+            fprintf(stderr, "error: attempt to take head of empty list");
+        }
+    } else {
+        head = head_list_val(a);
+    }
 
     stack_push(stack, head);
     delete_ref(a);
@@ -51,8 +74,8 @@ void lib_head(AStack* stack, AVarBuffer *buffer) {
 
 /* get tail of list */
 void lib_tail(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
+    a = as_list(a, stack);
 
     AValue *tail = tail_list_val(a);
 
@@ -62,8 +85,8 @@ void lib_tail(AStack* stack, AVarBuffer *buffer) {
 
 /* get init of list */
 void lib_listinit(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
+    a = as_list(a, stack);
 
     AValue *init = init_list_val(a);
 
@@ -73,8 +96,8 @@ void lib_listinit(AStack* stack, AVarBuffer *buffer) {
 
 /* get last elem of list */
 void lib_last(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
+    a = as_list(a, stack);
 
     AValue *last = last_list_val(a);
 
@@ -84,8 +107,8 @@ void lib_last(AStack* stack, AVarBuffer *buffer) {
 
 /* split list on top of stack into head and tail */
 void lib_uncons(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
+    a = as_list(a, stack);
 
     AValue *head = head_list_val(a);
     AValue *tail = tail_list_val(a);
@@ -98,8 +121,8 @@ void lib_uncons(AStack* stack, AVarBuffer *buffer) {
 /* split list on top of stack into init and last
  * (note: come up with a better name???) */
 void lib_unappend(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
+    a = as_list(a, stack);
 
     AValue *last = last_list_val(a);
     AValue *init = init_list_val(a);
@@ -109,6 +132,580 @@ void lib_unappend(AStack* stack, AVarBuffer *buffer) {
     delete_ref(a);
 }
 
+/* If <block> is a constant block consisting of just one built-in
+ * word, like [+], return that word so we can call it directly
+ * rather than going through the interpreter. Otherwise NULL. */
+static
+APrimitiveFunc single_primitive(AValue *block) {
+    if (val_type(block) != block_val) return NULL;
+    ACode *code = block->data.ast->code;
+    if (code == NULL || code->length != 2) return NULL;
+    if (code->instrs[0].op != op_call_prim && !op_is_shuffle(code->instrs[0].op)) return NULL;
+    return code->instrs[0].arg.func->data.primitive;
+}
+
+/* Run <block> (or <prim>, if it's a single built-in) on the stack. */
+#define RUN_BLOCK(stack, buffer, prim, block) \
+    do { \
+        if (prim) prim(stack, buffer); \
+        else eval_block(stack, buffer, block); \
+    } while (0)
+
+/* Copy the instructions of <code> (up to its op_return) into <out>,
+ * splicing in the bodies of any user words it calls, so that e.g.
+ * [p multiple not] comes out as p mod 0 = not. Returns how many
+ * there were, or -1 if there were more than <max> (or it went more
+ * than <depth> words deep). */
+static
+int flatten_code(ACode *code, AInstruction **out, int max, int depth) {
+    int n = 0;
+    for (unsigned int i = 0; code->instrs[i].op != op_return; i++) {
+        AInstruction *instr = &code->instrs[i];
+        if (instr->op == op_call_user) {
+            AUserFunc *uf = instr->arg.func->data.userfunc;
+            if (depth == 0 || uf->type != const_func) return -1;
+            if (uf->words == NULL || uf->words->code == NULL) return -1;
+            int m = flatten_code(uf->words->code, out + n, max - n, depth - 1);
+            if (m < 0) return -1;
+            n += m;
+        } else {
+            if (n == max) return -1;
+            out[n++] = instr;
+        }
+    }
+    return n;
+}
+
+/* Is <instr> a call to the built-in <prim>? (Including the int-only
+ * versions the type pass puts in.) */
+static
+int calls_prim(AInstruction *instr, APrimitiveFunc prim) {
+    return (instr->op == op_call_prim || op_is_int_op(instr->op))
+        && instr->arg.func->data.primitive == prim;
+}
+
+/* If <block> is an int (constant or variable) followed by a single
+ * operator, like [2 *] or [n <], or a "not divisible by" test like
+ * [3 mod] or [p multiple not], so that a vector kernel can do it to
+ * a whole list of ints at once, return the operator, and put the int
+ * in <k>. <negate> says whether the result needs flipping (from any
+ * trailing nots, or from a "mod 0 =" divisibility test). Otherwise
+ * return NULL. */
+static
+APrimitiveFunc block_kernel(AValue *block, AVarBuffer *buffer, long *k, int *negate) {
+    ACode *code;
+    AVarBuffer *code_buf;
+    AValueType type = val_type(block);
+    if (type == block_val) {
+        code = block->data.ast->code;
+        code_buf = buffer;
+    } else if (type == bound_block_val && block->data.uf->words != NULL) {
+        code = block->data.uf->words->code;
+        code_buf = block->data.uf->closure;
+    } else {
+        return NULL;
+    }
+    if (code == NULL) return NULL;
+
+    AInstruction *instrs[8];
+    int n = flatten_code(code, instrs, 8, 2);
+    if (n < 2) return NULL;
+    if (instrs[1]->op != op_call_prim && !op_is_int_op(instrs[1]->op)) return NULL;
+
+    /* first, the int */
+    if (code_base_op(instrs[0]->op) == op_push_const) {
+        if (!val_is_imm_int(instrs[0]->arg.val)) return NULL;
+        *k = val_get_int(instrs[0]->arg.val);
+    } else if (instrs[0]->op == op_push_var && instrs[0] == code->instrs) {
+        /* (only if it's the block's own variable - one from a word
+         * spliced in would be relative to that word's buffer) */
+        AValue *var = varbuf_lookup(code_buf, instrs[0]->arg.var);
+        int is_int = val_is_imm_int(var);
+        *k = val_get_int(var);
+        delete_ref(var);
+        if (!is_int) return NULL;
+    } else {
+        return NULL;
+    }
+
+    /* then the operator */
+    APrimitiveFunc op = instrs[1]->arg.func->data.primitive;
+    int i = 2;
+    *negate = 0;
+    if (op == &lib_add || op == &lib_subtract || op == &lib_multiply) {
+        return (n == 2) ? op : NULL;
+    } else if (op == &lib_mod) {
+        /* "mod 0 =" is true when mod alone would be false */
+        if (i + 1 < n && code_base_op(instrs[i]->op) == op_push_const
+                && instrs[i]->arg.val == val_int(0)
+                && (calls_prim(instrs[i + 1], &lib_equal)
+                    || calls_prim(instrs[i + 1], &lib_notequal))) {
+            *negate = calls_prim(instrs[i + 1], &lib_equal);
+            i += 2;
+        }
+    } else if (op != &lib_lessthan && op != &lib_greaterthan
+            && op != &lib_lessthanequal && op != &lib_greaterthanequal
+            && op != &lib_equal && op != &lib_notequal) {
+        return NULL;
+    }
+    for (; i < n; i++) {
+        if (!calls_prim(instrs[i], &lib_not)) return NULL;
+        *negate = !*negate;
+    }
+    return op;
+}
+
+/* Map one of the arithmetic operators, applied with <k>, over the
+ * ints in <vlist>. Returns the new list value (using up the reference
+ * to <vlist>), or NULL if the results wouldn't all fit in immediates,
+ * in which case <vlist> is left alone for the slow path to deal with. */
+static
+AValue *map_kernel(AValue *vlist, APrimitiveFunc op, long k) {
+    AList *list = vlist->data.list;
+    unsigned int n = list->length;
+    if (op == &lib_subtract) {
+        if (k == VAL_INT_MIN) return NULL;
+        op = &lib_add;
+        k = -k;
+    }
+
+    int unshared = list_val_unshared(vlist);
+    AList *result = unshared ? list : list_new_length(n);
+    AValue **src = &list_get(list, 0);
+    AValue **dst = &list_get(result, 0);
+    int ok = (op == &lib_add)
+        ? vec_int_add(dst, src, n, k)
+        : vec_int_mul(dst, src, n, k);
+
+    if (unshared) {
+        return ok ? vlist : NULL;
+    } else if (!ok) {
+        free_list(result);
+        return NULL;
+    }
+    delete_ref(vlist);
+    return ref(val_list(result));
+}
+
+/* Keep the ints in <vlist> that pass the test <op>, applied with <k>
+ * (and flipped if <negate>). Returns the new list value, using up
+ * the reference to <vlist>, or NULL if it can't. */
+static
+AValue *filter_kernel(AValue *vlist, APrimitiveFunc op, long k, int negate) {
+    AList *list = vlist->data.list;
+    unsigned int n = list->length;
+    AValue **items = &list_get(list, 0);
+    if (op == &lib_mod && k == 0) return NULL;
+
+    unsigned char *mask = malloc(n);
+    if (op == &lib_mod) {
+        vec_int_mod(mask, items, n, k);
+    } else {
+        AVecCompare cmp = (op == &lib_lessthan) ? vec_lt
+                        : (op == &lib_greaterthan) ? vec_gt
+                        : (op == &lib_lessthanequal) ? vec_le
+                        : (op == &lib_greaterthanequal) ? vec_ge
+                        : (op == &lib_equal) ? vec_eq
+                        : vec_ne;
+        vec_int_compare(mask, items, n, cmp, k);
+    }
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < n; i++) {
+        mask[i] ^= negate;
+        kept += mask[i];
+    }
+
+    /* ints don't need their references dropped, so getting rid of
+     * the rest is just a matter of not copying them */
+    AValue *result;
+    if (list_val_unshared(vlist)) {
+        /* (without branches, since the mask is hard to predict) */
+        unsigned int j = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            items[j] = items[i];
+            j += mask[i];
+        }
+        list->length = kept;
+        list->buf->hi = list->start + kept;
+        result = vlist;
+    } else {
+        AList *out = list_new_length(kept);
+        AValue **dst = &list_get(out, 0);
+        unsigned int j = 0;
+        for (unsigned int i = 0; i < n && j < kept; i++) {
+            dst[j] = items[i];
+            j += mask[i];
+        }
+        result = ref(val_list(out));
+        delete_ref(vlist);
+    }
+    free(mask);
+    return result;
+}
+
+/* Given stack [F L ..., apply F to each element of L,
+ * giving a list of the results. (Goes from the end
+ * of the list to the start.) */
+void lib_map(AStack* stack, AVarBuffer *buffer) {
+    AValue *f = stack_pop_owned(stack);
+    AValue *vlist = stack_pop_owned(stack);
+
+    if (val_type(vlist) == seq_val) {
+        if (seq_block_ok(f)) {
+            /* just make a note to do it later */
+            stack_push(stack, ref(val_seq(seq_map(vlist, f))));
+            return;
+        }
+        /* (it might print something, say, so it has to happen now,
+         * once, in the same order as for any other list) */
+        vlist = as_list(vlist, stack);
+    }
+
+    AList *list = vlist->data.list;
+    long k;
+    int negate;
+    if (list->length > 0 && list_all_ints(list)) {
+        APrimitiveFunc op = block_kernel(f, buffer, &k, &negate);
+        AValue *result = NULL;
+        if (op == &lib_add || op == &lib_subtract || op == &lib_multiply) {
+            result = map_kernel(vlist, op, k);
+        }
+        if (result != NULL) {
+            stack_push(stack, result);
+            delete_ref(f);
+            return;
+        }
+    }
+
+    APrimitiveFunc prim = single_primitive(f);
+    if (list_val_unshared(vlist)) {
+        /* nobody else can see this list, so just replace its
+         * elements with the results as we go */
+        int ints = 1;
+        for (unsigned int i = list->length; i-- > 0; ) {
+            stack_push(stack, list_get(list, i));
+            RUN_BLOCK(stack, buffer, prim, f);
+            list_get(list, i) = stack_pop_owned(stack);
+            ints = ints && val_is_imm_int(list_get(list, i));
+        }
+        list_all_ints(list) = ints;
+        stack_push(stack, vlist);
+    } else {
+        AList *result = list_new();
+        for (unsigned int i = list->length; i-- > 0; ) {
+            stack_push(stack, ref(list_get(list, i)));
+            RUN_BLOCK(stack, buffer, prim, f);
+            list_cons(stack_pop_owned(stack), result);
+        }
+        stack_push(stack, ref(val_list(result)));
+        delete_ref(vlist);
+    }
+
+    delete_ref(f);
+}
+
+/* Given stack [P L ..., give a list of the elements of L
+ * for which applying P gives a truthy value. (Goes from
+ * the end of the list to the start.) */
+void lib_filter(AStack* stack, AVarBuffer *buffer) {
+    AValue *p = stack_pop_owned(stack);
+    AValue *vlist = stack_pop_owned(stack);
+
+    if (val_type(vlist) == seq_val) {
+        if (seq_block_ok(p)) {
+            stack_push(stack, ref(val_seq(seq_filter(vlist, p))));
+            return;
+        }
+        vlist = as_list(vlist, stack);
+    }
+
+    AList *list = vlist->data.list;
+    long k;
+    int negate;
+    if (list->length > 0 && list_all_ints(list)) {
+        APrimitiveFunc op = block_kernel(p, buffer, &k, &negate);
+        AValue *result = NULL;
+        if (op != NULL && op != &lib_add && op != &lib_subtract
+                && op != &lib_multiply) {
+            result = filter_kernel(vlist, op, k, negate);
+        }
+        if (result != NULL) {
+            stack_push(stack, result);
+            delete_ref(p);
+            return;
+        }
+    }
+
+    APrimitiveFunc prim = single_primitive(p);
+    if (list_val_unshared(vlist)) {
+        /* slide the ones we keep down to the end of the list,
+         * and then chop off the start */
+        unsigned int kept = list->length;
+        for (unsigned int i = list->length; i-- > 0; ) {
+            AValue *elem = list_get(list, i);
+            stack_push(stack, ref(elem));
+            RUN_BLOCK(stack, buffer, prim, p);
+            AValue *cond = stack_pop_owned(stack);
+            if (val_get_int(cond)) {
+                list_get(list, --kept) = elem;
+            } else {
+                delete_ref(elem);
+            }
+            delete_ref(cond);
+        }
+        list->start += kept;
+        list->length -= kept;
+        list->buf->lo = list->start;
+        stack_push(stack, vlist);
+    } else {
+        AList *result = list_new();
+        for (unsigned int i = list->length; i-- > 0; ) {
+            AValue *elem = list_get(list, i);
+            stack_push(stack, ref(elem));
+            RUN_BLOCK(stack, buffer, prim, p);
+            AValue *cond = stack_pop_owned(stack);
+            if (val_get_int(cond)) {
+                list_cons(ref(elem), result);
+            }
+            delete_ref(cond);
+        }
+        stack_push(stack, ref(val_list(result)));
+        delete_ref(vlist);
+    }
+
+    delete_ref(p);
+}
+
+/* Given stack [F I L ..., start with I on the stack, and
+ * apply F to it and each element of L in turn, from the
+ * start of the list to the end. */
+void lib_fold(AStack* stack, AVarBuffer *buffer) {
+    AValue *f = stack_pop_owned(stack);
+    /* leave the initial value where it is */
+    AValue *init = stack_pop_owned(stack);
+    AValue *vlist = stack_pop_owned(stack);
+    stack_push(stack, init);
+
+    APrimitiveFunc prim = single_primitive(f);
+    if (val_type(vlist) == seq_val) {
+        ASeqIter *it = seq_iter_new(vlist->data.seq, stack);
+        AValue *val;
+        while ((val = seq_iter_next(it)) != NULL) {
+            stack_push(stack, val);
+            RUN_BLOCK(stack, buffer, prim, f);
+        }
+        free_seq_iter(it);
+    } else {
+        AList *list = vlist->data.list;
+        for (unsigned int i = 0; i < list->length; i++) {
+            stack_push(stack, ref(list_get(list, i)));
+            RUN_BLOCK(stack, buffer, prim, f);
+        }
+    }
+
+    delete_ref(vlist);
+    delete_ref(f);
+}
+
+/* Say that the built-in <name> was given something other than a
+ * list of ints. */
+static
+void not_int_list(const char *name) {
+    fprintf(stderr, "error: ‘%s’ needs a list of ints\n", name);
+}
+
+/* Add up (or multiply together, if <product>) the elements of a
+ * lazy sequence, without keeping them around, into <total>. Returns
+ * 0 (and stops there) if one of them isn't an int. */
+static
+int seq_total(ASeq *seq, AStack *stack, int product, long *total) {
+    if (seq->kind == range_seq && !product) {
+        /* n(a + b)/2, where one of n and a + b has to be even;
+         * unsigned so that overflow wraps like the slow way */
+        *total = 0;
+        if (seq->to <= seq->from) return 1;
+        unsigned long n = (unsigned long)seq->to - (unsigned long)seq->from;
+        unsigned long ends = (unsigned long)seq->from + (unsigned long)seq->to - 1;
+        *total = (long)((n % 2 == 0) ? (n / 2) * ends : n * (ends / 2));
+        return 1;
+    }
+    unsigned long sofar = product ? 1 : 0;
+    ASeqIter *it = seq_iter_new(seq, stack);
+    AValue *val;
+    int ok = 1;
+    while (ok && (val = seq_iter_next(it)) != NULL) {
+        if (val_type(val) != int_val) {
+            ok = 0;
+        } else if (product) {
+            sofar *= (unsigned long)val_get_int(val);
+        } else {
+            sofar += (unsigned long)val_get_int(val);
+        }
+        delete_ref(val);
+    }
+    free_seq_iter(it);
+    *total = (long)sofar;
+    return ok;
+}
+
+/* Add up (or multiply together, if <product>) the elements of the
+ * list or sequence <vlist>, into <total>. Returns 0 if it isn't one,
+ * or if one of them isn't an int. */
+static
+int list_total(AValue *vlist, AStack *stack, int product, long *total) {
+    if (val_type(vlist) == seq_val) {
+        return seq_total(vlist->data.seq, stack, product, total);
+    }
+    if (val_type(vlist) != list_val) return 0;
+
+    AList *list = vlist->data.list;
+    if (list->length > 0 && list_all_ints(list)) {
+        *total = product ? vec_int_product(&list_get(list, 0), list->length)
+                         : vec_int_sum(&list_get(list, 0), list->length);
+        return 1;
+    }
+    *total = product ? 1 : 0;
+    for (unsigned int i = 0; i < list->length; i++) {
+        AValue *val = list_get(list, i);
+        if (val_type(val) != int_val) return 0;
+        if (product) {
+            *total *= val_get_int(val);
+        } else {
+            *total += val_get_int(val);
+        }
+    }
+    return 1;
+}
+
+/* add up all the (integer) elements of a list */
+void lib_sum(AStack* stack, AVarBuffer *buffer) {
+    AValue *vlist = stack_pop_owned(stack);
+
+    long total;
+    if (!list_total(vlist, stack, 0, &total)) {
+        not_int_list("sum");
+        total = 0;
+    }
+
+    stack_push(stack, ref(val_int(total)));
+    delete_ref(vlist);
+}
+
+/* multiply together all the (integer) elements of a list */
+void lib_product(AStack* stack, AVarBuffer *buffer) {
+    AValue *vlist = stack_pop_owned(stack);
+
+    long total;
+    if (!list_total(vlist, stack, 1, &total)) {
+        not_int_list("product");
+        total = 1;
+    }
+
+    stack_push(stack, ref(val_int(total)));
+    delete_ref(vlist);
+}
+
+/* Find the smallest (integer) element of a list, or the largest if
+ * <largest>, for the built-in <name>. */
+static
+void list_extreme(AStack *stack, int largest, const char *name) {
+    AValue *vlist = stack_pop_owned(stack);
+    vlist = as_list(vlist, stack);
+
+    if (val_type(vlist) != list_val) {
+        not_int_list(name);
+        delete_ref(vlist);
+        return;
+    }
+    AList *list = vlist->data.list;
+    if (list->length == 0) {
+        fprintf(stderr, "error: attempt to take %s of empty list\n", name);
+    } else if (list_all_ints(list)) {
+        stack_push(stack, ref(val_int(largest
+            ? vec_int_max(&list_get(list, 0), list->length)
+            : vec_int_min(&list_get(list, 0), list->length))));
+    } else {
+        AValue *best = NULL;
+        for (unsigned int i = 0; i < list->length; i++) {
+            AValue *val = list_get(list, i);
+            if (val_type(val) != int_val) {
+                not_int_list(name);
+                best = NULL;
+                break;
+            }
+            if (best == NULL || (largest ? val_get_int(val) > val_get_int(best)
+                                         : val_get_int(val) < val_get_int(best))) {
+                best = val;
+            }
+        }
+        if (best != NULL) stack_push(stack, ref(best));
+    }
+    delete_ref(vlist);
+}
+
+/* find the smallest (integer) element of a list */
+void lib_minimum(AStack* stack, AVarBuffer *buffer) {
+    list_extreme(stack, 0, "minimum");
+}
+
+/* find the largest (integer) element of a list */
+void lib_maximum(AStack* stack, AVarBuffer *buffer) {
+    list_extreme(stack, 1, "maximum");
+}
+
+/* Given stack [N ..., give the ints from 1 to N (lazily). */
+void lib_iota(AStack* stack, AVarBuffer *buffer) {
+    AValue *n = stack_pop_owned(stack);
+
+    stack_push(stack, ref(val_seq(seq_range(1, val_get_int(n) + 1))));
+    delete_ref(n);
+}
+
+/* Given stack [N ..., give the ints from 0 to N-1 (lazily). */
+void lib_range(AStack* stack, AVarBuffer *buffer) {
+    AValue *n = stack_pop_owned(stack);
+
+    stack_push(stack, ref(val_seq(seq_range(0, val_get_int(n)))));
+    delete_ref(n);
+}
+
+/* Given stack [HI LO ..., give the ints from LO to HI-1 (lazily). */
+void lib_rangeends(AStack* stack, AVarBuffer *buffer) {
+    AValue *hi = stack_pop_owned(stack);
+    AValue *lo = stack_pop_owned(stack);
+
+    stack_push(stack, ref(val_seq(seq_range(val_get_int(lo), val_get_int(hi)))));
+    delete_ref(hi);
+    delete_ref(lo);
+}
+
+/* Given stack [G P X ..., give X, then G applied to X, then G
+ * applied to that, etc., for as long as P says yes (lazily: G and P
+ * run each time the sequence is gone through, whatever they do). */
+void lib_iterwhile(AStack* stack, AVarBuffer *buffer) {
+    AValue *gen = stack_pop_owned(stack);
+    AValue *pred = stack_pop_owned(stack);
+    AValue *seed = stack_pop_owned(stack);
+
+    stack_push(stack, ref(val_seq(seq_iterate(seed, pred, gen, 0))));
+}
+
+/* Like iter-while, but stops once P says yes. */
+void lib_iteruntil(AStack* stack, AVarBuffer *buffer) {
+    AValue *gen = stack_pop_owned(stack);
+    AValue *pred = stack_pop_owned(stack);
+    AValue *seed = stack_pop_owned(stack);
+
+    stack_push(stack, ref(val_seq(seq_iterate(seed, pred, gen, 1))));
+}
+
+/* turn a lazy sequence into a real list (lists stay as they are) */
+void lib_force(AStack* stack, AVarBuffer *buffer) {
+    AValue *a = stack_pop_owned(stack);
+
+    stack_push(stack, as_list(a, stack));
+}
+
 /* Initialize built-in list operators. */
 void listlib_init(ASymbolTable *st, AScope *sc) {
     addlibfunc(sc, st, "len", &lib_len);
@@ -120,4 +717,17 @@ void listlib_init(ASymbolTable *st, AScope *sc) {
     addlibfunc(sc, st, "last", &lib_last);
     addlibfunc(sc, st, "uncons", &lib_uncons);
     addlibfunc(sc, st, "unappend", &lib_unappend);
+    addlibfunc(sc, st, "map", &lib_map);
+    addlibfunc(sc, st, "filter", &lib_filter);
+    addlibfunc(sc, st, "fold", &lib_fold);
+    addlibfunc(sc, st, "sum", &lib_sum);
+    addlibfunc(sc, st, "product", &lib_product);
+    addlibfunc(sc, st, "minimum", &lib_minimum);
+    addlibfunc(sc, st, "maximum", &lib_maximum);
+    addlibfunc(sc, st, "iota", &lib_iota);
+    addlibfunc(sc, st, "range", &lib_range);
+    addlibfunc(sc, st, "range-ends", &lib_rangeends);
+    addlibfunc(sc, st, "iter-while", &lib_iterwhile);
+    addlibfunc(sc, st, "iter-until", &lib_iteruntil);
+    addlibfunc(sc, st, "force", &lib_force);
 }
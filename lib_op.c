@@ -1,316 +1,236 @@
 #include "lib.h"
 
-/* optimizing value-math functions (see bottom of file) */
-static AValue *gt_int_val(AValue *a, AValue *b);
-static AValue *lt_int_val(AValue *a, AValue *b);
-static AValue *gte_int_val(AValue *a, AValue *b);
-static AValue *lte_int_val(AValue *a, AValue *b);
-static AValue *ne_int_val(AValue *a, AValue *b);
-static AValue *eq_int_val(AValue *a, AValue *b);
-/* TODO replace all these with set_2int_val.
- * I am not very smart. */
-static AValue *set_int_val(AValue *a, int x);
-static AValue *set_2int_val(AValue *a, AValue *b, long x);
+/* For an operator given something other than ints: say so, and give
+ * back 0 in place of the answer so the stack still comes out the
+ * right size. (Takes over the references to <b> and <a>.) */
+static
+AValue *not_ints(AValue *b, AValue *a, const char *op) {
+    fprintf(stderr, "error: ‘%s’ needs two ints\n", op);
+    delete_ref(a);
+    delete_ref(b);
+    return ref(val_int(0));
+}
+
+/* Are <b> and <a> the same value? Ints, floats and symbols small
+ * enough to be immediates always are, so those are the same only if
+ * they're the same word; anything else has to be the same type, with
+ * the same contents (which for strings, lists and the like means the
+ * very same one). */
+static
+int same_value(AValue *b, AValue *a) {
+    if (a == b) return 1;
+    if (val_is_immediate(a) || val_is_immediate(b)) return 0;
+    if (a->type != b->type) return 0;
+    if (a->type == float_val) return a->data.fl == b->data.fl;
+    return a->data.i == b->data.i;
+}
 
 /* Boolean-negate the top value on the stack. */
 void lib_not(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
 
-    AValue *c = set_int_val(a, !a->data.i);
+    if (val_type(a) != int_val) {
+        fprintf(stderr, "error: ‘not’ needs an int\n");
+        stack_push(stack, ref(val_int(0)));
+        delete_ref(a);
+        return;
+    }
+    AValue *c = ref(val_int(!val_get_int(a)));
 
     stack_push(stack, c);
     delete_ref(a);
 }
 
+/* Run an operator on the top two values on the stack, replacing them
+ * with the result. Each operator is written as a function of the two
+ * values themselves (second, then top), which takes over the references
+ * to them and returns a new one; that's the form the interpreter calls
+ * directly when it has the top of the stack to hand (see eval.c). */
+static
+void run_binary(AStack *stack, ABinaryFunc f) {
+    AValue *a = stack_pop_owned(stack);
+    AValue *b = stack_pop_owned(stack);
+    stack_push(stack, f(b, a));
+}
+
+/* The + operator, on the values themselves (see run_binary). */
+static
+AValue *binary_add(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "+");
+    AValue *c = ref(val_int(val_get_int(b) + val_get_int(a)));
+    delete_ref(a);
+    delete_ref(b);
+    return c;
+}
+
 /* Add the top two values on the stack. */
 void lib_add(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = set_2int_val(a, b, b->data.i + a->data.i);
+    run_binary(stack, &binary_add);
+}
 
-    stack_push(stack, c);
+/* The - operator, on the values themselves (see run_binary). */
+static
+AValue *binary_subtract(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "-");
+    AValue *c = ref(val_int(val_get_int(b) - val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* Subtract the top value on the stack from the second value on the stack. */
 void lib_subtract(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = set_2int_val(a, b, b->data.i - a->data.i);
+    run_binary(stack, &binary_subtract);
+}
 
-    stack_push(stack, c);
+/* The * operator, on the values themselves (see run_binary). */
+static
+AValue *binary_multiply(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "*");
+    AValue *c = ref(val_int(val_get_int(b) * val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* Multiply the top two values on the stack. */
 void lib_multiply(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = set_2int_val(a, b, b->data.i * a->data.i);
+    run_binary(stack, &binary_multiply);
+}
 
-    stack_push(stack, c);
+/* The / operator, on the values themselves (see run_binary). */
+static
+AValue *binary_div(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "/");
+    AValue *c = ref(val_int(val_get_int(b) / val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* Divide the NOS by TOS. (Integer division only!) */
 void lib_div(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = set_2int_val(a, b, b->data.i / a->data.i);
+    run_binary(stack, &binary_div);
+}
 
-    stack_push(stack, c);
+/* The < operator, on the values themselves (see run_binary). */
+static
+AValue *binary_lessthan(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "<");
+    AValue *c = ref(val_int(val_get_int(b) < val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* given stack [A B ..., is B < A? */
 void lib_lessthan(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = lt_int_val(a, b);
+    run_binary(stack, &binary_lessthan);
+}
 
-    stack_push(stack, c);
+/* The > operator, on the values themselves (see run_binary). */
+static
+AValue *binary_greaterthan(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, ">");
+    AValue *c = ref(val_int(val_get_int(b) > val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* given stack [A B ..., is B > A? */
 void lib_greaterthan(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = gt_int_val(a, b);
+    run_binary(stack, &binary_greaterthan);
+}
 
-    stack_push(stack, c);
+/* The <= operator, on the values themselves (see run_binary). */
+static
+AValue *binary_lessthanequal(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "<=");
+    AValue *c = ref(val_int(val_get_int(b) <= val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* given stack [A B ..., is B < A? */
 void lib_lessthanequal(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = lte_int_val(a, b);
+    run_binary(stack, &binary_lessthanequal);
+}
 
-    stack_push(stack, c);
+/* The >= operator, on the values themselves (see run_binary). */
+static
+AValue *binary_greaterthanequal(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, ">=");
+    AValue *c = ref(val_int(val_get_int(b) >= val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* given stack [A B ..., is B > A? */
 void lib_greaterthanequal(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = gte_int_val(a, b);
+    run_binary(stack, &binary_greaterthanequal);
+}
 
-    stack_push(stack, c);
+/* The != operator, on the values themselves (see run_binary). */
+static
+AValue *binary_notequal(AValue *b, AValue *a) {
+    AValue *c = ref(val_int(!same_value(b, a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* are the two numbers on the top of the stack not equal? */
 void lib_notequal(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = ne_int_val(a, b);
+    run_binary(stack, &binary_notequal);
+}
 
-    stack_push(stack, c);
+/* The = operator, on the values themselves (see run_binary). */
+static
+AValue *binary_equal(AValue *b, AValue *a) {
+    AValue *c = ref(val_int(same_value(b, a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* are the two numbers on the top of the stack equal? */
 void lib_equal(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = eq_int_val(a, b);
+    run_binary(stack, &binary_equal);
+}
 
-    stack_push(stack, c);
+/* The mod operator, on the values themselves (see run_binary). */
+static
+AValue *binary_mod(AValue *b, AValue *a) {
+    if (val_type(b) != int_val || val_type(a) != int_val) return not_ints(b, a, "mod");
+    AValue *c = ref(val_int(val_get_int(b) % val_get_int(a)));
     delete_ref(a);
     delete_ref(b);
+    return c;
 }
 
 /* Take mod of NOS by TOS. */
 void lib_mod(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 1);
-    AValue *b = stack_get(stack, 0);
-    stack_pop(stack, 2);
-
-    // We don't do typechecking yet, so this might be garbage
-    // if it's not actually an int... we'll fix this later!
-    AValue *c = set_2int_val(a, b, a->data.i % b->data.i);
-
-    stack_push(stack, c);
-    delete_ref(a);
-    delete_ref(b);
+    run_binary(stack, &binary_mod);
 }
 
-
 /* Initialize built-in operators. */
 void oplib_init(ASymbolTable *st, AScope *sc) {
-    addlibfunc(sc, st, "+", &lib_add);
-    addlibfunc(sc, st, "-", &lib_subtract);
-    addlibfunc(sc, st, "*", &lib_multiply);
-    addlibfunc(sc, st, "/", &lib_div);
-    addlibfunc(sc, st, "mod", &lib_mod);
-    addlibfunc(sc, st, "<", &lib_lessthan);
-    addlibfunc(sc, st, ">", &lib_greaterthan);
-    addlibfunc(sc, st, "<=", &lib_lessthanequal);
-    addlibfunc(sc, st, "≤", &lib_lessthanequal);
-    addlibfunc(sc, st, ">=", &lib_greaterthanequal);
-    addlibfunc(sc, st, "≥", &lib_greaterthanequal);
-    addlibfunc(sc, st, "=", &lib_equal);
-    addlibfunc(sc, st, "!=", &lib_notequal);
-    addlibfunc(sc, st, "≠", &lib_notequal);
+    addbinaryfunc(sc, st, "+", &lib_add, &binary_add);
+    addbinaryfunc(sc, st, "-", &lib_subtract, &binary_subtract);
+    addbinaryfunc(sc, st, "*", &lib_multiply, &binary_multiply);
+    addbinaryfunc(sc, st, "/", &lib_div, &binary_div);
+    addbinaryfunc(sc, st, "mod", &lib_mod, &binary_mod);
+    addbinaryfunc(sc, st, "<", &lib_lessthan, &binary_lessthan);
+    addbinaryfunc(sc, st, ">", &lib_greaterthan, &binary_greaterthan);
+    addbinaryfunc(sc, st, "<=", &lib_lessthanequal, &binary_lessthanequal);
+    addbinaryfunc(sc, st, "≤", &lib_lessthanequal, &binary_lessthanequal);
+    addbinaryfunc(sc, st, ">=", &lib_greaterthanequal, &binary_greaterthanequal);
+    addbinaryfunc(sc, st, "≥", &lib_greaterthanequal, &binary_greaterthanequal);
+    addbinaryfunc(sc, st, "=", &lib_equal, &binary_equal);
+    addbinaryfunc(sc, st, "!=", &lib_notequal, &binary_notequal);
+    addbinaryfunc(sc, st, "≠", &lib_notequal, &binary_notequal);
     addlibfunc(sc, st, "not", &lib_not);
 }
-
-/* Same but for lessthan. */
-static
-AValue *lt_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = b->data.i < a->data.i;
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = b->data.i < a->data.i;
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i < a->data.i));
-    }
-}
-
-/* Same but for lessthan-or-equal. */
-static
-AValue *lte_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = b->data.i <= a->data.i;
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = b->data.i <= a->data.i;
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i <= a->data.i));
-    }
-}
-
-/* Same but for greaterthan. */
-static
-AValue *gt_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = b->data.i > a->data.i;
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = b->data.i > a->data.i;
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i > a->data.i));
-    }
-}
-
-/* Same but for greaterthan-or-equal. */
-static
-AValue *gte_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = b->data.i >= a->data.i;
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = b->data.i >= a->data.i;
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i >= a->data.i));
-    }
-}
-
-/* Same but for not-equal. */
-static
-AValue *ne_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = (b->data.i != a->data.i);
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = (b->data.i != a->data.i);
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i != a->data.i));
-    }
-}
-
-/* Same but for equal. */
-static
-AValue *eq_int_val(AValue *a, AValue *b) {
-    if (a->refs <= 1) {
-        a->data.i = (b->data.i == a->data.i);
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = (b->data.i == a->data.i);
-        return ref(b);
-    } else {
-        return ref(val_int(b->data.i == a->data.i));
-    }
-}
-
-/* Same but lets you set to an arbitrary int val. */
-static AValue *set_int_val(AValue *a, int x) {
-    if (a->refs <= 1) {
-        a->data.i = x;
-        return ref(a);
-    } else {
-        return ref(val_int(x));
-    }
-}
-
-static
-AValue *set_2int_val(AValue *a, AValue *b, long x) {
-    if (a->refs <= 1) {
-        a->data.i = x;
-        return ref(a);
-    } else if (b->refs <= 1) {
-        b->data.i = x;
-        return ref(b);
-    } else {
-        return ref(val_int(x));
-    }
-}
@@ -2,16 +2,13 @@
 
 /* Duplicate the top value on the stack. */
 void lib_dup(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_push(stack, a);
+    stack_push(stack, ref(stack_peek(stack, 0)));
 }
 
 /* Swap the top two values on the stack. */
 void lib_swap(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-
-    stack_pop(stack, 2);
+    AValue *a = stack_pop_owned(stack);
+    AValue *b = stack_pop_owned(stack);
 
     stack_push(stack, a);
     stack_push(stack, b);
@@ -20,20 +17,16 @@ void lib_swap(AStack* stack, AVarBuffer *buffer) {
 /* Copy the value below the top of the stack and put it
  * on top of the stack. ( a b -- a b a ) */
 void lib_over(AStack* stack, AVarBuffer *buffer) {
-    AValue *b = stack_get(stack, 1);
-
-    stack_push(stack, b);
+    stack_push(stack, ref(stack_peek(stack, 1)));
 }
 
 /* Move the value below NOS onto the top of the stack.
  * (i.e. ( a b c -- b c a ) where top of stack is to
  * the right) */
 void lib_rot(AStack* stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 2);
-    AValue *b = stack_get(stack, 1);
-    AValue *c = stack_get(stack, 0);
-
-    stack_pop(stack, 3);
+    AValue *c = stack_pop_owned(stack);
+    AValue *b = stack_pop_owned(stack);
+    AValue *a = stack_pop_owned(stack);
 
     stack_push(stack, b);
     stack_push(stack, c);
@@ -47,8 +40,7 @@ void lib_drop(AStack* stack, AVarBuffer *buffer) {
 
 /* Apply the block value on top of the stack. */
 void lib_apply(AStack *stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    stack_pop(stack, 1);
+    AValue *a = stack_pop_owned(stack);
 
     eval_block(stack, buffer, a);
 
@@ -58,12 +50,12 @@ void lib_apply(AStack *stack, AVarBuffer *buffer) {
 /* Apply the block value on top of the stack, but
  * ignore the top value underneath said block. */
 void lib_dip(AStack *stack, AVarBuffer *buffer) {
-    AValue *a = stack_get(stack, 0);
-    AValue *b = stack_get(stack, 1);
-    stack_pop(stack, 2);
+    AValue *a = stack_pop_owned(stack);
+    AValue *b = stack_pop_owned(stack);
 
-    if (a->type != block_val && a->type != bound_block_val) {
-        fprintf(stderr, "dip needs a block! (got %d)\n", a->type);
+    AValueType type = val_type(a);
+    if (type != block_val && type != bound_block_val) {
+        fprintf(stderr, "dip needs a block! (got %d)\n", type);
         return;
     }
     eval_block(stack, buffer, a);
@@ -1,52 +1,188 @@
 #include "list.h"
 
+/* The smallest number of slots we'll give a list when it grows. */
+#define LIST_MIN_CAPACITY 8
+
+/* Allocate a new, empty list buffer. */
+static
+AListBuffer *listbuf_new(unsigned int capacity) {
+    AListBuffer *buf = pool_alloc(&listbuf_pool);
+    COUNT_ALLOC(alloc_list_buffer, sizeof(AListBuffer) + capacity * sizeof(AValue*));
+    buf->items = NULL;
+    if (capacity > 0) {
+        buf->items = malloc(capacity * sizeof(AValue*));
+        if (buf->items == NULL) {
+            fprintf(stderr, "Error: couldn't allocate a list of %d elements. "
+                            "Out of memory.\n", capacity);
+            exit(1);
+        }
+    }
+    buf->lo = buf->hi = 0;
+    buf->capacity = capacity;
+    buf->refs = 1;
+    buf->all_ints = 1;
+    return buf;
+}
+
+/* Drop a list's reference to a buffer, freeing it (and
+ * dropping all the values in it) if it was the last one. */
+static
+void listbuf_unref(AListBuffer *buf) {
+    buf->refs --;
+    if (buf->refs == 0) {
+        for (unsigned int i = buf->lo; i < buf->hi; i++) {
+            delete_ref(buf->items[i]);
+        }
+        free(buf->items);
+        COUNT_FREE(alloc_list_buffer);
+        pool_free(&listbuf_pool, buf);
+    }
+}
+
 /* Allocate a new blank list. */
 AList *list_new() {
-    AList *list = malloc(sizeof(AList));
-    list->first = NULL;
-    list->last = NULL;
+    AList *list = pool_alloc(&list_pool);
+    COUNT_ALLOC(alloc_list, sizeof(AList));
+    list->buf = listbuf_new(0);
+    list->start = 0;
     list->length = 0;
     return list;
 }
 
-/* Allocate a new list-element and set it to
- * point to <val>. */
+/* Allocate a new list of <length> zeroes, for the caller to fill
+ * in with list_get. */
+AList *list_new_length(unsigned int length) {
+    AList *list = pool_alloc(&list_pool);
+    COUNT_ALLOC(alloc_list, sizeof(AList));
+    list->buf = listbuf_new(length);
+    AValue *zero = val_int(0);
+    for (unsigned int i = 0; i < length; i++) {
+        list->buf->items[i] = zero;
+    }
+    list->buf->hi = length;
+    list->start = 0;
+    list->length = length;
+    return list;
+}
+
+/* Make a new list looking at <count> elements of <list>, starting
+ * at <from>. Shares <list>'s storage, so it doesn't copy anything. */
+AList *list_slice(AList *list, unsigned int from, unsigned int count) {
+    assert(from + count <= list->length && "slice runs off end of list");
+    AList *slice = pool_alloc(&list_pool);
+    COUNT_ALLOC(alloc_list, sizeof(AList));
+    slice->buf = list->buf;
+    slice->buf->refs ++;
+    slice->start = list->start + from;
+    slice->length = count;
+    return slice;
+}
+
+/* If <list> is the only one using its buffer, let go of
+ * any values in the buffer that aren't part of the list. */
 static
-AListElem *create_element(AValue *val) {
-    AListElem *elem = malloc(sizeof(AListElem));
-    elem->val = val;
-    elem->next = NULL;
-    return elem;
+void list_trim(AList *list) {
+    AListBuffer *buf = list->buf;
+    if (buf->refs > 1) return;
+    unsigned int end = list->start + list->length;
+    for (unsigned int i = buf->lo; i < list->start; i++) {
+        delete_ref(buf->items[i]);
+    }
+    for (unsigned int i = end; i < buf->hi; i++) {
+        delete_ref(buf->items[i]);
+    }
+    buf->lo = list->start;
+    buf->hi = end;
+}
+
+/* Make sure <list> can claim <front> slots right before its first
+ * element and <back> slots right after its last one. Those slots
+ * have to be free, not just unused by this list, since other lists
+ * might be looking at them. If they aren't, the list gets its own
+ * copy of its elements in a new buffer, with the spare room split
+ * evenly between the two ends, so a run of conses or appends only
+ * has to copy now and then. */
+static
+void list_reserve(AList *list, unsigned int front, unsigned int back) {
+    list_trim(list);
+
+    AListBuffer *buf = list->buf;
+    unsigned int end = list->start + list->length;
+    int front_ok = (front == 0) || (buf->lo == list->start && list->start >= front);
+    int back_ok = (back == 0) || (buf->hi == end && buf->capacity - end >= back);
+    if (front_ok && back_ok) {
+        COUNT_REUSE(reuse_reserve, 1);
+        return;
+    }
+
+    unsigned int needed = list->length + front + back;
+    unsigned int new_start;
+    if (buf->refs == 1 && needed * 2 <= buf->capacity) {
+        /* there's plenty of room, it's just at the wrong end */
+        COUNT_REUSE(reuse_reserve, 1);
+        new_start = front + (buf->capacity - needed) / 2;
+        memmove(buf->items + new_start, buf->items + list->start,
+                list->length * sizeof(AValue*));
+    } else {
+        unsigned int new_capacity = needed * 2;
+        if (new_capacity < LIST_MIN_CAPACITY) new_capacity = LIST_MIN_CAPACITY;
+        new_start = front + (new_capacity - needed) / 2;
+
+        COUNT_REUSE(reuse_reserve, 0);
+        AListBuffer *newbuf = listbuf_new(new_capacity);
+        int sole_owner = (buf->refs == 1);
+        for (unsigned int i = 0; i < list->length; i++) {
+            /* if nobody else is using the old buffer, we can just
+             * take over its references rather than making new ones */
+            AValue *val = list_get(list, i);
+            newbuf->items[new_start + i] = sole_owner ? val : ref(val);
+            /* the old buffer might have had other things in it,
+             * but all that matters now is what we copied */
+            if (!val_is_imm_int(val)) newbuf->all_ints = 0;
+        }
+        if (sole_owner) {
+            buf->lo = buf->hi = 0;
+        }
+        listbuf_unref(buf);
+        list->buf = buf = newbuf;
+    }
+    list->start = new_start;
+    buf->lo = new_start;
+    buf->hi = new_start + list->length;
+}
+
+/* If nothing else can see the elements of the list in <val> (the
+ * value and its storage both have only the one reference), tidy up
+ * its storage so it holds exactly the list's elements, and return 1:
+ * the caller can then change them in place. Otherwise return 0. */
+int list_val_unshared(AValue *val) {
+    if (val->refs != 1 || val->data.list->buf->refs != 1) {
+        COUNT_REUSE(reuse_unshared, 0);
+        return 0;
+    }
+    COUNT_REUSE(reuse_unshared, 1);
+    list_trim(val->data.list);
+    return 1;
 }
 
 /* Push an AValue* onto the front of a list,
  * mutating the list. */
 void list_cons(AValue *val, AList *list) {
-    AListElem *elem = create_element(val);
-    elem->prev = NULL;
-    elem->next = list->first;
-    if (list->first != NULL) {
-        list->first->prev = elem;
-    }
-    list->first = elem;
-    if (list->last == NULL) {
-        list->last = elem;
-    }
+    list_reserve(list, 1, 0);
+    if (!val_is_imm_int(val)) list->buf->all_ints = 0;
+    list->start --;
+    list->buf->lo --;
+    list->buf->items[list->start] = val;
     list->length ++;
 }
 
 /* Put an AValue* at the end of a list,
  * mutating the list. */
 void list_append(AList *list, AValue *val) {
-    AListElem *elem = create_element(val);
-    elem->prev = list->last;
-    if (list->last != NULL) {
-        list->last->next = elem;
-    }
-    list->last = elem;
-    if (list->first == NULL) {
-        list->first = elem;
-    }
+    list_reserve(list, 0, 1);
+    if (!val_is_imm_int(val)) list->buf->all_ints = 0;
+    list->buf->items[list->buf->hi] = val;
+    list->buf->hi ++;
     list->length ++;
 }
 
@@ -104,38 +240,21 @@ AList *list_reify(AVarBuffer *buf, AProtoList *proto, unsigned int linenum) {
 /* Note: obviously this function is partial and
  * doesn't work on lists of length 0. */
 AValue *tail_list_val(AValue *val) {
-    if (val->data.list->length == 0) {
+    AList *list = val->data.list;
+    if (list->length == 0) {
         fprintf(stderr, "error: attempt to take tail of empty list");
         return NULL;
     }
 
+    COUNT_REUSE(reuse_tail, val->refs == 1);
     if (val->refs == 1) {
-        AListElem *oldfirst = val->data.list->first;
-        AListElem *newfirst = val->data.list->first->next;
-        AListElem *newlast = val->data.list->last;
-        if (newfirst == NULL) {
-            newlast = NULL;
-        }
-        val->data.list->first = newfirst;
-        if (newfirst != NULL) {
-            val->data.list->first->prev = NULL;
-        }
-        val->data.list->last = newlast;
-        val->data.list->length --;
-
-        /* don't need the old head element-holder anymore */
-        delete_ref(oldfirst->val);
-        free(oldfirst);
-
+        list->start ++;
+        list->length --;
+        /* don't need the old head anymore (unless someone else does) */
+        list_trim(list);
         return ref(val);
     } else {
-        AList *newlist = list_new();
-        AListElem *current = val->data.list->first->next;
-        while (current) {
-            list_append(newlist, ref(current->val));
-            current = current->next;
-        }
-        return ref(val_list(newlist));
+        return ref(val_list(list_slice(list, 1, list->length - 1)));
     }
 }
 
@@ -147,38 +266,20 @@ AValue *tail_list_val(AValue *val) {
 /* Also partial and returns NULL on lists
  * of length 0. */
 AValue *init_list_val(AValue *val) {
-    if (val->data.list->length == 0) {
+    AList *list = val->data.list;
+    if (list->length == 0) {
         fprintf(stderr, "error: attempt to take init of empty list");
         return NULL;
     }
 
+    COUNT_REUSE(reuse_init, val->refs == 1);
     if (val->refs == 1) {
-        AListElem *oldlast = val->data.list->last;
-        AListElem *newlast = val->data.list->last->prev;
-        AListElem *newfirst = val->data.list->first;
-        if (newlast == NULL) {
-            newfirst = NULL;
-        }
-        val->data.list->last = newlast;
-        if (newlast != NULL) {
-            val->data.list->last->next = NULL;
-        }
-        val->data.list->first = newfirst;
-        val->data.list->length --;
-
-        /* don't need the old head element-holder anymore */
-        delete_ref(oldlast->val);
-        free(oldlast);
-
+        list->length --;
+        /* don't need the old last element anymore (unless someone else does) */
+        list_trim(list);
         return ref(val);
     } else {
-        AList *newlist = list_new();
-        AListElem *current = val->data.list->first;
-        while (current->next) {
-            list_append(newlist, ref(current->val));
-            current = current->next;
-        }
-        return ref(val_list(newlist));
+        return ref(val_list(list_slice(list, 0, list->length - 1)));
     }
 }
 
@@ -188,15 +289,13 @@ AValue *init_list_val(AValue *val) {
 /* (NOTE: doesn't destroy list object; returns a
  * fresh reference to head value) */
 AValue *head_list_val(AValue *val) {
+    assert(val->data.list != NULL);
     if (val->data.list->length == 0) {
         fprintf(stderr, "error: attempt to take head of empty list");
         return NULL;
     }
 
-    assert(val->data.list != NULL);
-    assert(val->data.list->first != NULL);
-    AValue *hval = ref(val->data.list->first->val);
-    return hval;
+    return ref(list_get(val->data.list, 0));
 }
 
 /* Given a value of type 'list', return the last element
@@ -205,28 +304,25 @@ AValue *head_list_val(AValue *val) {
 /* (NOTE: doesn't destroy list object; returns a
  * fresh reference to head value) */
 AValue *last_list_val(AValue *val) {
+    assert(val->data.list != NULL);
     if (val->data.list->length == 0) {
         fprintf(stderr, "error: attempt to take last of empty list");
         return NULL;
     }
 
-    assert(val->data.list != NULL);
-    AValue *lval = ref(val->data.list->last->val);
-    return lval;
+    return ref(list_get(val->data.list, val->data.list->length - 1));
 }
 
 /* Print out a list to an arbitrary filehandle. */
 void fprint_list(FILE *out, AList *l) {
-    AListElem *current = l->first;
     fprintf(out, "{ ");
-    while (current) {
-        fprint_val(out, current->val);
-        if (current->next != NULL) {
+    for (unsigned int i = 0; i < l->length; i++) {
+        fprint_val(out, list_get(l, i));
+        if (i + 1 < l->length) {
             fprintf(out, ", ");
         } else {
             fprintf(out, " ");
         }
-        current = current->next;
     }
     fprintf(out, "}");
 }
@@ -235,19 +331,14 @@ void fprint_list(FILE *out, AList *l) {
  * the value cons'd onto the front of the list.
  * Can reuse the list value if only has one reference. */
 AValue *cons_list_val(AValue *val, AValue *l) {
+    COUNT_REUSE(reuse_cons, l->refs == 1);
     if (l->refs == 1) {
         list_cons(ref(val), l->data.list);
         return ref(l);
     } else {
-        AList *newlist = list_new();
-        AListElem *current = l->data.list->first;
-
-        while (current) {
-            assert(current->val != NULL);
-            list_append(newlist, ref(current->val));
-            current = current->next;
-        }
-
+        /* this only copies if something else is already
+         * using the space in front of the list */
+        AList *newlist = list_slice(l->data.list, 0, l->data.list->length);
         list_cons(ref(val), newlist);
         return ref(val_list(newlist));
     }
@@ -257,19 +348,14 @@ AValue *cons_list_val(AValue *val, AValue *l) {
  * the value appended to the end of the list.
  * Can reuse the list value if only has one reference. */
 AValue *append_list_val(AValue *l, AValue *val) {
+    COUNT_REUSE(reuse_append, l->refs == 1);
     if (l->refs == 1) {
         list_append(l->data.list, ref(val));
         return ref(l);
     } else {
-        AList *newlist = list_new();
-        AListElem *current = l->data.list->first;
-
-        while (current) {
-            assert(current->val != NULL);
-            list_append(newlist, ref(current->val));
-            current = current->next;
-        }
-
+        /* this only copies if something else is already
+         * using the space after the end of the list */
+        AList *newlist = list_slice(l->data.list, 0, l->data.list->length);
         list_append(newlist, ref(val));
         return ref(val_list(newlist));
     }
@@ -282,12 +368,7 @@ void print_list(AList *l) {
 
 /* Free a list. */
 void free_list(AList *l) {
-    AListElem *current = l->first;
-    while (current) {
-        AListElem *next = current->next;
-        delete_ref(current->val);
-        free(current);
-        current = next;
-    }
-    free(l);
+    listbuf_unref(l->buf);
+    COUNT_FREE(alloc_list);
+    pool_free(&list_pool, l);
 }
@@ -2,13 +2,39 @@
 #define _AL_LIST_H__
 
 #include "alma.h"
+#include "alloc.h"
 #include "stack.h"
 #include "eval.h"
 #include "value.h"
 
+/* Get the <i>'th element of a list (no bounds checking,
+ * and no new reference). */
+#define list_get(l, i) ((l)->buf->items[(l)->start + (i)])
+
+/* Is every element of a list an immediate int, so that it can go
+ * straight to the kernels in vector.h? (This can say no when the
+ * answer is yes, if the list's storage used to hold other things.)
+ * Anything that stores into a list with list_get has to clear it
+ * if what it stores isn't an immediate int. */
+#define list_all_ints(l) ((l)->buf->all_ints)
+
 /* Allocate a new blank list. */
 AList *list_new();
 
+/* Allocate a new list of <length> zeroes, for the caller to fill
+ * in with list_get. */
+AList *list_new_length(unsigned int length);
+
+/* Make a new list looking at <count> elements of <list>, starting
+ * at <from>. Shares <list>'s storage, so it doesn't copy anything. */
+AList *list_slice(AList *list, unsigned int from, unsigned int count);
+
+/* If nothing else can see the elements of the list in <val> (the
+ * value and its storage both have only the one reference), tidy up
+ * its storage so it holds exactly the list's elements, and return 1:
+ * the caller can then change them in place. Otherwise return 0. */
+int list_val_unshared(AValue *val);
+
 /* Push an AValue* onto the front of a list,
  * mutating the list. */
 void list_cons(AValue *val, AList *list);
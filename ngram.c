@@ -0,0 +1,179 @@
+#include "ngram.h"
+
+/* When alma is built with ALMA_NGRAMS (`make NGRAMS=1`), every
+ * instruction counts how many times it's run, and --ngram-stats prints
+ * out which sequences of two or three instructions in a row get run
+ * the most. That's what to look at when picking superinstructions
+ * (see fuse_superinstructions in bytecode.c), so those builds leave
+ * them out, and the sequences come out just as they were compiled. */
+
+#ifdef ALMA_NGRAMS
+
+/* All the code that's still around, so it can be counted at the end. */
+static ACode **live = NULL;
+static unsigned int live_size = 0;
+static unsigned int live_capacity = 0;
+
+/* The counts so far, by sequence. */
+static ANgram *ngrams = NULL;
+
+/* Keep hold of <code>, so that once the program's done, the sequences
+ * of instructions in it get counted up. (Only with ALMA_NGRAMS.) */
+void ngram_track(ACode *code) {
+    if (live_size == live_capacity) {
+        live_capacity = live_capacity ? live_capacity * 2 : 256;
+        live = realloc(live, live_capacity * sizeof(ACode*));
+    }
+    code->live_index = live_size;
+    live[live_size++] = code;
+}
+
+/* Write a short name for <instr> onto the end of <buf>. Constants
+ * are written out if they're ints or quoted words, since those are
+ * the ones worth fusing with whatever uses them. */
+static
+void name_instr(char *buf, size_t size, AInstruction *instr) {
+    size_t len = strlen(buf);
+    char *out = buf + len;
+    size -= len;
+    AValue *val;
+    switch (instr->op) {
+        case op_push_const:
+            val = instr->arg.val;
+            if (val_is_imm_int(val)) {
+                snprintf(out, size, "%ld", val_get_int(val));
+            } else if (val_type(val) == block_val && val->data.ast->code != NULL
+                    && val->data.ast->code->length == 2
+                    && (val->data.ast->code->instrs[0].op == op_call_prim
+                        || op_is_shuffle(val->data.ast->code->instrs[0].op)
+                        || val->data.ast->code->instrs[0].op == op_call_user
+                        || val->data.ast->code->instrs[0].op == op_dip
+                        || val->data.ast->code->instrs[0].op == op_apply)) {
+                AInstruction *only = &val->data.ast->code->instrs[0];
+                if (only->op == op_dip) snprintf(out, size, "'dip");
+                else if (only->op == op_apply) snprintf(out, size, "'apply");
+                else snprintf(out, size, "'%s", only->arg.func->sym->name);
+            } else if (val_type(val) == block_val) {
+                snprintf(out, size, "[block]");
+            } else {
+                snprintf(out, size, "<const>");
+            }
+            break;
+        case op_call_prim: case op_call_user:
+        case op_dup: case op_swap: case op_over: case op_drop:
+        case op_add_int: case op_sub_int: case op_mul_int:
+        case op_div_int: case op_mod_int:
+        case op_lt_int: case op_gt_int: case op_le_int:
+        case op_ge_int: case op_eq_int: case op_ne_int:
+            snprintf(out, size, "%s", instr->arg.func->sym->name);
+            break;
+        case op_push_var:       snprintf(out, size, "<var>"); break;
+        case op_bind:
+        case op_bind_local:     snprintf(out, size, "->"); break;
+        case op_unbind:         snprintf(out, size, "<unbind>"); break;
+        case op_make_closure:   snprintf(out, size, "[closure]"); break;
+        case op_reify_list:     snprintf(out, size, "{list}"); break;
+        case op_apply:          snprintf(out, size, "apply"); break;
+        case op_dip:            snprintf(out, size, "dip"); break;
+        case op_if:             snprintf(out, size, "if"); break;
+        case op_ifstar:         snprintf(out, size, "if*"); break;
+        default:                snprintf(out, size, "?%d", instr->op); break;
+    }
+}
+
+/* Does <op> go off and run something else before the next
+ * instruction? (Then it can't be fused with what comes after.) */
+static
+int leaves(AOpcode op) {
+    return op == op_call_user || op == op_apply || op == op_dip
+        || op == op_if || op == op_ifstar;
+}
+
+/* Add <count> to the sequence called <key>. */
+static
+void add_ngram(const char *key, unsigned int length, unsigned long count) {
+    ANgram *ng = NULL;
+    HASH_FIND_STR(ngrams, key, ng);
+    if (ng == NULL) {
+        ng = malloc(sizeof(ANgram));
+        ng->key = malloc(strlen(key) + 1);
+        strcpy(ng->key, key);
+        ng->length = length;
+        ng->count = 0;
+        HASH_ADD_KEYPTR(hh, ngrams, ng->key, strlen(ng->key), ng);
+    }
+    ng->count += count;
+}
+
+/* Let go of <code>, since it's about to be freed. (Only with
+ * ALMA_NGRAMS.) What it ran doesn't get counted: by the time code is
+ * freed, the values and words it points to might be gone already. */
+void ngram_forget(ACode *code) {
+    live[code->live_index] = live[--live_size];
+    live[code->live_index]->live_index = code->live_index;
+}
+
+/* Count up the sequences of instructions in <code> that were run. */
+static
+void count_code(ACode *code) {
+    char key[256];
+    for (unsigned int i = 0; i < code->length; i++) {
+        unsigned long count = code->instrs[i].count;
+        if (count == 0) continue;
+        key[0] = '\0';
+        name_instr(key, sizeof(key), &code->instrs[i]);
+        /* straight-line code runs its next instruction as many times
+         * as it runs this one, so the count of the first one is the
+         * count of the whole sequence */
+        for (unsigned int n = 2; n <= NGRAM_MAX && i + n - 1 < code->length; n++) {
+            AInstruction *prev = &code->instrs[i + n - 2];
+            AInstruction *next = &code->instrs[i + n - 1];
+            if (leaves(prev->op) || next->op == op_return) break;
+            strncat(key, " ", sizeof(key) - strlen(key) - 1);
+            name_instr(key, sizeof(key), next);
+            add_ngram(key, n, count);
+        }
+    }
+}
+
+/* For sorting the most-run sequences first. */
+static
+int by_count(ANgram *a, ANgram *b) {
+    if (a->count == b->count) return strcmp(a->key, b->key);
+    return (a->count > b->count) ? -1 : 1;
+}
+
+/* Print out the <limit> most-run sequences of each length from 2 up
+ * to NGRAM_MAX, from all the code that's still around. This has to
+ * happen before the program's words are freed. */
+void fprint_ngrams(FILE *out, unsigned int limit) {
+    for (unsigned int i = 0; i < live_size; i++) {
+        count_code(live[i]);
+    }
+    HASH_SORT(ngrams, by_count);
+    for (unsigned int n = 2; n <= NGRAM_MAX; n++) {
+        fprintf(out, "-- most-run sequences of %u instructions --\n", n);
+        unsigned int shown = 0;
+        for (ANgram *ng = ngrams; ng != NULL && shown < limit; ng = ng->hh.next) {
+            if (ng->length != n) continue;
+            fprintf(out, "%12lu  %s\n", ng->count, ng->key);
+            shown ++;
+        }
+    }
+}
+
+#else
+
+void ngram_track(ACode *code) { }
+
+void ngram_forget(ACode *code) { }
+
+/* Print out the <limit> most-run sequences of each length from 2 up
+ * to NGRAM_MAX, from all the code that's still around. This has to
+ * happen before the program's words are freed. */
+void fprint_ngrams(FILE *out, unsigned int limit) {
+    fprintf(out, "(no instruction counts: alma has to be built with "
+                 "`make NGRAMS=1` for those)\n");
+}
+
+#endif
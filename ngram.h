@@ -0,0 +1,25 @@
+#ifndef _AL_NGRAM_H__
+#define _AL_NGRAM_H__
+
+#include "alma.h"
+#include "value.h"
+#include "bytecode.h"
+
+/* The longest instruction sequences that get counted. */
+#define NGRAM_MAX 3
+
+/* Keep hold of <code>, so that once the program's done, the sequences
+ * of instructions in it get counted up. (Only with ALMA_NGRAMS.) */
+void ngram_track(ACode *code);
+
+/* Let go of <code>, since it's about to be freed. (Only with
+ * ALMA_NGRAMS.) What it ran doesn't get counted: by the time code is
+ * freed, the values and words it points to might be gone already. */
+void ngram_forget(ACode *code);
+
+/* Print out the <limit> most-run sequences of each length from 2 up
+ * to NGRAM_MAX, from all the code that's still around. This has to
+ * happen before the program's words are freed. */
+void fprint_ngrams(FILE *out, unsigned int limit);
+
+#endif
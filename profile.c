@@ -0,0 +1,406 @@
+#include "profile.h"
+#include "value.h"
+#include <time.h>
+#include <signal.h>
+
+/* With --profile, every call into Alma code -- a word, or a block run
+ * by apply, dip, if, or a built-in like while -- is timed. Each piece
+ * of code gets a count of how many times it was called, its inclusive
+ * time (from being called to returning, counting what it called), and
+ * its exclusive time (the same, minus what it called). A word calling
+ * itself only counts towards its inclusive time once, at the outermost
+ * call, so that doesn't add up to more than the whole run.
+ *
+ * The calls that haven't returned yet are kept on a shadow call stack
+ * here, since the interpreter's own return stack skips tail calls and
+ * doesn't know when C re-enters it. A tail call counts as its caller
+ * returning and the callee being called in its place. Built-ins aren't
+ * timed on their own: their time goes to whatever called them.
+ *
+ * Timing every call takes long enough to throw off the numbers for
+ * words that are called very often, so there's also a sampling mode
+ * (--profile=folded), where nothing gets timed. Instead a timer goes
+ * off every PROFILE_INTERVAL_NS of CPU time, and the calls on the
+ * shadow stack are counted up, in the folded-stack format that
+ * flamegraph.pl takes. The signal handler itself only notes that a
+ * sample is due; it gets taken at the next call or return, which is
+ * the same thing since the shadow stack can't change before then, and
+ * means the handler never has to look at the stack while it's being
+ * changed (or allocate anything). */
+
+/* How much CPU time there is between samples. */
+#define PROFILE_INTERVAL_NS 1000000
+
+/* Samples only keep this many of the innermost calls, with the rest
+ * put together as one "[...]" call at the bottom. */
+#define PROFILE_SAMPLE_DEPTH 512
+
+int profiling = 0;
+
+/* Whether it's the sampling kind of profiling. */
+static int sampling = 0;
+
+/* How many samples are due, according to the timer. */
+static volatile sig_atomic_t samples_due = 0;
+
+/* The samples taken so far, by stack. */
+static AProfileSample *samples = NULL;
+
+/* Everything profiled so far, by code. */
+static AProfileEntry *entries = NULL;
+
+/* The calls that haven't returned yet, innermost last. */
+static AProfileFrame *calls = NULL;
+static unsigned int calls_size = 0;
+static unsigned int calls_capacity = 0;
+
+/* The time now, in nanoseconds from some fixed point. */
+static
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Start profiling every call from here on. */
+void profile_start(void) {
+    profiling = 1;
+}
+
+/* For the timer: note that it's time for another sample. */
+static
+void sample_due(int signum) {
+    samples_due ++;
+}
+
+/* Start sampling the calls being run from here on, every so often.
+ * Returns whether it could set the timer up. */
+int profile_start_sampling(void) {
+    struct sigaction action;
+    action.sa_handler = &sample_due;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+#ifdef SA_RESTART
+    /* (not strictly POSIX, but don't let it interrupt reading input) */
+    action.sa_flags = SA_RESTART;
+#endif
+    if (sigaction(SIGPROF, &action, NULL) != 0) {
+        return 0;
+    }
+
+    timer_t timer;
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+        return 0;
+    }
+    struct itimerspec interval;
+    interval.it_interval.tv_sec = 0;
+    interval.it_interval.tv_nsec = PROFILE_INTERVAL_NS;
+    interval.it_value = interval.it_interval;
+    if (timer_settime(timer, 0, &interval, NULL) != 0) {
+        return 0;
+    }
+
+    profiling = 1;
+    sampling = 1;
+    return 1;
+}
+
+/* Find the entry for <code>, making a new one if need be. */
+static
+AProfileEntry *entry_for(ACode *code) {
+    AProfileEntry *e = NULL;
+    HASH_FIND_PTR(entries, &code, e);
+    if (e == NULL) {
+        e = malloc(sizeof(AProfileEntry));
+        e->code = code;
+        e->name = NULL;
+        e->owner = NULL;
+        e->index = 0;
+        e->linenum = code->instrs[0].linenum;
+        e->calls = 0;
+        e->inclusive = 0;
+        e->exclusive = 0;
+        e->active = 0;
+        HASH_ADD_PTR(entries, code, e);
+    }
+    return e;
+}
+
+/* Write the name of <e>'s code into <buf>, which is <size> long. A
+ * block is named after the word it's in, and where it comes in there,
+ * since there could be several of them on the same line. */
+static
+void entry_name(char *buf, size_t size, AProfileEntry *e) {
+    if (e->name != NULL) {
+        snprintf(buf, size, "%s", e->name);
+    } else if (e->owner != NULL) {
+        snprintf(buf, size, "[block %u in %s at line %u]", e->index, e->owner, e->linenum);
+    } else {
+        snprintf(buf, size, "[block at line %u]", e->linenum);
+    }
+}
+
+/* Write the name of <e>'s code onto the end of <buf>, which has
+ * <length> characters in it so far, for a sample. */
+static
+void sample_frame_name(char **buf, size_t *length, size_t *capacity,
+                       AProfileEntry *e) {
+    char name[256];
+    entry_name(name, sizeof(name), e);
+    size_t n = strlen(name);
+    if (*length + n + 2 > *capacity) {
+        while (*length + n + 2 > *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 256;
+        }
+        *buf = realloc(*buf, *capacity);
+    }
+    if (*length > 0) {
+        (*buf)[(*length)++] = ';';
+    }
+    for (size_t i = 0; i < n; i++) {
+        /* (a ; would split it up in the output) */
+        (*buf)[(*length)++] = (name[i] == ';') ? ':' : name[i];
+    }
+    (*buf)[*length] = '\0';
+}
+
+/* Count the calls on the shadow stack right now as however many
+ * samples are due. */
+static
+void take_sample(void) {
+    static char *stack = NULL;
+    static size_t capacity = 0;
+    size_t length = 0;
+
+    /* (with the timer's signal held off, so a tick can't land between
+     * reading the count and resetting it, and get lost) */
+    sigset_t prof, old;
+    sigemptyset(&prof);
+    sigaddset(&prof, SIGPROF);
+    sigprocmask(SIG_BLOCK, &prof, &old);
+    unsigned long count = samples_due;
+    samples_due = 0;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+
+    unsigned int first = 0;
+    if (calls_size > PROFILE_SAMPLE_DEPTH) {
+        first = calls_size - PROFILE_SAMPLE_DEPTH;
+        AProfileEntry deeper = { .name = "[...]" };
+        sample_frame_name(&stack, &length, &capacity, &deeper);
+    }
+    for (unsigned int i = first; i < calls_size; i++) {
+        sample_frame_name(&stack, &length, &capacity, calls[i].entry);
+    }
+    if (length == 0) {
+        /* (nothing's running; it's between calls from C) */
+        return;
+    }
+
+    AProfileSample *sample = NULL;
+    HASH_FIND_STR(samples, stack, sample);
+    if (sample == NULL) {
+        sample = malloc(sizeof(AProfileSample));
+        sample->stack = malloc(length + 1);
+        strcpy(sample->stack, stack);
+        sample->count = 0;
+        HASH_ADD_KEYPTR(hh, samples, sample->stack, length, sample);
+    }
+    sample->count += count;
+}
+
+/* Note that <code> is one of the blocks written in the word <owner>
+ * (at line <linenum>), the next one after the <*count> found so far. */
+static void name_blocks(ACode *code, const char *owner, unsigned int *count);
+static
+void name_block(ACode *code, const char *owner, unsigned int linenum,
+                unsigned int *count) {
+    if (code == NULL) return;
+    AProfileEntry *e = entry_for(code);
+    if (e->name != NULL || e->owner != NULL) return;
+    e->owner = malloc(strlen(owner) + 1);
+    strcpy(e->owner, owner);
+    e->index = ++ *count;
+    if (e->linenum == 0) {
+        /* (an empty block has nothing in it to say where it is) */
+        e->linenum = linenum;
+    }
+    name_blocks(code, owner, count);
+}
+
+/* Name the blocks made anywhere in <code>, which is written in the
+ * word <owner>, in the order they get made (which is the order they're
+ * written in, apart from a list's elements, which are made last first). */
+static
+void name_blocks(ACode *code, const char *owner, unsigned int *count) {
+    for (unsigned int i = 0; i < code->length; i++) {
+        AInstruction *instr = &code->instrs[i];
+        AOpcode op = code_base_op(instr->op);
+        if (op == op_make_closure
+                || (op == op_push_const && val_type(instr->arg.val) == block_val)) {
+            name_block(instr->arg.val->data.ast->code, owner, instr->linenum, count);
+        } else if (op == op_reify_list) {
+            /* (each element gets run like a block) */
+            for (AWordSeqNode *elem = instr->arg.pl->first; elem != NULL; elem = elem->next) {
+                name_block(elem->code, owner, instr->linenum, count);
+            }
+        }
+    }
+}
+
+/* Note that <code> is the body of the word <f>, for the report. */
+void profile_name(ACode *code, AFunc *f) {
+    AProfileEntry *e = entry_for(code);
+    if (e->name == NULL) {
+        /* (copied, since the report comes after the symbols are freed) */
+        e->name = malloc(strlen(f->sym->name) + 1);
+        strcpy(e->name, f->sym->name);
+        unsigned int count = 0;
+        name_blocks(code, e->name, &count);
+    }
+}
+
+/* Note that <code> has just been called, by the instruction <from>
+ * (or from C, if that's NULL). */
+void profile_enter(ACode *code, AInstruction *from) {
+    if (samples_due) take_sample();
+    if (from != NULL && from->op == op_call_user) {
+        profile_name(code, from->arg.func);
+    }
+    AProfileEntry *e = entry_for(code);
+    e->calls ++;
+    e->active ++;
+
+    if (calls_size == calls_capacity) {
+        calls_capacity = calls_capacity ? calls_capacity * 2 : 64;
+        calls = realloc(calls, calls_capacity * sizeof(AProfileFrame));
+    }
+    AProfileFrame *f = &calls[calls_size++];
+    f->entry = e;
+    f->children = 0;
+    f->start = sampling ? 0 : now_ns();
+}
+
+/* Note that the most recently called code has just returned. */
+void profile_leave(void) {
+    if (samples_due) take_sample();
+    if (sampling) {
+        if (calls_size > 0) calls[--calls_size].entry->active --;
+        return;
+    }
+    uint64_t now = now_ns();
+    if (calls_size == 0) return;
+    AProfileFrame *f = &calls[--calls_size];
+    uint64_t elapsed = now - f->start;
+    f->entry->exclusive += elapsed - f->children;
+    if (-- f->entry->active == 0) {
+        f->entry->inclusive += elapsed;
+    }
+    if (calls_size > 0) {
+        calls[calls_size - 1].children += elapsed;
+    }
+}
+
+/* For sorting the most time first. */
+static
+int by_exclusive(AProfileEntry *a, AProfileEntry *b) {
+    if (a->exclusive != b->exclusive) return (a->exclusive > b->exclusive) ? -1 : 1;
+    if (a->calls != b->calls) return (a->calls > b->calls) ? -1 : 1;
+    return (a->linenum < b->linenum) ? -1 : (a->linenum > b->linenum);
+}
+
+/* Print <s> as a JSON string. */
+static
+void fprint_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(out, "\\%c", *s);
+        } else if ((unsigned char)*s < 0x20) {
+            fprintf(out, "\\u%04x", *s);
+        } else {
+            fputc(*s, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Print out everything that's been profiled, most time first, as JSON
+ * if <json> is set and as a table otherwise. Any calls that haven't
+ * returned yet are finished off first, counting up to now. */
+void fprint_profile(FILE *out, int json) {
+    while (calls_size > 0) {
+        profile_leave();
+    }
+    HASH_SORT(entries, by_exclusive);
+
+    uint64_t total = 0;
+    for (AProfileEntry *e = entries; e != NULL; e = e->hh.next) {
+        total += e->exclusive;
+    }
+
+    if (json) {
+        const char *separator = "";
+        fprintf(out, "{\"total_ns\": %llu, \"words\": [", (unsigned long long)total);
+        for (AProfileEntry *e = entries; e != NULL; e = e->hh.next) {
+            /* (blocks get entries when their word is named, run or not) */
+            if (e->calls == 0) continue;
+            fprintf(out, "%s\n  {\"name\": ", separator);
+            separator = ",";
+            if (e->name) {
+                fprint_json_string(out, e->name);
+            } else {
+                fprintf(out, "null");
+            }
+            fprintf(out, ", \"block\": %s, ", e->name ? "false" : "true");
+            if (e->owner) {
+                fprintf(out, "\"in\": ");
+                fprint_json_string(out, e->owner);
+                fprintf(out, ", \"index\": %u, ", e->index);
+            }
+            fprintf(out, "\"line\": %u, \"calls\": %lu, "
+                         "\"inclusive_ns\": %llu, \"exclusive_ns\": %llu}",
+                    e->linenum, e->calls,
+                    (unsigned long long)e->inclusive,
+                    (unsigned long long)e->exclusive);
+        }
+        fprintf(out, "\n]}\n");
+        return;
+    }
+
+    fprintf(out, "-- profile: %.3f ms in Alma code --\n", total / 1e6);
+    fprintf(out, "%10s %7s %10s %12s  %s\n", "self ms", "self %", "total ms", "calls", "word");
+    for (AProfileEntry *e = entries; e != NULL; e = e->hh.next) {
+        if (e->calls == 0) continue;
+        char name[256];
+        entry_name(name, sizeof(name), e);
+        fprintf(out, "%10.3f %6.1f%% %10.3f %12lu  %s",
+                e->exclusive / 1e6, total ? 100.0 * e->exclusive / total : 0.0,
+                e->inclusive / 1e6, e->calls, name);
+        if (e->name) {
+            fprintf(out, " (line %u)", e->linenum);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/* For sorting the samples by stack. */
+static
+int by_stack(AProfileSample *a, AProfileSample *b) {
+    return strcmp(a->stack, b->stack);
+}
+
+/* Print out the samples taken so far, one line for each set of calls
+ * that was caught running, in the folded-stack format that
+ * flamegraph.pl takes: the calls, outermost first and separated by
+ * semicolons, then how many samples caught them. */
+void fprint_folded(FILE *out) {
+    if (samples_due) take_sample();
+    HASH_SORT(samples, by_stack);
+    for (AProfileSample *sample = samples; sample != NULL; sample = sample->hh.next) {
+        fprintf(out, "%s %lu\n", sample->stack, sample->count);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef _AL_PROFILE_H__
+#define _AL_PROFILE_H__
+
+#include "alma.h"
+#include "bytecode.h"
+
+/* Whether --profile is on. The interpreter checks this before calling
+ * anything else in here, so it costs nothing more than that when off. */
+extern int profiling;
+
+/* Start profiling every call from here on. */
+void profile_start(void);
+
+/* Start sampling the calls being run from here on, every so often.
+ * Returns whether it could set the timer up. */
+int profile_start_sampling(void);
+
+/* Note that <code> has just been called, by the instruction <from>
+ * (or from C, if that's NULL). */
+void profile_enter(ACode *code, AInstruction *from);
+
+/* Note that the most recently called code has just returned. */
+void profile_leave(void);
+
+/* Note that <code> is the body of the word <f>, for the report. */
+void profile_name(ACode *code, AFunc *f);
+
+/* Print out everything that's been profiled, most time first, as JSON
+ * if <json> is set and as a table otherwise. Any calls that haven't
+ * returned yet are finished off first, counting up to now. */
+void fprint_profile(FILE *out, int json);
+
+/* Print out the samples taken so far, one line for each set of calls
+ * that was caught running, in the folded-stack format that
+ * flamegraph.pl takes: the calls, outermost first and separated by
+ * semicolons, then how many samples caught them. */
+void fprint_folded(FILE *out);
+
+#endif
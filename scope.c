@@ -27,8 +27,11 @@ AScopeEntry *scope_entry_new(ASymbol *sym, AFunc *func) {
     return newentry;
 }
 
-/* Create an entry in the scope promising to fill in this word later. */
-ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol, unsigned int linenum) {
+/* Create an entry in the scope promising to fill in this word later.
+ * (<vars_below> and <bind_depth> say where it's being declared.) */
+ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
+                               unsigned int vars_below, unsigned int bind_depth,
+                               unsigned int linenum) {
     AScopeEntry *e = NULL;
     HASH_FIND_PTR(sc->content, &symbol, e);
 
@@ -57,7 +60,12 @@ ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
          * actually do need one, we always have one. */
         /* (I don't really like how this makes the speed of your program
          * super-dependent on the order functions are declared, tho.) */
+        /* (Though if there are no variables around it to be free, it
+         * can't have any -- so a call to it from inside a block still
+         * lets that block be a flat closure.) */
         dummy->free_var_index = 0;
+        dummy->vars_below = vars_below;
+        dummy->bind_depth = bind_depth;
 
         /* The reason for this weird structure is, now we can change the AUserFunc
          * that dummyfunc has a pointer to, and anything that got a pointer to
@@ -65,6 +73,7 @@ ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
         AFunc *dummyfunc = malloc(sizeof(AFunc));
         dummyfunc->type = user_func;
         dummyfunc->data.userfunc = dummy;
+        dummyfunc->binary = NULL;
         dummyfunc->sym = symbol;
         registry_register(reg, dummyfunc);
 
@@ -125,7 +134,7 @@ ACompileStatus scope_import(AScope *sc, ASymbol *symbol, AFunc *func) {
 
 /* Register a new user word into scope. Requires that scope_placehold was already called. */
 ACompileStatus scope_user_register(AScope *sc, ASymbol *symbol, unsigned int free_index,
-                                   unsigned int vars_below, AWordSeqNode *words) {
+                                   AWordSeqNode *words) {
     AScopeEntry *e = NULL;
     HASH_FIND_PTR(sc->content, &symbol, e);
 
@@ -141,7 +150,6 @@ ACompileStatus scope_user_register(AScope *sc, ASymbol *symbol, unsigned int fre
     e->func->data.userfunc->type = const_func;
     e->func->data.userfunc->words = words;
     e->func->data.userfunc->free_var_index = free_index;
-    e->func->data.userfunc->vars_below = vars_below;
 
     e->imported = 0;
 
@@ -149,9 +157,11 @@ ACompileStatus scope_user_register(AScope *sc, ASymbol *symbol, unsigned int fre
 }
 
 /* Create an entry in the scope telling it to push the
- * <num>'th bound variable to the stack. */
+ * <index>'th bound variable to the stack. (It's the <slot>'th
+ * one bound by a bind that's <depth> binds deep.) */
 ACompileStatus scope_create_push(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
-                                 unsigned int index, unsigned int linenum) {
+                                 unsigned int index, unsigned int depth,
+                                 unsigned int slot, unsigned int linenum) {
     AScopeEntry *e = NULL;
     HASH_FIND_PTR(sc->content, &symbol, e);
 
@@ -177,7 +187,10 @@ ACompileStatus scope_create_push(AScope *sc, AFuncRegistry *reg, ASymbol *symbol
 
     AFunc *pushfunc = malloc(sizeof(AFunc));
     pushfunc->type = var_push;
-    pushfunc->data.varindex = index;
+    pushfunc->binary = NULL;
+    pushfunc->data.var.index = index;
+    pushfunc->data.var.depth = depth;
+    pushfunc->data.var.slot = slot;
     pushfunc->sym = symbol;
     registry_register(reg, pushfunc);
 
@@ -245,6 +258,7 @@ void free_user_func(AUserFunc *f) {
         /* if it's a bound_func, then we need to free its closure (or at least
          * decrease its closure's refcount.) */
         varbuf_unref(f->closure);
+        COUNT_FREE(alloc_userfunc);
     }
     f->words = NULL;
     free(f);
@@ -9,8 +9,11 @@
 /* Create a new lexical scope with parent scope 'parent'. */
 AScope *scope_new(AScope *parent);
 
-/* Create an entry in the scope promising to fill in this function later. */
-ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol, unsigned int linenum);
+/* Create an entry in the scope promising to fill in this function later.
+ * (<vars_below> and <bind_depth> say where it's being declared.) */
+ACompileStatus scope_placehold(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
+                               unsigned int vars_below, unsigned int bind_depth,
+                               unsigned int linenum);
 
 /* Register a new function into scope using the symbol sym as a key. */
 ACompileStatus scope_register(AScope *sc, ASymbol *sym, AFunc *func);
@@ -22,12 +25,14 @@ ACompileStatus scope_import(AScope *sc, ASymbol *symbol, AFunc *func);
 
 /* Register a new user word into scope. Requires that scope_placehold was already called. */
 ACompileStatus scope_user_register(AScope *sc, ASymbol *symbol, unsigned int free_index,
-                                   unsigned int vars_below, AWordSeqNode *words);
+                                   AWordSeqNode *words);
 
 /* Create an entry in the scope telling it to push the
- * <num>'th bound variable to the stack. */
+ * <index>'th bound variable to the stack. (It's the <slot>'th
+ * one bound by a bind that's <depth> binds deep.) */
 ACompileStatus scope_create_push(AScope *sc, AFuncRegistry *reg, ASymbol *symbol,
-                                 unsigned int index, unsigned int linenum);
+                                 unsigned int index, unsigned int depth,
+                                 unsigned int slot, unsigned int linenum);
 
 /* Delete an entry from the scope. (Used if you make a mistake in interactive mode;
  * we don't want to ban you from redefining the same function!!) */
@@ -0,0 +1,200 @@
+#include "seq.h"
+
+/* Allocate a new sequence with nothing filled in. */
+static
+ASeq *seq_new(ASeqKind kind) {
+    ASeq *seq = malloc(sizeof(ASeq));
+    seq->kind = kind;
+    seq->from = seq->to = 0;
+    seq->seed = seq->block = seq->pred = seq->source = NULL;
+    seq->until = 0;
+    return seq;
+}
+
+/* Make a sequence of the ints from <from> up to (not including) <to>. */
+ASeq *seq_range(long from, long to) {
+    ASeq *seq = seq_new(range_seq);
+    seq->from = from;
+    seq->to = to;
+    return seq;
+}
+
+/* Make a sequence that starts with <seed>, and then gets each element
+ * by applying <gen> to the one before, stopping before the first one
+ * that <pred> says no to (or yes to, if <until>). Takes over the
+ * references to <seed>, <pred> and <gen>. */
+ASeq *seq_iterate(AValue *seed, AValue *pred, AValue *gen, int until) {
+    ASeq *seq = seq_new(iterate_seq);
+    seq->seed = seed;
+    seq->pred = pred;
+    seq->block = gen;
+    seq->until = until;
+    return seq;
+}
+
+/* Is <block> proven (by the type pass) to do nothing but change the
+ * stack? Only those go into a map or filter over a sequence, since
+ * they get run whenever (and however often) the sequence is gone
+ * through, in order from first to last -- or not at all, if nothing
+ * asks for that element. */
+int seq_block_ok(AValue *block) {
+    ACode *code = NULL;
+    if (val_type(block) == block_val) {
+        code = block->data.ast->code;
+    } else if (val_type(block) == bound_block_val && block->data.uf->words != NULL) {
+        code = block->data.uf->words->code;
+    }
+    return code != NULL && code->typed && code->effect.pure;
+}
+
+/* Make a sequence of the results of applying <block> to each element
+ * of the sequence <source>. Takes over both references. */
+ASeq *seq_map(AValue *source, AValue *block) {
+    ASeq *seq = seq_new(map_seq);
+    seq->source = source;
+    seq->block = block;
+    return seq;
+}
+
+/* Make a sequence of the elements of the sequence <source> that
+ * <block> gives a truthy value for. Takes over both references. */
+ASeq *seq_filter(AValue *source, AValue *block) {
+    ASeq *seq = seq_new(filter_seq);
+    seq->source = source;
+    seq->block = block;
+    return seq;
+}
+
+/* Start going through a sequence. Any blocks it needs to run get run
+ * on <stack>, which is left as it was found in between elements. */
+ASeqIter *seq_iter_new(ASeq *seq, AStack *stack) {
+    ASeqIter *it = malloc(sizeof(ASeqIter));
+    it->seq = seq;
+    it->next = seq->from;
+    it->current = (seq->kind == iterate_seq) ? ref(seq->seed) : NULL;
+    it->source = (seq->source != NULL)
+        ? seq_iter_new(seq->source->data.seq, stack)
+        : NULL;
+    it->stack = stack;
+    return it;
+}
+
+/* Apply <block> to <val> (using up the reference to it),
+ * and return the result. */
+/* (The block doesn't need the var-buffer it was given in: a bound
+ * block brings its own, and a constant one only uses variables it
+ * binds itself. So sequences don't hold on to var-buffers.) */
+static
+AValue *run_on(ASeqIter *it, AValue *block, AValue *val) {
+    stack_push(it->stack, val);
+    eval_block(it->stack, NULL, block);
+    return stack_pop_owned(it->stack);
+}
+
+/* Apply <block> to <val> (not using up the reference to
+ * it), and return whether the result was truthy. */
+static
+int test_on(ASeqIter *it, AValue *block, AValue *val) {
+    AValue *cond = run_on(it, block, ref(val));
+    int truthy = (val_get_int(cond) != 0);
+    delete_ref(cond);
+    return truthy;
+}
+
+/* Get the next element of a sequence (as a new reference),
+ * or NULL if there aren't any more. */
+AValue *seq_iter_next(ASeqIter *it) {
+    ASeq *seq = it->seq;
+    AValue *val;
+    switch (seq->kind) {
+        case range_seq:
+            if (it->next >= seq->to) return NULL;
+            return ref(val_int(it->next ++));
+        case iterate_seq:
+            val = it->current;
+            if (val == NULL) return NULL;
+            if (test_on(it, seq->pred, val) == seq->until) {
+                delete_ref(val);
+                it->current = NULL;
+                return NULL;
+            }
+            it->current = run_on(it, seq->block, ref(val));
+            return val;
+        case map_seq:
+            val = seq_iter_next(it->source);
+            if (val == NULL) return NULL;
+            return run_on(it, seq->block, val);
+        case filter_seq:
+            while ((val = seq_iter_next(it->source)) != NULL) {
+                if (test_on(it, seq->block, val)) return val;
+                delete_ref(val);
+            }
+            return NULL;
+    }
+    return NULL;
+}
+
+/* Finish going through a sequence. */
+void free_seq_iter(ASeqIter *it) {
+    if (it->source != NULL) free_seq_iter(it->source);
+    if (it->current != NULL) delete_ref(it->current);
+    free(it);
+}
+
+/* Count the elements of a sequence. (Ranges, and maps over them,
+ * know their length without going through them.) */
+long seq_length(ASeq *seq, AStack *stack) {
+    if (seq->kind == range_seq) {
+        return (seq->to > seq->from) ? seq->to - seq->from : 0;
+    } else if (seq->kind == map_seq) {
+        return seq_length(seq->source->data.seq, stack);
+    }
+    long count = 0;
+    ASeqIter *it = seq_iter_new(seq, stack);
+    AValue *val;
+    while ((val = seq_iter_next(it)) != NULL) {
+        count ++;
+        delete_ref(val);
+    }
+    free_seq_iter(it);
+    return count;
+}
+
+/* Work out all the elements of a sequence, and put them in a list. */
+AList *seq_force(ASeq *seq, AStack *stack) {
+    AList *list = list_new();
+    ASeqIter *it = seq_iter_new(seq, stack);
+    AValue *val;
+    while ((val = seq_iter_next(it)) != NULL) {
+        list_append(list, val);
+    }
+    free_seq_iter(it);
+    return list;
+}
+
+/* Print out a sequence (as the list it would turn into). */
+void fprint_seq(FILE *out, ASeq *seq) {
+    /* there's no stack to hand, so any blocks get a scratch one */
+    AStack *tmp = stack_new(4);
+    ASeqIter *it = seq_iter_new(seq, tmp);
+    AValue *val = seq_iter_next(it);
+    fprintf(out, "{ ");
+    while (val != NULL) {
+        fprint_val(out, val);
+        delete_ref(val);
+        val = seq_iter_next(it);
+        fprintf(out, (val != NULL) ? ", " : " ");
+    }
+    fprintf(out, "}");
+    free_seq_iter(it);
+    free_stack(tmp);
+}
+
+/* Free a sequence. */
+void free_seq(ASeq *seq) {
+    if (seq->seed != NULL) delete_ref(seq->seed);
+    if (seq->block != NULL) delete_ref(seq->block);
+    if (seq->pred != NULL) delete_ref(seq->pred);
+    if (seq->source != NULL) delete_ref(seq->source);
+    free(seq);
+}
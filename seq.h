@@ -0,0 +1,58 @@
+#ifndef _AL_SEQ_H__
+#define _AL_SEQ_H__
+
+#include "alma.h"
+#include "value.h"
+#include "list.h"
+#include "stack.h"
+#include "eval.h"
+
+/* Make a sequence of the ints from <from> up to (not including) <to>. */
+ASeq *seq_range(long from, long to);
+
+/* Make a sequence that starts with <seed>, and then gets each element
+ * by applying <gen> to the one before, stopping before the first one
+ * that <pred> says no to (or yes to, if <until>). Takes over the
+ * references to <seed>, <pred> and <gen>. */
+ASeq *seq_iterate(AValue *seed, AValue *pred, AValue *gen, int until);
+
+/* Is <block> proven (by the type pass) to do nothing but change the
+ * stack? Only those go into a map or filter over a sequence, since
+ * they get run whenever (and however often) the sequence is gone
+ * through, in order from first to last -- or not at all, if nothing
+ * asks for that element. */
+int seq_block_ok(AValue *block);
+
+/* Make a sequence of the results of applying <block> to each element
+ * of the sequence <source>. Takes over both references. */
+ASeq *seq_map(AValue *source, AValue *block);
+
+/* Make a sequence of the elements of the sequence <source> that
+ * <block> gives a truthy value for. Takes over both references. */
+ASeq *seq_filter(AValue *source, AValue *block);
+
+/* Start going through a sequence. Any blocks it needs to run get run
+ * on <stack>, which is left as it was found in between elements. */
+ASeqIter *seq_iter_new(ASeq *seq, AStack *stack);
+
+/* Get the next element of a sequence (as a new reference),
+ * or NULL if there aren't any more. */
+AValue *seq_iter_next(ASeqIter *it);
+
+/* Finish going through a sequence. */
+void free_seq_iter(ASeqIter *it);
+
+/* Count the elements of a sequence. (Ranges, and maps over them,
+ * know their length without going through them.) */
+long seq_length(ASeq *seq, AStack *stack);
+
+/* Work out all the elements of a sequence, and put them in a list. */
+AList *seq_force(ASeq *seq, AStack *stack);
+
+/* Print out a sequence (as the list it would turn into). */
+void fprint_seq(FILE *out, ASeq *seq);
+
+/* Free a sequence. */
+void free_seq(ASeq *seq);
+
+#endif
@@ -22,7 +22,9 @@ AValue *stack_get(AStack *st, int n) {
 }
 
 /* Peek at the value on the stack, but don't get a fresh reference to it.
- * (Useful in the unit tests where we want to check the stack has a certain value) */
+ * The stack still owns it, so it's only good until it gets popped.
+ * (Built-ins that leave their arguments where they are use this, as
+ * do the unit tests when checking the stack has a certain value.) */
 AValue *stack_peek(AStack *st, int n) {
     if (n >= st->size) {
         fprintf(stderr, "Error: attempt to access too many elements from stack\n"
@@ -32,16 +34,48 @@ AValue *stack_peek(AStack *st, int n) {
     return st->content[st->size - 1 - n];
 }
 
+/* Take the top value off the stack, along with the stack's reference
+ * to it, so the refcount doesn't change. The caller owns it after.
+ * Built-ins get their arguments this way rather than with stack_get
+ * and stack_pop, which would bump the refcount up just to bring it
+ * back down: a value only the stack had still has refs == 1 once
+ * it's taken off, so the checks for reusing a list in place see
+ * the same thing they would have. */
+AValue *stack_pop_owned(AStack *st) {
+    if (st->size == 0) {
+        fprintf(stderr, "Error: attempt to access too many elements from stack\n"
+                        "(element accessed: #0; stack size: 0)\n");
+        return NULL;
+    }
+    return st->content[-- st->size];
+}
+
+/* Double the stack's capacity until it can hold <needed> values. */
+static
+void stack_grow(AStack *st, int needed) {
+    int new_capacity = st->capacity ? st->capacity : 1;
+    while (new_capacity < needed) new_capacity *= 2;
+    AValue **new_array = realloc(st->content, new_capacity * sizeof(AValue*));
+    if (new_array == NULL) {
+        fprintf(stderr, "Error: couldn't grow stack from size %d to %d. Out of memory.",
+                st->capacity, new_capacity);
+    }
+    st->content = new_array;
+    st->capacity = new_capacity;
+}
+
+/* Make sure there's room for <n> more values on the stack, so
+ * pushing them won't have to grow it. The interpreter does this
+ * once when it starts running code whose stack effect is known,
+ * rather than checking on every push. */
+void stack_reserve(AStack *st, unsigned int n) {
+    if (st->size + (int)n > st->capacity) stack_grow(st, st->size + (int)n);
+}
+
 /* Push something onto the stack. Doesn't affect refcounter. */
 void stack_push(AStack *st, AValue *v) {
     if (st->size == st->capacity) {
-        AValue **new_array = realloc(st->content, st->capacity * 2 * sizeof(AValue*));
-        if (new_array == NULL) {
-            fprintf(stderr, "Error: couldn't grow stack from size %d to %d. Out of memory.",
-                    st->capacity, st->capacity * 2);
-        }
-        st->content = new_array;
-        st->capacity *= 2;
+        stack_grow(st, st->size + 1);
     }
     st->content[st->size] = v;
     st->size ++;
@@ -11,9 +11,17 @@ AStack *stack_new(size_t initial_size);
 AValue *stack_get(AStack *st, int n);
 
 /* Peek at the value on the stack, but don't get a fresh reference to it.
- * (Useful in the unit tests) */
+ * The stack still owns it, so it's only good until it gets popped. */
 AValue *stack_peek(AStack *st, int n);
 
+/* Take the top value off the stack, along with the stack's reference
+ * to it, so the refcount doesn't change. The caller owns it after. */
+AValue *stack_pop_owned(AStack *st);
+
+/* Make sure there's room for <n> more values on the stack, so
+ * pushing them won't have to grow it. */
+void stack_reserve(AStack *st, unsigned int n);
+
 /* Push something onto the stack. */
 void stack_push(AStack *st, AValue *v);
 
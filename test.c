@@ -1,5 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
 #include <check.h>
 #include "alma.h"
 #include "ast.h"
@@ -10,6 +13,9 @@
 #include "parse.h"
 #include "compile.h"
 #include "registry.h"
+#include "alloc.h"
+#include "cache.h"
+#include "profile.h"
 
 #define ALMATESTINTRO(filename) \
     printf("-- %s --\n", filename); \
@@ -22,7 +28,7 @@
     AFuncRegistry *reg = registry_new(20); \
     program = parse_file(in, &symtab); \
     lib_init(&symtab, lib_scope, 0); \
-    ABindInfo bi = {0,0};
+    ABindInfo bi = {0,0,0};
 
 #define ALMATESTCLEAN() \
     free_stack(stack); \
@@ -39,6 +45,16 @@ int ustr_check(AUstr *ustr, const char *test) {
     return result;
 }
 
+/* Print <program> into <buf> (of <size> bytes), for comparing. */
+void decl_seq_text(ADeclSeqNode *program, char *buf, size_t size) {
+    FILE *out = tmpfile();
+    fprint_decl_seq(out, program);
+    rewind(out);
+    size_t n = fread(buf, 1, size - 1, out);
+    buf[n] = '\0';
+    fclose(out);
+}
+
 START_TEST(test_stack_push) {
     ALMATESTINTRO("tests/simplepush.alma");
 
@@ -52,16 +68,16 @@ START_TEST(test_stack_push) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 5);
-    ck_assert(stack_peek(stack, 0)->type == str_val);
+    ck_assert(val_type(stack_peek(stack, 0)) == str_val);
     ck_assert(ustr_check(stack_peek(stack, 0)->data.str, "hello world"));
-    ck_assert(stack_peek(stack, 1)->type == int_val);
-    ck_assert(stack_peek(stack, 1)->data.i == 1);
-    ck_assert(stack_peek(stack, 2)->type == int_val);
-    ck_assert(stack_peek(stack, 2)->data.i == 2);
-    ck_assert(stack_peek(stack, 3)->type == int_val);
-    ck_assert(stack_peek(stack, 3)->data.i == 3);
-    ck_assert(stack_peek(stack, 4)->type == int_val);
-    ck_assert(stack_peek(stack, 4)->data.i == 4);
+    ck_assert(val_type(stack_peek(stack, 1)) == int_val);
+    ck_assert(val_get_int(stack_peek(stack, 1)) == 1);
+    ck_assert(val_type(stack_peek(stack, 2)) == int_val);
+    ck_assert(val_get_int(stack_peek(stack, 2)) == 2);
+    ck_assert(val_type(stack_peek(stack, 3)) == int_val);
+    ck_assert(val_get_int(stack_peek(stack, 3)) == 3);
+    ck_assert(val_type(stack_peek(stack, 4)) == int_val);
+    ck_assert(val_get_int(stack_peek(stack, 4)) == 4);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -94,7 +110,7 @@ START_TEST(test_addition) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 9);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 9);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -110,7 +126,7 @@ START_TEST(test_apply) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 9);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 9);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -151,10 +167,10 @@ START_TEST(test_basiclist) {
 
     /* jeez that's a lot of pointers huh */
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->type, list_val);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->val->data.i, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->val->data.i, 3);
+    ck_assert_int_eq(val_type(stack_peek(stack, 0)), list_val);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 1);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 1)), 2);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 2)), 3);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -169,8 +185,8 @@ START_TEST(test_emptylist) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->type, list_val);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 1);
+    ck_assert_int_eq(val_type(stack_peek(stack, 0)), list_val);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 1);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -185,10 +201,10 @@ START_TEST(test_uncons) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->val->data.i, 3);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->val->data.i, 4);
-    ck_assert_int_eq(stack_peek(stack, 1)->data.i, 1);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 2);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 1)), 3);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 2)), 4);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 1);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -203,9 +219,9 @@ START_TEST(test_chimera) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->val->data.i, 5);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->val->data.i, 6);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 1);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 1)), 5);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 2)), 6);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -220,12 +236,12 @@ START_TEST(test_concat) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->val->data.i, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->val->data.i, 3);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->next->val->data.i, 4);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->next->next->val->data.i, 5);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->next->next->next->val->data.i, 6);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 1);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 1)), 2);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 2)), 3);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 3)), 4);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 4)), 5);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 5)), 6);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -240,7 +256,7 @@ START_TEST(test_stackshuffle) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 36);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 36);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -257,10 +273,10 @@ START_TEST(test_listwarn) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->type, list_val);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->val->data.i, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->val->data.i, 3);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.list->first->next->next->val->data.i, 4);
+    ck_assert_int_eq(val_type(stack_peek(stack, 0)), list_val);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 0)), 2);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 1)), 3);
+    ck_assert_int_eq(val_get_int(list_get(stack_peek(stack, 0)->data.list, 2)), 4);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -273,7 +289,7 @@ START_TEST(test_definition) {
     eval_sequence(stack, NULL, program->first->data.func->node);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 24);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 24);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -287,7 +303,7 @@ START_TEST(test_let) {
     eval_sequence(stack, NULL, program->first->data.func->node);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 12);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 12);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -301,7 +317,7 @@ START_TEST(test_2let) {
     eval_sequence(stack, NULL, program->first->data.func->node);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 18);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 18);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -319,7 +335,7 @@ START_TEST(test_bind) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 12);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 12);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -337,7 +353,7 @@ START_TEST(test_blockparam) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 9);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 9);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -355,7 +371,7 @@ START_TEST(test_boundblock) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 3);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -373,8 +389,8 @@ START_TEST(test_2bind) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 20);
-    ck_assert_int_eq(stack_peek(stack, 1)->data.i, 24);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 20);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 24);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -392,8 +408,8 @@ START_TEST(test_funcargs) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 2);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 30);
-    ck_assert_int_eq(stack_peek(stack, 1)->data.i, 9);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 30);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 9);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -411,10 +427,10 @@ START_TEST(test_closure) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 4);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 50);
-    ck_assert_int_eq(stack_peek(stack, 1)->data.i, 42);
-    ck_assert_int_eq(stack_peek(stack, 2)->data.i, 15);
-    ck_assert_int_eq(stack_peek(stack, 3)->data.i, 30);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 50);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 42);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 15);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 3)), 30);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -432,7 +448,7 @@ START_TEST(test_multibuf) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 12);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 12);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -450,7 +466,7 @@ START_TEST(test_namedclosure) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 5);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 5);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -466,7 +482,428 @@ START_TEST(test_freevarafter) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 2);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_varaccess) {
+    ALMATESTINTRO("tests/varaccess.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 6);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 43);
+
+    AValue *block = stack_peek(stack, 0);
+    ck_assert_int_eq(val_type(block), bound_block_val);
+#ifndef ALMA_CHAINED_CLOSURES
+    /* it only copied the two vars it uses, not the whole chain */
+    ck_assert(block->data.uf->closure->parent == NULL);
+    ck_assert_int_eq(block->data.uf->closure->size, 2);
+#endif
+    eval_block(stack, NULL, block);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 4);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_localbind) {
+    ALMATESTINTRO("tests/localbind.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* only the last bind has to get its var-buffer from the heap */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    AOpcode binds[3];
+    int nbinds = 0;
+    for (unsigned int i = 0; i < code->length; i++) {
+        AOpcode op = code->instrs[i].op;
+        if (op == op_bind || op == op_bind_local) binds[nbinds++] = op;
+    }
+    ck_assert_int_eq(nbinds, 3);
+    ck_assert_int_eq(binds[0], op_bind_local);
+#ifndef ALMA_CHAINED_CLOSURES
+    ck_assert_int_eq(binds[1], op_bind_local);
+#endif
+    ck_assert_int_eq(binds[2], op_bind);
+
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 16);
+    eval_block(stack, NULL, stack_peek(stack, 1));
+    AValue *four = stack_get(stack, 0);
+    ck_assert_int_eq(val_get_int(four), 4);
+    stack_pop(stack, 1);
+    delete_ref(four);
+    eval_block(stack, NULL, stack_peek(stack, 0));
+    AValue *list = stack_peek(stack, 0);
+    ck_assert_int_eq(val_type(list), list_val);
+    ck_assert_int_eq(val_get_int(list_get(list->data.list, 0)), 2);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_inline) {
+    ALMATESTINTRO("tests/inline.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+#if !defined(ALMA_INLINE_MAX) || ALMA_INLINE_MAX >= 2
+    /* incr and twice get copied in; big is too big */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    int calls = 0;
+    for (unsigned int i = 0; i < code->length; i++) {
+        if (code->instrs[i].op == op_call_user) {
+            ck_assert_str_eq(code->instrs[i].arg.func->sym->name, "big");
+            calls ++;
+        }
+    }
+    ck_assert_int_eq(calls, 1);
+#endif
+
+    eval_word(stack, NULL, mainfunc);
+    ck_assert_int_eq(stack->size, 1);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 22);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_constfold) {
+    ALMATESTINTRO("tests/constfold.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* the arithmetic is all done already (neg counts, once it's inlined) */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    ck_assert_int_eq(code->instrs[0].op, op_push_const);
+#if !defined(ALMA_INLINE_MAX) || ALMA_INLINE_MAX >= 2
+    ck_assert_int_eq(val_get_int(code->instrs[0].arg.val), -7);
+    ck_assert_int_eq(code->instrs[1].op, op_push_const);
+    ck_assert_int_eq(val_type(code->instrs[1].arg.val), list_val);
+#endif
+
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), -7);
+    AValue *added = stack_peek(stack, 1);
+    ck_assert_int_eq(added->data.list->length, 5);
+    AValue *again = stack_peek(stack, 0);
+    ck_assert_int_eq(again->data.list->length, 4);
+    ck_assert_int_eq(val_get_int(list_get(again->data.list, 0)), 1);
+    ck_assert_int_eq(val_get_int(list_get(again->data.list, 1)), 5);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_types) {
+    ALMATESTINTRO("tests/types.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* the arithmetic on a gets the int-only instructions */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    ck_assert_int_eq(code->instrs[4].op, op_add_int);
+    ck_assert_int_eq(code->instrs[6].op, op_mul_int);
+    ck_assert_int_eq(code->instrs[11].op, op_add_int);
+
+    /* ( -- int string int ) */
+    ck_assert(code->typed);
+    ck_assert(code->effect.known);
+    ck_assert_int_eq(code->effect.in, 0);
+    ck_assert_int_eq(code->effect.out, 3);
+    ck_assert_int_eq(code->effect.gives[0].type, TYPE_OF(int_val));
+    ck_assert_int_eq(code->effect.gives[1].type, TYPE_OF(str_val));
+    ck_assert_int_eq(code->effect.gives[2].type, TYPE_OF(int_val));
+
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 30);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_symequal) {
+    ALMATESTINTRO("tests/symequal.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* (which mustn't get the int-only instruction) */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    for (unsigned int i = 0; i < code->length; i++) {
+        ck_assert(code_base_op(code->instrs[i].op) != op_eq_int);
+    }
+
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 1);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 0);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_typeerror) {
+    ALMATESTINTRO("tests/typeerror.alma");
+
+    printf("The next thing printed should be a type error.\n");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    /* half needs an int, and it's getting a string. */
+    ck_assert_int_eq(stat, compile_fail);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_super) {
+    ALMATESTINTRO("tests/super.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+#if !defined(ALMA_NGRAMS) && !defined(ALMA_NO_SUPERINSTRUCTIONS)
+    /* each pair gets fused, leaving its second half where it was */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    ck_assert_int_eq(code->instrs[3].op, op_add_const);
+    ck_assert_int_eq(code->instrs[6].op, op_eq_const);
+    ck_assert_int_eq(code->instrs[11].op, op_swap_call);
+    ck_assert_int_eq(code->instrs[12].op, op_call_prim);
+    ck_assert_int_eq(code->instrs[14].op, op_dup_call);
+    ck_assert_int_eq(code->instrs[20].op, op_dip2);
+    ck_assert_int_eq(code->instrs[21].op, op_dip);
+#endif
+
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 9);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 8)), 6);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 7)), 0);
+    AList *consed = stack_peek(stack, 6)->data.list;
+    ck_assert_int_eq(consed->length, 2);
+    ck_assert_int_eq(val_get_int(list_get(consed, 0)), 2);
+    ck_assert_int_eq(stack_peek(stack, 5)->data.list->length, 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 4)), 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 3)), 11);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 3);
+    /* (too big to fit in the pointer) */
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 4611686018427387904L);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_tos) {
+    ALMATESTINTRO("tests/tos.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* the shuffles are done by the interpreter itself */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    ck_assert_int_eq(code->instrs[1].op, op_dup);
+    ck_assert_int_eq(code->instrs[2].op, op_drop);
+    ck_assert_int_eq(code->instrs[4].op, op_over);
+
+    eval_word(stack, NULL, mainfunc);
+
+    /* and whatever was on top still ends up on the stack */
+    ck_assert_int_eq(stack->size, 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 7);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 6);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 5);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_reserve) {
+    ALMATESTINTRO("tests/reserve.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+
+    /* it's known to go 31 values up... */
+    ACode *code = mainfunc->data.userfunc->words->code;
+    ck_assert(code->effect.known);
+    ck_assert_int_eq(code->effect.in, 0);
+    ck_assert_int_eq(code->effect.max, 31);
+
+    /* ...so room gets made for them all at once, past the 20 the
+     * stack started with, and none of the pushes have to check */
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 31);
+    ck_assert(stack->capacity >= 31);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 30)), 1);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_cache) {
+    ALMATESTINTRO("tests/cache.alma");
+
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/alma-cache-test-%ld", (long)getpid());
+    setenv("ALMA_CACHE", dir, 1);
+
+    /* save the parse, then get it back... */
+    uint64_t hash = cache_source_hash(in);
+    ck_assert(hash != 0);
+    ck_assert(cache_save("tests/cache.alma", hash, program));
+    ADeclSeqNode *loaded = cache_load("tests/cache.alma", hash, &symtab);
+    ck_assert(loaded != NULL);
+
+    /* ...and it should be the same tree */
+    char orig_text[1024], loaded_text[1024];
+    decl_seq_text(program, orig_text, sizeof(orig_text));
+    decl_seq_text(loaded, loaded_text, sizeof(loaded_text));
+    ck_assert_str_eq(orig_text, loaded_text);
+
+    /* which still runs */
+    ACompileStatus stat = compile(scope, &symtab, reg, loaded, bi);
+    ck_assert_int_eq(stat, compile_success);
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    eval_word(stack, NULL, mainfunc);
+    ck_assert_int_eq(stack->size, 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 5);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 4);
+
+    free_decl_seq_top(loaded);
+
+    /* a change that keeps the size (and, this quickly, the mtime)
+     * still has to be noticed */
+    char fixture[96], text[1024];
+    snprintf(fixture, sizeof(fixture), "%s/same-size.alma", dir);
+    const char *versions[] = { "def main ( 1 say )\n", "def main ( 2 say )\n" };
+    for (int i = 0; i < 2; i++) {
+        FILE *src = fopen(fixture, "w");
+        fputs(versions[i], src);
+        fclose(src);
+        src = fopen(fixture, "r");
+        ADeclSeqNode *parsed = parse_file_cached(fixture, src, &symtab, NULL);
+        fclose(src);
+        ck_assert(parsed != NULL);
+        decl_seq_text(parsed, text, sizeof(text));
+        ck_assert(strstr(text, i ? "2" : "1") != NULL);
+        ck_assert(strstr(text, i ? "1" : "2") == NULL);
+        free_decl_seq_top(parsed);
+    }
+
+    /* clean up after ourselves */
+    DIR *cachedir = opendir(dir);
+    ck_assert(cachedir != NULL);
+    struct dirent *entry;
+    char entry_path[512];
+    while ((entry = readdir(cachedir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", dir, entry->d_name);
+        unlink(entry_path);
+    }
+    closedir(cachedir);
+    ck_assert_int_eq(rmdir(dir), 0);
+
+    unsetenv("ALMA_CACHE");
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_profile) {
+    ALMATESTINTRO("tests/profile.alma");
+
+    /* (before compiling, so that nothing gets inlined) */
+    profile_start();
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    eval_word(stack, NULL, mainfunc);
+    profiling = 0;
+
+    /* every call is counted, under the word's name, and each block is
+     * told apart by where it is in its word */
+    char text[2048];
+    FILE *out = tmpfile();
+    fprint_profile(out, 1);
+    rewind(out);
+    text[fread(text, 1, sizeof(text) - 1, out)] = '\0';
+    fclose(out);
+    ck_assert(strstr(text, "{\"name\": \"main\", \"block\": false, \"line\": 7, \"calls\": 1,") != NULL);
+    ck_assert(strstr(text, "{\"name\": \"down\", \"block\": false, \"line\": 2, \"calls\": ") != NULL);
+    ck_assert(strstr(text, "{\"name\": \"sq\", \"block\": false, \"line\": 5, \"calls\": 1,") != NULL);
+    ck_assert(strstr(text, "\"in\": \"down\", \"index\": 1, \"line\": 2, \"calls\": 6,") != NULL);
+    ck_assert(strstr(text, "\"in\": \"down\", \"index\": 2, \"line\": 2, \"calls\": 1,") != NULL);
+    ck_assert(strstr(text, "\"in\": \"down\", \"index\": 3, \"line\": 2, \"calls\": 5,") != NULL);
+
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_sample) {
+    ALMATESTINTRO("tests/sample.alma");
+
+    /* (before compiling, so that spin doesn't get inlined into main) */
+    ck_assert(profile_start_sampling());
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    eval_word(stack, NULL, mainfunc);
+    profiling = 0;
+
+    /* it should have been caught in spin's loop at least once, and
+     * every line is the calls, outermost first, and a count */
+    char text[4096];
+    FILE *out = tmpfile();
+    fprint_folded(out);
+    rewind(out);
+    text[fread(text, 1, sizeof(text) - 1, out)] = '\0';
+    fclose(out);
+    ck_assert(strstr(text, "spin;[block ") != NULL);
+    ck_assert(strstr(text, " in spin at line 2]") != NULL);
+    unsigned long total = 0;
+    for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        char *count = strrchr(line, ' ');
+        ck_assert(count != NULL);
+        total += strtoul(count + 1, NULL, 10);
+    }
+    ck_assert(total > 0);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -484,7 +921,7 @@ START_TEST(test_doubleclosure) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 10);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 10);
 
     ALMATESTCLEAN();
 } END_TEST
@@ -522,7 +959,7 @@ START_TEST(test_funcshadow) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 10);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 10);
     ALMATESTCLEAN();
 } END_TEST
 
@@ -539,10 +976,393 @@ START_TEST(test_varshadow) {
     eval_word(stack, NULL, mainfunc);
 
     ck_assert_int_eq(stack->size, 1);
-    ck_assert_int_eq(stack_peek(stack, 0)->data.i, 5);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 5);
     ALMATESTCLEAN();
 } END_TEST
 
+START_TEST(test_deeprecursion) {
+    ALMATESTINTRO("tests/deeprecursion.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 0);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 5000050000);
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_listfuncs) {
+    ALMATESTINTRO("tests/listfuncs.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+    printf("The next two things printed should be error messages.\n");
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 7);
+    AList *mapped = stack_peek(stack, 6)->data.list;
+    ck_assert_int_eq(mapped->length, 4);
+    ck_assert_int_eq(val_get_int(list_get(mapped, 0)), 2);
+    ck_assert_int_eq(val_get_int(list_get(mapped, 3)), 8);
+    AList *filtered = stack_peek(stack, 5)->data.list;
+    ck_assert_int_eq(filtered->length, 3);
+    ck_assert_int_eq(val_get_int(list_get(filtered, 0)), 1);
+    ck_assert_int_eq(val_get_int(list_get(filtered, 1)), 3);
+    ck_assert_int_eq(val_get_int(list_get(filtered, 2)), 5);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 4)), 4);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 3)), 10);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), 24);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 0);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_vectors) {
+    ALMATESTINTRO("tests/vectors.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 6);
+    AList *mapped = stack_peek(stack, 5)->data.list;
+    ck_assert_int_eq(mapped->length, 6);
+    ck_assert(list_all_ints(mapped));
+    ck_assert_int_eq(val_get_int(list_get(mapped, 0)), -9);
+    ck_assert_int_eq(val_get_int(list_get(mapped, 5)), -4);
+    AList *small = stack_peek(stack, 4)->data.list;
+    ck_assert_int_eq(small->length, 3);
+    ck_assert_int_eq(val_get_int(list_get(small, 2)), 3);
+    AList *coprime = stack_peek(stack, 3)->data.list;
+    ck_assert_int_eq(coprime->length, 5);
+    ck_assert_int_eq(val_get_int(list_get(coprime, 3)), 13);
+    ck_assert_int_eq(val_get_int(list_get(coprime, 4)), 15);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 2)), -2);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 1)), 9);
+
+    /* too big for immediates, so it has to go the slow way */
+    AList *big = stack_peek(stack, 0)->data.list;
+    ck_assert_int_eq(big->length, 3);
+    ck_assert(!list_all_ints(big));
+    ck_assert(val_get_int(list_get(big, 2)) == 3 * (1L << 61));
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_lazy) {
+    ALMATESTINTRO("tests/lazy.alma");
+
+    ACompileStatus stat = compile(scope, &symtab, reg, program, bi);
+    ck_assert_int_eq(stat, compile_success);
+
+    AFunc *mainfunc = scope_find_func(scope, symtab, "main");
+    ck_assert(mainfunc != NULL);
+    eval_word(stack, NULL, mainfunc);
+
+    ck_assert_int_eq(stack->size, 6);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 5)), 3);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 4)), 500000);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 3)), 55);
+
+    /* nothing's asked for the range's elements, so it's still lazy */
+    AValue *range = stack_peek(stack, 2);
+    ck_assert_int_eq(val_type(range), seq_val);
+    ck_assert_int_eq(seq_length(range->data.seq, stack), 4);
+
+    AValue *forced = stack_peek(stack, 1);
+    ck_assert_int_eq(val_type(forced), list_val);
+    ck_assert_int_eq(forced->data.list->length, 3);
+    ck_assert_int_eq(val_get_int(list_get(forced->data.list, 0)), 16);
+    ck_assert_int_eq(val_get_int(list_get(forced->data.list, 2)), 64);
+
+    /* a block that prints can't be put off, so that one's done now */
+    AValue *printed = stack_peek(stack, 0);
+    ck_assert_int_eq(val_type(printed), list_val);
+    ck_assert_int_eq(printed->data.list->length, 4);
+    ck_assert_int_eq(val_get_int(list_get(printed->data.list, 3)), 3);
+    ALMATESTCLEAN();
+} END_TEST
+
+START_TEST(test_immediates) {
+    AValue *small = val_int(-42);
+    ck_assert(val_is_immediate(small));
+    ck_assert_int_eq(val_type(small), int_val);
+    ck_assert_int_eq(val_get_int(small), -42);
+
+    /* too big to fit in the pointer, so it gets boxed */
+    AValue *big = ref(val_int(LONG_MAX));
+    ck_assert(!val_is_immediate(big));
+    ck_assert_int_eq(val_type(big), int_val);
+    ck_assert(val_get_int(big) == LONG_MAX);
+    delete_ref(big);
+
+    AValue *fl = val_float(2.5);
+    ck_assert_int_eq(val_type(fl), float_val);
+    ck_assert(val_get_float(fl) == 2.5);
+
+    ASymbolTable symtab = NULL;
+    ASymbol *sym = get_symbol(&symtab, "hello");
+    AValue *symval = val_sym(sym);
+    ck_assert_int_eq(val_type(symval), sym_val);
+    ck_assert(val_get_sym(symval) == sym);
+    free_symbol_table(&symtab);
+} END_TEST
+
+START_TEST(test_nonintops) {
+    ASymbolTable symtab = NULL;
+    AValue *foo = val_sym(get_symbol(&symtab, "foo"));
+    AValue *bar = val_sym(get_symbol(&symtab, "bar"));
+    AStack *stack = stack_new(4);
+
+    /* = and != go by the value, whatever its type */
+    stack_push(stack, val_float(1.5));
+    stack_push(stack, val_float(1.5));
+    lib_equal(stack, NULL);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+    stack_push(stack, foo);
+    stack_push(stack, foo);
+    lib_equal(stack, NULL);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+    stack_push(stack, foo);
+    stack_push(stack, bar);
+    lib_notequal(stack, NULL);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 1);
+    stack_push(stack, val_float(2.5));
+    stack_push(stack, val_int(2));
+    lib_equal(stack, NULL);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 0);
+    ck_assert_int_eq(stack->size, 4);
+    stack_pop(stack, 4);
+
+    /* the others only take ints, and leave 0 in place of the answer */
+    stack_push(stack, val_float(2.5));
+    stack_push(stack, val_int(1));
+    lib_add(stack, NULL);
+    ck_assert_int_eq(stack->size, 1);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 0);
+    stack_push(stack, foo);
+    lib_lessthan(stack, NULL);
+    ck_assert_int_eq(stack->size, 1);
+    ck_assert_int_eq(val_get_int(stack_peek(stack, 0)), 0);
+    stack_push(stack, val_float(1.5));
+    lib_not(stack, NULL);
+    ck_assert_int_eq(stack->size, 2);
+    ck_assert_int_eq(val_type(stack_peek(stack, 0)), int_val);
+
+    free_stack(stack);
+    free_symbol_table(&symtab);
+} END_TEST
+
+START_TEST(test_pool) {
+    APool pool = { "test", 24, 0, NULL, NULL, 0, 0, 0, 0 };
+
+    void *a = pool_alloc(&pool);
+    void *b = pool_alloc(&pool);
+    ck_assert(a != NULL && b != NULL && a != b);
+    ck_assert_int_eq(pool.live, 2);
+
+    /* freed objects get reused straight away */
+    pool_free(&pool, a);
+    ck_assert_int_eq(pool.live, 1);
+    void *c = pool_alloc(&pool);
+#ifndef ALMA_NO_POOL
+    ck_assert(c == a);
+#endif
+
+    ck_assert_int_eq(pool.live, 2);
+    ck_assert_int_eq(pool.peak, 2);
+    ck_assert_int_eq(pool.allocs, 3);
+} END_TEST
+
+START_TEST(test_listdeque) {
+    AValue *lv = ref(val_list(list_new()));
+
+    /* build { -99 ... -1 0 1 ... 99 } from the middle outwards */
+    for (long i = 0; i < 100; i++) {
+        list_append(lv->data.list, val_int(i));
+        if (i > 0) list_cons(val_int(-i), lv->data.list);
+    }
+    ck_assert_int_eq(lv->data.list->length, 199);
+    for (long i = 0; i < 199; i++) {
+        ck_assert_int_eq(val_get_int(list_get(lv->data.list, i)), i - 99);
+    }
+
+    /* with only one reference, tail/init just trim the ends */
+    AValue *t = tail_list_val(lv);
+    ck_assert(t == lv);
+    delete_ref(t);
+    AValue *in = init_list_val(lv);
+    ck_assert(in == lv);
+    delete_ref(in);
+    ck_assert_int_eq(lv->data.list->length, 197);
+    ck_assert_int_eq(val_get_int(list_get(lv->data.list, 0)), -98);
+    ck_assert_int_eq(val_get_int(list_get(lv->data.list, 196)), 98);
+
+    /* but with two, they have to leave the original alone */
+    ref(lv);
+    AValue *c = cons_list_val(val_int(1000), lv);
+    ck_assert(c != lv);
+    ck_assert_int_eq(c->data.list->length, 198);
+    ck_assert_int_eq(val_get_int(list_get(c->data.list, 0)), 1000);
+    ck_assert_int_eq(lv->data.list->length, 197);
+
+    delete_ref(c);
+    delete_ref(lv);
+    delete_ref(lv);
+} END_TEST
+
+/* Find the line of <text> starting with <label>, and read the first
+ * two numbers after it. */
+void alloc_stats_line(const char *text, const char *label,
+                      unsigned long *a, unsigned long *b) {
+    const char *line = text;
+    while (strncmp(line, label, strlen(label)) != 0 || line[strlen(label)] != ' ') {
+        line = strchr(line, '\n');
+        ck_assert(line != NULL);
+        line ++;
+    }
+    ck_assert_int_eq(sscanf(line + strlen(label), "%lu %lu", a, b), 2);
+}
+
+START_TEST(test_allocstats) {
+    alloc_stats_start();
+    AInstruction site = { op_call_prim };
+    site.file = code_file_index("tests/where.alma");
+    site.linenum = 7;
+    alloc_site = &site;
+
+    /* a block that gets compiled in between being made and freed */
+    AValue *block = ref(val_block(ast_wordseq_new()));
+    block->type = block_val;
+    delete_ref(block);
+
+    AValue *lv = ref(val_list(list_new()));
+    for (long i = 0; i < 4; i++) {
+        list_append(lv->data.list, val_int(i));
+    }
+
+    /* one tail in place, then one that has to leave the original */
+    delete_ref(tail_list_val(lv));
+    ref(lv);
+    AValue *t = tail_list_val(lv);
+    delete_ref(t);
+    delete_ref(lv);
+    delete_ref(lv);
+    alloc_site = NULL;
+    alloc_stats = 0;
+
+    char text[4096];
+    FILE *out = tmpfile();
+    fprint_alloc_stats(out, 20);
+    rewind(out);
+    text[fread(text, 1, sizeof(text) - 1, out)] = '\0';
+    fclose(out);
+
+    unsigned long in_place, copied;
+    alloc_stats_line(text, "tail", &in_place, &copied);
+    ck_assert_int_eq(in_place, 1);
+    ck_assert_int_eq(copied, 1);
+
+    /* two list values (the second tail's is new), both freed... */
+    unsigned long allocs, frees;
+    alloc_stats_line(text, "list", &allocs, &frees);
+    ck_assert_int_eq(allocs, 2);
+    ck_assert_int_eq(frees, 2);
+
+    /* ...and put down to the file and line they were made on */
+    ck_assert(strstr(text, "     7  list ") != NULL);
+    ck_assert(strstr(text, "  tests/where.alma\n") != NULL);
+
+    /* the block's free counts against what it was made as */
+    alloc_stats_line(text, "proto block", &allocs, &frees);
+    ck_assert_int_eq(allocs, 1);
+    ck_assert_int_eq(frees, 1);
+    ck_assert(strstr(text, "\nblock ") == NULL);
+} END_TEST
+
+START_TEST(test_listshare) {
+    AValue *lv = ref(val_list(list_new()));
+    for (long i = 0; i < 10; i++) {
+        list_append(lv->data.list, val_int(i));
+    }
+    ref(lv); /* pretend it's been dup'd */
+
+    /* the tail of a shared list is just a window on the same storage */
+    AValue *t = tail_list_val(lv);
+    ck_assert(t != lv);
+    ck_assert(t->data.list->buf == lv->data.list->buf);
+    ck_assert_int_eq(t->data.list->length, 9);
+    ck_assert_int_eq(val_get_int(list_get(t->data.list, 0)), 1);
+
+    /* appending to the end of it can claim the next free slot */
+    AValue *a = append_list_val(lv, val_int(10));
+    ck_assert(a->data.list->buf == lv->data.list->buf);
+    ck_assert_int_eq(a->data.list->length, 11);
+    ck_assert_int_eq(lv->data.list->length, 10);
+
+    /* but then that slot's taken, so another append has to copy */
+    AValue *b = append_list_val(lv, val_int(20));
+    ck_assert(b->data.list->buf != lv->data.list->buf);
+    ck_assert_int_eq(val_get_int(list_get(a->data.list, 10)), 10);
+    ck_assert_int_eq(val_get_int(list_get(b->data.list, 10)), 20);
+    for (long i = 0; i < 10; i++) {
+        ck_assert_int_eq(val_get_int(list_get(b->data.list, i)), i);
+    }
+
+    delete_ref(b);
+    delete_ref(a);
+    delete_ref(t);
+    delete_ref(lv);
+    delete_ref(lv);
+} END_TEST
+
+START_TEST(test_stackowned) {
+    AStack *stack = stack_new(4);
+    AValue *lv = ref(val_list(list_new()));
+    for (long i = 0; i < 3; i++) {
+        list_append(lv->data.list, val_int(i));
+    }
+    stack_push(stack, lv);
+
+    /* taking it off the stack hands over the reference */
+    ck_assert(stack_pop_owned(stack) == lv);
+    ck_assert_int_eq(lv->refs, 1);
+    ck_assert_int_eq(stack->size, 0);
+    ck_assert(stack_pop_owned(stack) == NULL);
+
+    /* so a list only the stack had gets reused in place,
+     * the way the list built-ins do it */
+    AValue *t = tail_list_val(lv);
+    ck_assert(t == lv);
+    delete_ref(lv);
+    ck_assert_int_eq(lv->refs, 1);
+    ck_assert_int_eq(lv->data.list->length, 2);
+
+    /* but one that's been dup'd still gets copied */
+    stack_push(stack, lv);
+    lib_dup(stack, NULL);
+    ck_assert_int_eq(lv->refs, 2);
+    AValue *a = stack_pop_owned(stack);
+    t = tail_list_val(a);
+    ck_assert(t != lv);
+    delete_ref(a);
+    ck_assert_int_eq(lv->refs, 1);
+    ck_assert_int_eq(t->data.list->length, 1);
+    delete_ref(t);
+
+    free_stack(stack);
+} END_TEST
+
 Suite *simple_suite(void) {
     Suite *s;
     TCase *tc_core, *tc_comp, *tc_bind;
@@ -556,6 +1376,17 @@ Suite *simple_suite(void) {
     tcase_add_test(tc_core, test_stack_pop_print);
     tcase_add_test(tc_core, test_addition);
     tcase_add_test(tc_core, test_apply);
+    tcase_add_test(tc_core, test_deeprecursion);
+    tcase_add_test(tc_core, test_listfuncs);
+    tcase_add_test(tc_core, test_vectors);
+    tcase_add_test(tc_core, test_lazy);
+    tcase_add_test(tc_core, test_immediates);
+    tcase_add_test(tc_core, test_nonintops);
+    tcase_add_test(tc_core, test_pool);
+    tcase_add_test(tc_core, test_listdeque);
+    tcase_add_test(tc_core, test_listshare);
+    tcase_add_test(tc_core, test_allocstats);
+    tcase_add_test(tc_core, test_stackowned);
     tcase_add_test(tc_core, test_basiclist);
     tcase_add_test(tc_core, test_emptylist);
     tcase_add_test(tc_core, test_uncons);
@@ -591,7 +1422,20 @@ Suite *simple_suite(void) {
     tcase_add_test(tc_bind, test_multibuf);
     tcase_add_test(tc_bind, test_namedclosure);
     tcase_add_test(tc_bind, test_doubleclosure);
+    tcase_add_test(tc_bind, test_varaccess);
+    tcase_add_test(tc_bind, test_localbind);
+    tcase_add_test(tc_comp, test_inline);
+    tcase_add_test(tc_comp, test_constfold);
+    tcase_add_test(tc_comp, test_types);
+    tcase_add_test(tc_comp, test_symequal);
+    tcase_add_test(tc_comp, test_typeerror);
+    tcase_add_test(tc_comp, test_super);
+    tcase_add_test(tc_comp, test_tos);
+    tcase_add_test(tc_comp, test_reserve);
     tcase_add_test(tc_comp, test_freevarafter);
+    tcase_add_test(tc_comp, test_cache);
+    tcase_add_test(tc_comp, test_profile);
+    tcase_add_test(tc_comp, test_sample);
     suite_add_tcase(s, tc_bind);
 
     return s;
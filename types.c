@@ -0,0 +1,503 @@
+#include "types.h"
+
+/* This is a much simpler cousin of the unification-based checker the
+ * old interpreter had (see old/types.c). Instead of solving for type
+ * variables, it just follows the code from start to finish, keeping
+ * track of which kinds of value could be in each slot of the stack:
+ * constants and the results of built-ins are known, and anything from
+ * below where the code started is one of its inputs, which could be
+ * anything. Calls to words it's already been through, and blocks that
+ * are applied or branched on right where they're made, use the effects
+ * worked out for them. Anything else (a built-in that runs a block it
+ * can't see, say, or a word calling itself) makes it lose track, and
+ * the code's effect stays unknown -- but it starts tracking again from
+ * whatever gets pushed next. */
+
+/* How to describe one type in an error message. */
+static const char *type_names[] = {
+    "an int", "a float", "a string", "a symbol",
+    "a block", "a block", "a block", "a block",
+    "a list", "a list", "a sequence",
+};
+
+/* Same, but for printing out stack effects. */
+static const char *short_type_names[] = {
+    "int", "float", "string", "symbol",
+    "block", "block", "block", "block",
+    "list", "list", "seq",
+};
+
+#define TYPE_COUNT (sizeof(type_names) / sizeof(type_names[0]))
+
+/* The name of <type>, from <names>, if it's just one type (and <other>
+ * if it could be more than one). */
+static
+const char *type_name(AType type, const char **names, const char *other) {
+    for (unsigned int t = 0; t < TYPE_COUNT; t++) {
+        if (type == TYPE_OF(t)) return names[t];
+    }
+    return other;
+}
+
+/* What the built-ins the pass knows about do, Forth-style: bottom of
+ * the stack first. In <needs>, i means it has to be an int and * means
+ * anything goes. In <gives>, i, l and q are an int, a list and a lazy
+ * sequence, * is anything, and a digit is that input left as it was
+ * (0 being the top one). Built-ins that aren't here -- like while, or
+ * map, which run blocks the pass can't see, or minimum, which doesn't
+ * push anything for an empty list -- make it lose track. */
+static const struct {
+    const char *name;
+    const char *needs;
+    const char *gives;
+} signatures[] = {
+    { "+", "ii", "i" }, { "-", "ii", "i" }, { "*", "ii", "i" },
+    { "/", "ii", "i" }, { "mod", "ii", "i" },
+    /* (the comparisons run on anything -- = on symbols, say -- so they
+     * only get int-only instructions when both are proven ints) */
+    { "<", "**", "i" }, { ">", "**", "i" },
+    { "<=", "**", "i" }, { "≤", "**", "i" },
+    { ">=", "**", "i" }, { "≥", "**", "i" },
+    { "=", "**", "i" }, { "!=", "**", "i" }, { "≠", "**", "i" },
+    { "not", "i", "i" },
+    { "dup", "*", "00" }, { "swap", "**", "01" }, { "over", "**", "101" },
+    { "rot", "***", "102" }, { "drop", "*", "" }, { "stack", "", "" },
+    { "print", "*", "" }, { "println", "*", "" }, { "say", "*", "" },
+    { "len", "*", "i" }, { "sum", "*", "i" }, { "product", "*", "i" },
+    { "cons", "**", "l" }, { "append", "**", "l" },
+    { "head", "*", "*" }, { "last", "*", "*" },
+    { "tail", "*", "l" }, { "init", "*", "l" },
+    { "uncons", "*", "*l" }, { "unappend", "*", "l*" },
+    { "iota", "i", "q" }, { "range", "i", "q" }, { "range-ends", "ii", "q" },
+    { "iter-while", "***", "q" }, { "iter-until", "***", "q" },
+    { "force", "*", "*" },
+};
+
+/* The built-ins in <signatures> that do something besides change the
+ * stack. (The rest don't -- even going through a sequence doesn't,
+ * since map and filter only make lazy ones out of pure blocks.) */
+static const char *impure_prims[] = { "print", "println", "say", "stack" };
+
+/* Built-ins the pass can't follow, which still do nothing but change
+ * the stack as long as the block on top of it doesn't. */
+static const char *block_prims[] = { "map", "filter", "fold" };
+
+#define COUNT_OF(names) (sizeof(names) / sizeof(names[0]))
+
+/* Is <name> one of the <count> names in <names>? */
+static
+int name_in(const char *name, const char **names, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return 1;
+    }
+    return 0;
+}
+
+/* The built-ins that have int-only instructions. */
+static const struct {
+    APrimitiveFunc prim;
+    AOpcode op;
+} int_ops[] = {
+    { &lib_add, op_add_int }, { &lib_subtract, op_sub_int },
+    { &lib_multiply, op_mul_int }, { &lib_div, op_div_int },
+    { &lib_mod, op_mod_int },
+    { &lib_lessthan, op_lt_int }, { &lib_greaterthan, op_gt_int },
+    { &lib_lessthanequal, op_le_int }, { &lib_greaterthanequal, op_ge_int },
+    { &lib_equal, op_eq_int }, { &lib_notequal, op_ne_int },
+};
+
+/* A slot we know nothing about. */
+static const ASlotType unknown_slot = { TYPE_ANY, -1, NULL };
+
+/* Fill in <e> with the effect of the built-in called <name>, using
+ * <needs> and <gives> (which need room for three) as its arrays.
+ * Returns 0 if it isn't one the pass knows about. */
+static
+int prim_effect(const char *name, AStackEffect *e, AType *needs, ASlotType *gives) {
+    unsigned int i = 0;
+    while (i < sizeof(signatures) / sizeof(signatures[0])
+            && strcmp(signatures[i].name, name) != 0) {
+        i++;
+    }
+    if (i == sizeof(signatures) / sizeof(signatures[0])) return 0;
+
+    e->known = 1;
+    e->in = strlen(signatures[i].needs);
+    e->out = strlen(signatures[i].gives);
+    e->max = (e->out > e->in) ? e->out - e->in : 0;
+    e->needs = needs;
+    e->gives = gives;
+    for (unsigned int k = 0; k < e->in; k++) {
+        char c = signatures[i].needs[e->in - 1 - k];
+        needs[k] = (c == 'i') ? TYPE_OF(int_val) : TYPE_ANY;
+    }
+    for (unsigned int k = 0; k < e->out; k++) {
+        char c = signatures[i].gives[e->out - 1 - k];
+        gives[k] = unknown_slot;
+        if (c >= '0' && c <= '9') gives[k].input = c - '0';
+        else if (c == 'i') gives[k].type = TYPE_OF(int_val);
+        else if (c == 'l') gives[k].type = TYPE_OF(list_val);
+        else if (c == 'q') gives[k].type = TYPE_OF(seq_val);
+    }
+    return 1;
+}
+
+/* How high the stack is now, compared to where the code started. */
+static
+int height(ATypeState *s) {
+    return (int)s->size - (int)s->effect.in;
+}
+
+/* Is <slot> a block that's proven to do nothing but change the stack? */
+static
+int slot_pure(ASlotType slot) {
+    return slot.block != NULL && slot.block->typed && slot.block->effect.pure;
+}
+
+/* Forget everything on the stack, because something happened that the
+ * pass can't follow. The effect of the code is unknown from now on. */
+static
+void lose_track(ATypeState *s) {
+    s->effect.known = 0;
+    s->size = 0;
+}
+
+static
+void push_slot(ATypeState *s, ASlotType slot) {
+    if (s->size == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 8;
+        s->slots = realloc(s->slots, s->capacity * sizeof(ASlotType));
+    }
+    s->slots[s->size++] = slot;
+    if (height(s) > s->effect.max) s->effect.max = height(s);
+}
+
+static
+ASlotType pop_slot(ATypeState *s) {
+    if (s->size > 0) return s->slots[--s->size];
+    ASlotType slot = unknown_slot;
+    if (!s->effect.known) return slot;
+    /* it's reaching below where the code started, so it's an input */
+    s->effect.needs = realloc(s->effect.needs, (s->effect.in + 1) * sizeof(AType));
+    s->effect.needs[s->effect.in] = TYPE_ANY;
+    slot.input = s->effect.in ++;
+    return slot;
+}
+
+/* Check that <arg> can be a <type>, since <name> at <linenum> needs
+ * one. If it's one of the code's inputs, the code needs that input
+ * to be a <type> too. */
+static
+void need(ATypeState *s, ASlotType arg, AType type, const char *name, unsigned int linenum) {
+    if ((arg.type & type) == 0) {
+        fprintf(stderr, "error: ‘%s’ at line %u needs %s, but gets %s.\n", name, linenum,
+                type_name(type, type_names, "something else"),
+                type_name(arg.type, type_names, "something else"));
+        s->errors ++;
+    } else if (arg.input >= 0) {
+        s->effect.needs[arg.input] &= type;
+    }
+}
+
+/* Run something with effect <e> (called <name>, at <linenum>) on the
+ * stack picture. */
+static
+void apply_effect(ATypeState *s, AStackEffect *e, const char *name, unsigned int linenum) {
+    if (!e->known) {
+        lose_track(s);
+        return;
+    }
+    if (height(s) + e->max > s->effect.max) s->effect.max = height(s) + e->max;
+    ASlotType *args = malloc(e->in * sizeof(ASlotType) + 1);
+    for (unsigned int k = 0; k < e->in; k++) {
+        args[k] = pop_slot(s);
+        need(s, args[k], e->needs[k], name, linenum);
+    }
+    for (unsigned int k = e->out; k-- > 0; ) {
+        ASlotType g = e->gives[k];
+        push_slot(s, (g.input >= 0) ? args[g.input] : g);
+    }
+    free(args);
+}
+
+/* Run one of two things, with effects <a> and <b>, on the stack
+ * picture. That only works if they take and leave the same number
+ * of values; what they leave could then be either one's. (Neither
+ * is sure to run, so what they need isn't checked.) */
+static
+void apply_either(ATypeState *s, AStackEffect *a, AStackEffect *b) {
+    if (!a->known || !b->known || a->in != b->in || a->out != b->out) {
+        lose_track(s);
+        return;
+    }
+    int max = (a->max > b->max) ? a->max : b->max;
+    if (height(s) + max > s->effect.max) s->effect.max = height(s) + max;
+    ASlotType *args = malloc(a->in * sizeof(ASlotType) + 1);
+    for (unsigned int k = 0; k < a->in; k++) {
+        args[k] = pop_slot(s);
+    }
+    for (unsigned int k = a->out; k-- > 0; ) {
+        ASlotType x = (a->gives[k].input >= 0) ? args[a->gives[k].input] : a->gives[k];
+        ASlotType y = (b->gives[k].input >= 0) ? args[b->gives[k].input] : b->gives[k];
+        ASlotType slot = { x.type | y.type,
+                           (x.input == y.input) ? x.input : -1,
+                           (x.block == y.block) ? x.block : NULL };
+        push_slot(s, slot);
+    }
+    free(args);
+}
+
+/* What's known about the variable <var> in <env>. */
+static
+ASlotType lookup(ATypeEnv *env, AVarRef var) {
+    for (unsigned int up = var.up; up > 0 && env != NULL; up--) {
+        env = env->parent;
+    }
+    if (env == NULL || var.slot >= env->count) return unknown_slot;
+    return env->vars[var.slot];
+}
+
+/* If <instr> calls one of the arithmetic built-ins, and both of its
+ * arguments are proven to be ints, switch it to the int-only
+ * instruction. */
+static
+void specialize(ATypeState *s, AInstruction *instr) {
+    if (s->size < 2) return;
+    if (s->slots[s->size - 1].type != TYPE_OF(int_val)) return;
+    if (s->slots[s->size - 2].type != TYPE_OF(int_val)) return;
+    for (unsigned int i = 0; i < sizeof(int_ops) / sizeof(int_ops[0]); i++) {
+        if (int_ops[i].prim == instr->arg.func->data.primitive) {
+            instr->op = int_ops[i].op;
+        }
+    }
+}
+
+static unsigned int type_in(ACode *code, ATypeEnv *env);
+
+/* Run the type pass on the code of a block (or list element) made
+ * where <s> is, if it hasn't been done already. */
+static
+void type_block(ATypeState *s, ACode *block) {
+    if (block == NULL || block->typed) return;
+    if (block->captures == NULL) {
+        s->errors += type_in(block, s->env);
+        return;
+    }
+    /* a flat closure sees only its own copies of what it uses */
+    ATypeEnv flat = { malloc(block->capture_count * sizeof(ASlotType)),
+                      block->capture_count, NULL };
+    for (unsigned int j = 0; j < block->capture_count; j++) {
+        flat.vars[j] = lookup(s->env, block->captures[j]);
+        flat.vars[j].input = -1;
+    }
+    s->errors += type_in(block, &flat);
+    free(flat.vars);
+}
+
+/* Run the type pass on <code>, which sees the variables in <env>. */
+static
+unsigned int type_in(ACode *code, ATypeEnv *env) {
+    ATypeState s = { NULL, 0, 0, { 1, 0, 0, 0, NULL, NULL, 1 }, env, 0 };
+    /* how many of the variable buffers in s.env are the code's own */
+    unsigned int depth = 0;
+    AType needs[3];
+    ASlotType gives[3];
+    AStackEffect e;
+
+    for (unsigned int i = 0; i < code->length; i++) {
+        AInstruction *instr = &code->instrs[i];
+        ASlotType slot, block, then, otherwise, saved;
+        switch (code_base_op(instr->op)) {
+            case op_push_const:
+                slot = unknown_slot;
+                slot.type = TYPE_OF(val_type(instr->arg.val));
+                if (val_type(instr->arg.val) == block_val) {
+                    slot.block = instr->arg.val->data.ast->code;
+                    type_block(&s, slot.block);
+                }
+                push_slot(&s, slot);
+                break;
+            case op_make_closure:
+                slot = unknown_slot;
+                slot.type = TYPE_OF(bound_block_val);
+                slot.block = instr->arg.val->data.ast->code;
+                type_block(&s, slot.block);
+                push_slot(&s, slot);
+                break;
+            case op_reify_list:
+                for (AWordSeqNode *elem = instr->arg.pl->first; elem != NULL; elem = elem->next) {
+                    type_block(&s, elem->code);
+                    if (elem->code != NULL && !elem->code->effect.pure) s.effect.pure = 0;
+                }
+                slot = unknown_slot;
+                slot.type = TYPE_OF(list_val);
+                push_slot(&s, slot);
+                break;
+            case op_push_var:
+                slot = lookup(s.env, instr->arg.var);
+                /* (inputs only mean anything in the code they came from) */
+                if (instr->arg.var.up >= depth) slot.input = -1;
+                push_slot(&s, slot);
+                break;
+            case op_bind:
+            case op_bind_local: {
+                ATypeEnv *frame = malloc(sizeof(ATypeEnv));
+                frame->count = instr->arg.count;
+                frame->vars = malloc(frame->count * sizeof(ASlotType) + 1);
+                for (unsigned int k = frame->count; k-- > 0; ) {
+                    frame->vars[k] = pop_slot(&s);
+                }
+                frame->parent = s.env;
+                s.env = frame;
+                depth ++;
+                break;
+            }
+            case op_unbind: {
+                ATypeEnv *frame = s.env;
+                s.env = frame->parent;
+                free(frame->vars);
+                free(frame);
+                depth --;
+                break;
+            }
+            case op_call_prim:
+            case op_dup: case op_swap: case op_over: case op_drop:
+            case op_add_int: case op_sub_int: case op_mul_int:
+            case op_div_int: case op_mod_int:
+            case op_lt_int: case op_gt_int: case op_le_int:
+            case op_ge_int: case op_eq_int: case op_ne_int:
+                if (!prim_effect(instr->arg.func->sym->name, &e, needs, gives)) {
+                    if (!name_in(instr->arg.func->sym->name, block_prims, COUNT_OF(block_prims))
+                            || s.size == 0 || !slot_pure(s.slots[s.size - 1])) {
+                        s.effect.pure = 0;
+                    }
+                    lose_track(&s);
+                    break;
+                }
+                if (name_in(instr->arg.func->sym->name, impure_prims, COUNT_OF(impure_prims))) {
+                    s.effect.pure = 0;
+                }
+                specialize(&s, instr);
+                /* doing it straight beats calling the built-in as the
+                 * second half of a dup or swap superinstruction */
+                if (op_is_int_op(instr->op) && i > 0
+                        && (instr[-1].op == op_dup_call || instr[-1].op == op_swap_call)) {
+                    instr[-1].op = code_base_op(instr[-1].op);
+                }
+                apply_effect(&s, &e, instr->arg.func->sym->name, instr->linenum);
+                break;
+            case op_call_user: {
+                /* (a word that hasn't been through yet -- most likely
+                 * because it's calling itself -- can't be followed) */
+                AUserFunc *uf = instr->arg.func->data.userfunc;
+                ACode *callee = (uf->type != dummy_func && uf->words != NULL)
+                    ? uf->words->code : NULL;
+                if (callee == NULL || !callee->typed) {
+                    s.effect.pure = 0;
+                    lose_track(&s);
+                } else {
+                    if (!callee->effect.pure) s.effect.pure = 0;
+                    apply_effect(&s, &callee->effect, instr->arg.func->sym->name, instr->linenum);
+                }
+                break;
+            }
+            case op_apply:
+                block = pop_slot(&s);
+                if (!slot_pure(block)) s.effect.pure = 0;
+                if (block.block == NULL) {
+                    lose_track(&s);
+                } else {
+                    apply_effect(&s, &block.block->effect, "apply", instr->linenum);
+                }
+                break;
+            case op_dip:
+                block = pop_slot(&s);
+                saved = pop_slot(&s);
+                if (!slot_pure(block)) s.effect.pure = 0;
+                if (block.block == NULL) {
+                    lose_track(&s);
+                } else {
+                    apply_effect(&s, &block.block->effect, "dip", instr->linenum);
+                }
+                push_slot(&s, saved);
+                break;
+            case op_if:
+            case op_ifstar:
+                otherwise = pop_slot(&s);
+                then = pop_slot(&s);
+                block = pop_slot(&s);
+                if (!slot_pure(block) || !slot_pure(then) || !slot_pure(otherwise)) {
+                    s.effect.pure = 0;
+                }
+                if (block.block == NULL || then.block == NULL || otherwise.block == NULL) {
+                    lose_track(&s);
+                    break;
+                }
+                if (instr->op == op_ifstar) {
+                    /* the condition gets run on the value, which is
+                     * then put back after it */
+                    saved = pop_slot(&s);
+                    push_slot(&s, saved);
+                }
+                apply_effect(&s, &block.block->effect, "if", instr->linenum);
+                pop_slot(&s);
+                if (instr->op == op_ifstar) push_slot(&s, saved);
+                apply_either(&s, &then.block->effect, &otherwise.block->effect);
+                break;
+            case op_return:
+                break;
+            default:
+                /* (superinstructions are gone through as their halves) */
+                break;
+        }
+    }
+
+    if (s.effect.known) {
+        s.effect.out = s.size;
+        s.effect.gives = malloc(s.size * sizeof(ASlotType) + 1);
+        for (unsigned int k = 0; k < s.size; k++) {
+            s.effect.gives[k] = s.slots[s.size - 1 - k];
+        }
+    } else {
+        free(s.effect.needs);
+        s.effect.needs = NULL;
+        s.effect.in = 0;
+    }
+    free(s.slots);
+    free(code->effect.needs);
+    free(code->effect.gives);
+    code->effect = s.effect;
+    code->typed = 1;
+    return s.errors;
+}
+
+/* Work out what <code> does to the stack, and what it leaves there,
+ * storing the answer in code->effect. Calls to arithmetic built-ins
+ * whose arguments are proven to be ints get replaced with the int-only
+ * instructions. Blocks and list elements in the code are done too,
+ * knowing what they can about the variables around them. Prints out
+ * any type errors it's sure of, and returns how many there were. */
+unsigned int type_code(ACode *code) {
+    if (code == NULL || code->typed) return 0;
+    return type_in(code, NULL);
+}
+
+/* Print out a stack effect, like ( int * -- int ). */
+void fprint_effect(FILE *out, AStackEffect *effect) {
+    if (!effect->known) {
+        fprintf(out, "( ? )");
+        return;
+    }
+    fprintf(out, "(");
+    for (unsigned int k = effect->in; k-- > 0; ) {
+        fprintf(out, " %s", type_name(effect->needs[k], short_type_names, "*"));
+    }
+    fprintf(out, " --");
+    for (unsigned int k = effect->out; k-- > 0; ) {
+        /* (an input left as it was is whatever it had to be) */
+        ASlotType g = effect->gives[k];
+        AType type = (g.input >= 0) ? effect->needs[g.input] : g.type;
+        fprintf(out, " %s", type_name(type, short_type_names, "*"));
+    }
+    fprintf(out, " )");
+}
@@ -0,0 +1,27 @@
+#ifndef _AL_TYPES_H__
+#define _AL_TYPES_H__
+
+#include "alma.h"
+#include "ast.h"
+#include "value.h"
+#include "lib.h"
+#include "bytecode.h"
+
+/* The AType containing just <t>. */
+#define TYPE_OF(t)  ((AType)1 << (t))
+
+/* The AType a value we know nothing about has. */
+#define TYPE_ANY    (~(AType)0)
+
+/* Work out what <code> does to the stack, and what it leaves there,
+ * storing the answer in code->effect. Calls to arithmetic built-ins
+ * whose arguments are proven to be ints get replaced with the int-only
+ * instructions. Blocks and list elements in the code are done too,
+ * knowing what they can about the variables around them. Prints out
+ * any type errors it's sure of, and returns how many there were. */
+unsigned int type_code(ACode *code);
+
+/* Print out a stack effect, like ( int * -- int ). */
+void fprint_effect(FILE *out, AStackEffect *effect);
+
+#endif
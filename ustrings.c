@@ -13,6 +13,7 @@ AUstr *ustr_new(size_t initial_size) {
         fprintf(stderr, "Couldn't allocate space for a new string: Out of memory\n");
         return NULL;
     }
+    COUNT_ALLOC(alloc_ustr, sizeof(AUstr) + initial_size * sizeof(uint32_t));
     newstr->capacity = initial_size;
     newstr->length = 0;
     newstr->byte_length = 0;
@@ -212,6 +213,7 @@ int ustr_eq(AUstr *str1, AUstr *str2) {
 
 /* free a ustring. */
 void free_ustring(AUstr *str) {
+    COUNT_FREE(alloc_ustr);
     free(str->data);
     free(str);
 }
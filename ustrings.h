@@ -2,6 +2,7 @@
 #define _AL_USTR_H__
 
 #include "alma.h"
+#include "alloc.h"
 
 /* Create a new string (actually a sequence of 32-bit integers
  * representing UTF8 codepoints) */
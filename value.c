@@ -1,48 +1,71 @@
 #include "value.h"
 
-/* Allocates a value without any data attached */
+/* Allocates a value of type <type> without any data attached */
 static
-AValue *alloc_val(void) {
-    AValue *new_val = malloc(sizeof(AValue));
+AValue *alloc_val(AValueType type) {
+    AValue *new_val = pool_alloc(&value_pool);
     if (new_val == NULL) {
         fprintf(stderr, "Couldn't allocate space for a new variable: Out of memory\n");
         return NULL;
     }
+    COUNT_ALLOC(type, sizeof(AValue));
+    new_val->type = type;
+    new_val->made_as = type;
     new_val->refs = 0;
     return new_val;
 }
 
 AValue *val_int(long data) {
-    AValue *v = alloc_val();
-    v->type = int_val;
+    if (data >= VAL_INT_MIN && data <= VAL_INT_MAX) {
+        /* shift as unsigned so negative numbers don't overflow */
+        return (AValue*)(((uintptr_t)(intptr_t)data << 1) | 1);
+    }
+    AValue *v = alloc_val(int_val);
     v->data.i = data;
     return v;
 }
 
 AValue *val_float(float data) {
-    AValue *v = alloc_val();
-    v->type = float_val;
+#ifdef ALMA_IMMEDIATE_FLOATS
+    uint32_t bits;
+    memcpy(&bits, &data, sizeof(bits));
+    return (AValue*)(((uintptr_t)bits << 32) | VAL_FLOAT_TAG);
+#else
+    AValue *v = alloc_val(float_val);
     v->data.fl = data;
     return v;
+#endif
+}
+
+double val_get_float(AValue *v) {
+#ifdef ALMA_IMMEDIATE_FLOATS
+    if (val_is_imm_float(v)) {
+        uint32_t bits = (uint32_t)((uintptr_t)v >> 32);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+#endif
+    return v->data.fl;
 }
 
 AValue *val_str(AUstr *str) {
-    AValue *v = alloc_val();
-    v->type = str_val;
+    AValue *v = alloc_val(str_val);
     v->data.str = str;
     return v;
 }
 
 AValue *val_sym(ASymbol *sym) {
-    AValue *v = alloc_val();
-    v->type = sym_val;
+    if (((uintptr_t)sym & VAL_TAG_MASK) == 0) {
+        return (AValue*)((uintptr_t)sym | VAL_SYM_TAG);
+    }
+    AValue *v = alloc_val(sym_val);
     v->data.sym = sym;
     return v;
 }
 
 AValue *val_block(AWordSeqNode *block) {
-    AValue *v = alloc_val();
-    v->type = proto_block;
+    AValue *v = alloc_val(proto_block);
     v->data.ast = block;
     return v;
 }
@@ -51,14 +74,15 @@ AValue *val_block(AWordSeqNode *block) {
 AValue *val_boundblock(AValue *fb, AVarBuffer *buf) {
     assert(fb->type == free_block_val && "can't create a bound block from a not free block");
 
-    AValue *v = alloc_val();
-    v->type = bound_block_val;
+    AValue *v = alloc_val(bound_block_val);
 
     AUserFunc *uf = malloc(sizeof(AUserFunc));
+    COUNT_ALLOC(alloc_userfunc, sizeof(AUserFunc));
     uf->type = bound_func;
     uf->words = fb->data.ast;
     uf->closure = buf;
 
+    assert((buf == NULL || !buf->on_stack) && "closing over a var-buffer that can't escape");
     varbuf_ref(buf); /* Make sure buf doesn't get deleted out from under us */
 
     v->data.uf = uf;
@@ -67,22 +91,28 @@ AValue *val_boundblock(AValue *fb, AVarBuffer *buf) {
 
 /* Create a value holding a proto-list (when parsing) */
 AValue *val_protolist(AProtoList *pl) {
-    AValue *v = alloc_val();
-    v->type = proto_list;
+    AValue *v = alloc_val(proto_list);
     v->data.pl = pl;
     return v;
 }
 
 /* Create a value holding a real list */
 AValue *val_list(AList *l) {
-    AValue *v = alloc_val();
-    v->type = list_val;
+    AValue *v = alloc_val(list_val);
     v->data.list = l;
     return v;
 }
 
+/* Create a value holding a lazy sequence */
+AValue *val_seq(ASeq *seq) {
+    AValue *v = alloc_val(seq_val);
+    v->data.seq = seq;
+    return v;
+}
+
 /* Get a fresh pointer to the object that counts as a reference. */
 AValue *ref(AValue *v) {
+    if (val_is_immediate(v)) return v;
     v->refs ++;
     return v;
 }
@@ -90,6 +120,7 @@ AValue *ref(AValue *v) {
 /* Delete a reference to the object, reducing its refcount and
  * potentially freeing it. */
 void delete_ref(AValue *v) {
+    if (val_is_immediate(v)) return;
     v->refs --;
     if (v->refs < 1) {
         free_value(v);
@@ -98,8 +129,14 @@ void delete_ref(AValue *v) {
 
 /* Print out a value to an arbitrary filehandle. */
 void fprint_val(FILE *out, AValue *v) {
-    if (v->type == int_val) {
-        fprintf(out, "%ld", v->data.i);
+    AValueType type = val_type(v);
+    if (type == int_val) {
+        fprintf(out, "%ld", val_get_int(v));
+    } else if (type == float_val) {
+        fprintf(out, "%g", val_get_float(v));
+    } else if (type == sym_val) {
+        fprintf(out, "/");
+        fprint_symbol(out, val_get_sym(v));
     } else if (v->type == block_val
             || v->type == proto_block
             || v->type == free_block_val) {
@@ -116,17 +153,14 @@ void fprint_val(FILE *out, AValue *v) {
         fprintf(out, "\"");
         ustr_fprint(out, v->data.str);
         fprintf(out, "\"");
-    } else if (v->type == float_val) {
-        fprintf(out, "%g", v->data.fl);
     } else if (v->type == proto_list) {
         fprintf(out, "{ ");
         fprint_protolist(out, v->data.pl);
         fprintf(out, " }");
     } else if (v->type == list_val) {
         fprint_list(out, v->data.list);
-    } else if (v->type == sym_val) {
-        fprintf(out, "/");
-        fprint_symbol(out, v->data.sym);
+    } else if (v->type == seq_val) {
+        fprint_seq(out, v->data.seq);
     } else {
         fprintf(out, "?");
     }
@@ -140,7 +174,7 @@ void print_val(AValue *v) {
 /* Print out a value without quoting strings etc.
  * (called by 'print' word) */
 void print_val_simple(AValue *v) {
-    if (v->type == str_val) {
+    if (val_type(v) == str_val) {
         /* no quotes!!! */
         ustr_print(v->data.str);
     } else {
@@ -154,6 +188,7 @@ extern void free_protolist(AProtoList *pl);
 
 /* Free a value. */
 void free_value(AValue *to_free) {
+    if (val_is_immediate(to_free)) return;
     switch(to_free->type) {
         case int_val:
         case float_val:
@@ -179,10 +214,14 @@ void free_value(AValue *to_free) {
         case list_val:
             free_list(to_free->data.list);
             break;
+        case seq_val:
+            free_seq(to_free->data.seq);
+            break;
         default:
             fprintf(stderr,
                     "warning, freeing value of unrecognized type %d.",
                     to_free->type);
     }
-    free(to_free);
+    COUNT_FREE(to_free->made_as);
+    pool_free(&value_pool, to_free);
 }
@@ -5,8 +5,62 @@
 #include "scope.h" /* for free_user_func */
 #include "vars.h"
 #include "list.h"
+#include "seq.h"
 #include "ustrings.h"
 #include "symbols.h"
+#include "alloc.h"
+
+/* Ints, floats and symbols don't get a heap-allocated AValue. The
+ * AValue* itself holds their data, marked by its low bits (real
+ * AValues come from malloc, so their low three bits are always 0):
+ *
+ *     ...iiii1    int, in the upper bits
+ *     ...ssss010  symbol: the ASymbol* with 010 or'd in
+ *     f..f...100  float: its 32 bits in the upper half of the word
+ *
+ * So these cost nothing to create or to throw away, and ref() and
+ * delete_ref() just leave them alone. Ints too big to fit (and floats,
+ * on 32-bit machines) still get a real AValue like before.
+ *
+ * This means anything that might be handed an immediate has to go
+ * through val_type() and val_get_int() etc., rather than looking at
+ * ->type and ->data directly. (The macros may evaluate their argument
+ * more than once.) */
+#define VAL_TAG_MASK    ((uintptr_t)7)
+#define VAL_SYM_TAG     ((uintptr_t)2)
+#define VAL_FLOAT_TAG   ((uintptr_t)4)
+
+#define VAL_INT_MAX     (INTPTR_MAX >> 1)
+#define VAL_INT_MIN     (INTPTR_MIN >> 1)
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define ALMA_IMMEDIATE_FLOATS
+#endif
+
+/* Is this value stored in the pointer, rather than on the heap? */
+#define val_is_immediate(v) (((uintptr_t)(v) & VAL_TAG_MASK) != 0)
+
+#define val_is_imm_int(v)   (((uintptr_t)(v) & 1) != 0)
+#define val_is_imm_sym(v)   (((uintptr_t)(v) & VAL_TAG_MASK) == VAL_SYM_TAG)
+#define val_is_imm_float(v) (((uintptr_t)(v) & VAL_TAG_MASK) == VAL_FLOAT_TAG)
+
+/* The AValueType of any value, immediate or not. */
+#define val_type(v) \
+    (val_is_imm_int(v) ? int_val \
+     : val_is_imm_sym(v) ? sym_val \
+     : val_is_imm_float(v) ? float_val \
+     : (v)->type)
+
+/* Get the contents of an int value. */
+#define val_get_int(v) \
+    (val_is_imm_int(v) ? (long)((intptr_t)(v) >> 1) : (v)->data.i)
+
+/* Get the contents of a symbol value. */
+#define val_get_sym(v) \
+    (val_is_imm_sym(v) ? (ASymbol*)((uintptr_t)(v) & ~VAL_TAG_MASK) : (v)->data.sym)
+
+/* Get the contents of a float value. */
+double val_get_float(AValue *v);
 
 /* Create a value holding an int */
 AValue *val_int(long data);
@@ -32,6 +86,9 @@ AValue *val_protolist(AProtoList *pl);
 /* Create a value holding a real list */
 AValue *val_list(AList *l);
 
+/* Create a value holding a lazy sequence */
+AValue *val_seq(ASeq *seq);
+
 /* Get a fresh pointer to the object that counts as a reference. */
 AValue *ref(AValue *v);
 
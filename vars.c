@@ -22,12 +22,19 @@ AVarBind *varbind_new(ANameSeqNode *names, AWordSeqNode *words) {
 
 /* Create a new VarBuffer with size <size> and parent <parent>. */
 AVarBuffer *varbuf_new(AVarBuffer *parent, unsigned int size) {
-    AVarBuffer *newbuf = malloc(sizeof(AVarBuffer));
+    AVarBuffer *newbuf = pool_alloc(&varbuf_pool);
     if (newbuf == NULL) {
         fprintf(stderr, "error: cannot allocate space for a new var buffer: out of memory\n");
         return NULL;
     }
-    newbuf->vars = malloc(size * sizeof(AValue*));
+    COUNT_ALLOC(alloc_varbuf, sizeof(AVarBuffer) + size * sizeof(AValue*));
+    if (size == 0) {
+        newbuf->vars = NULL;
+    } else if (size <= VARSLOT_POOLS) {
+        newbuf->vars = pool_alloc(&varslot_pools[size - 1]);
+    } else {
+        newbuf->vars = malloc(size * sizeof(AValue*));
+    }
     newbuf->size = size;
     if (parent != NULL) {
         newbuf->base = parent->base + parent->size;
@@ -35,6 +42,7 @@ AVarBuffer *varbuf_new(AVarBuffer *parent, unsigned int size) {
         newbuf->base = 0;
     }
     newbuf->refs = 0;
+    newbuf->on_stack = 0;
 
     /* Make sure we don't free the parent until we free this one */
     varbuf_ref(parent);
@@ -42,6 +50,38 @@ AVarBuffer *varbuf_new(AVarBuffer *parent, unsigned int size) {
     return newbuf;
 }
 
+/* Var-buffers for binds that nothing can hold onto past their unbind
+ * (see op_bind_local) come off this stack instead of the pools. They
+ * go away in the opposite order they came, so making one is just
+ * bumping a pointer or two. If it runs out (in very deep recursion,
+ * say) they come from the pools like any other. */
+#define FRAME_STACK_SIZE 4096
+#define FRAME_SLOTS_SIZE 16384
+static AVarBuffer frame_stack[FRAME_STACK_SIZE];
+static unsigned int frames_top = 0;
+static AValue *frame_slots[FRAME_SLOTS_SIZE];
+static unsigned int slots_top = 0;
+
+/* Create a new VarBuffer with size <size> and parent <parent>, on the
+ * frame stack if there's room. It has to be freed before anything
+ * made after it is -- so nothing can hold on to it. */
+AVarBuffer *varbuf_new_local(AVarBuffer *parent, unsigned int size) {
+    if (frames_top == FRAME_STACK_SIZE || size > FRAME_SLOTS_SIZE - slots_top) {
+        return varbuf_new(parent, size);
+    }
+    AVarBuffer *newbuf = &frame_stack[frames_top++];
+    newbuf->vars = &frame_slots[slots_top];
+    slots_top += size;
+    newbuf->size = size;
+    newbuf->base = (parent != NULL) ? parent->base + parent->size : 0;
+    newbuf->refs = 0;
+    newbuf->on_stack = 1;
+
+    varbuf_ref(parent);
+    newbuf->parent = parent;
+    return newbuf;
+}
+
 /* Put a value into <buf> at index <index> */
 void varbuf_put(AVarBuffer *buf, unsigned int index, AValue *val) {
     assert(index < buf->size && "trying to put value too far into varbuf");
@@ -63,6 +103,26 @@ AValue *varbuf_get(AVarBuffer *buf, unsigned int index) {
     }
 }
 
+/* Get the buffer <up> steps along the chain of <buf>'s parents.
+ * (Compiled code knows how far up each of its variables is, so this
+ * is all it needs to find them.) */
+AVarBuffer *varbuf_up(AVarBuffer *buf, unsigned int up) {
+    while (up > 0) {
+        assert(buf != NULL && "attempt to go above the outermost var buffer");
+        buf = buf->parent;
+        up --;
+    }
+    return buf;
+}
+
+/* Get the variable that <var> points to, starting from <buf>. */
+/* Returns a new reference to the value. */
+AValue *varbuf_lookup(AVarBuffer *buf, AVarRef var) {
+    buf = varbuf_up(buf, var.up);
+    assert(buf != NULL && var.slot < buf->size && "attempt to get var with too-high slot");
+    return ref(buf->vars[var.slot]);
+}
+
 /* Get the buffer in the chain of <buf>'s parents which has <num>
  * variables below it. This is important because when we call a user
  * function we want to reset the varbuffer to only include the
@@ -108,8 +168,23 @@ void varbuf_free(AVarBuffer *buf) {
         /* Drop refcount of contained vars */
         delete_ref(buf->vars[i]);
     }
-    free(buf->vars);
+    if (buf->on_stack) {
+        AVarBuffer *parent = buf->parent;
+        assert(buf == &frame_stack[frames_top - 1] && "var-buffer freed out of order");
+        frames_top --;
+        slots_top = buf->vars - frame_slots;
+        varbuf_unref(parent);
+        return;
+    }
+    if (buf->size == 0) {
+        /* no slots to free */
+    } else if (buf->size <= VARSLOT_POOLS) {
+        pool_free(&varslot_pools[buf->size - 1], buf->vars);
+    } else {
+        free(buf->vars);
+    }
     /* if we have a parent, unref it as well */
     varbuf_unref(buf->parent);
-    free(buf);
+    COUNT_FREE(alloc_varbuf);
+    pool_free(&varbuf_pool, buf);
 }
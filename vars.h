@@ -2,6 +2,7 @@
 #define _AL_VARS_H__
 
 #include "alma.h"
+#include "alloc.h"
 #include "value.h"
 
 /* Create a new var-bind instruction, with the names from the
@@ -11,6 +12,11 @@ AVarBind *varbind_new(ANameSeqNode *names, AWordSeqNode *words);
 /* Create a new VarBuffer with size <size> and parent <parent>. */
 AVarBuffer *varbuf_new(AVarBuffer *parent, unsigned int size);
 
+/* Create a new VarBuffer with size <size> and parent <parent>, on the
+ * frame stack if there's room. It has to be freed before anything
+ * made after it is -- so nothing can hold on to it. */
+AVarBuffer *varbuf_new_local(AVarBuffer *parent, unsigned int size);
+
 /* Put a value into <buf> at index <index> */
 void varbuf_put(AVarBuffer *buf, unsigned int index, AValue *val);
 
@@ -19,6 +25,13 @@ void varbuf_put(AVarBuffer *buf, unsigned int index, AValue *val);
 /* Returns a new reference to the value. */
 AValue *varbuf_get(AVarBuffer *buf, unsigned int index);
 
+/* Get the buffer <up> steps along the chain of <buf>'s parents. */
+AVarBuffer *varbuf_up(AVarBuffer *buf, unsigned int up);
+
+/* Get the variable that <var> points to, starting from <buf>. */
+/* Returns a new reference to the value. */
+AValue *varbuf_lookup(AVarBuffer *buf, AVarRef var);
+
 /* Get the buffer in the chain of this one's parents which contains
  * the <num>'th var. This is important because when we call a user
  * function we want to reset the varbuffer to only include the
@@ -0,0 +1,276 @@
+#include "vector.h"
+
+/* Use the widest instructions the compiler's been told it can. The
+ * SIMD versions only make sense where an immediate is a 64-bit word;
+ * on anything else (and for the leftovers at the end of an array)
+ * there are plain loops, which the compiler can vectorize itself if
+ * it knows how. */
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#  if defined(__AVX2__)
+#    include <immintrin.h>
+#    define VEC_AVX2
+#  elif defined(__SSE4_2__)
+#    include <nmmintrin.h>
+#    define VEC_SSE4
+#  endif
+#  if defined(__SSE2__)
+#    include <emmintrin.h>
+#    define VEC_SSE2
+#  endif
+#endif
+
+/* An immediate int is the word 2n + 1 (see value.h). That ordering
+ * is the same as n's, so comparisons can look at the words as they
+ * are, and adding 2k to one gives the immediate for n + k. */
+#define WORD(v)     ((intptr_t)(v))
+#define UNTAG(v)    ((long)((intptr_t)(v) >> 1))
+#define TAG(n)      ((intptr_t)(((uintptr_t)(intptr_t)(n) << 1) | 1))
+
+/* Add up <n> ints. */
+long vec_int_sum(AValue **items, unsigned int n) {
+    /* unsigned, so that overflow wraps rather than being undefined */
+    uintptr_t total = 0;
+    unsigned int i = 0;
+#if defined(VEC_AVX2)
+    __m256i acc = _mm256_setzero_si256();
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    for (; i + 4 <= n; i += 4) {
+        __m256i w = _mm256_loadu_si256((const __m256i*)(items + i));
+        /* there's no 64-bit arithmetic shift before AVX-512, so
+         * shift logically and then put the sign bit back */
+        w = _mm256_or_si256(_mm256_srli_epi64(w, 1), _mm256_and_si256(w, sign));
+        acc = _mm256_add_epi64(acc, w);
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(VEC_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    for (; i + 2 <= n; i += 2) {
+        __m128i w = _mm_loadu_si128((const __m128i*)(items + i));
+        w = _mm_or_si128(_mm_srli_epi64(w, 1), _mm_and_si128(w, sign));
+        acc = _mm_add_epi64(acc, w);
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    total = lanes[0] + lanes[1];
+#endif
+    for (; i < n; i++) {
+        total += (uintptr_t)UNTAG(items[i]);
+    }
+    return (long)total;
+}
+
+/* Multiply together <n> ints. */
+long vec_int_product(AValue **items, unsigned int n) {
+    /* Nothing short of AVX-512 multiplies 64-bit lanes, so this one
+     * stays scalar; four separate products let the multiplies at
+     * least overlap with each other. */
+    uintptr_t p0 = 1, p1 = 1, p2 = 1, p3 = 1;
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        p0 *= (uintptr_t)UNTAG(items[i]);
+        p1 *= (uintptr_t)UNTAG(items[i + 1]);
+        p2 *= (uintptr_t)UNTAG(items[i + 2]);
+        p3 *= (uintptr_t)UNTAG(items[i + 3]);
+    }
+    for (; i < n; i++) {
+        p0 *= (uintptr_t)UNTAG(items[i]);
+    }
+    return (long)(p0 * p1 * p2 * p3);
+}
+
+/* Find the smallest and largest of <n> (at least 1) ints. */
+static
+void int_extremes(AValue **items, unsigned int n, long *min, long *max) {
+    intptr_t lo = WORD(items[0]);
+    intptr_t hi = lo;
+    unsigned int i = 1;
+#if defined(VEC_AVX2)
+    if (n >= 4) {
+        __m256i vlo = _mm256_set1_epi64x(lo);
+        __m256i vhi = vlo;
+        for (; i + 4 <= n; i += 4) {
+            __m256i w = _mm256_loadu_si256((const __m256i*)(items + i));
+            vlo = _mm256_blendv_epi8(vlo, w, _mm256_cmpgt_epi64(vlo, w));
+            vhi = _mm256_blendv_epi8(vhi, w, _mm256_cmpgt_epi64(w, vhi));
+        }
+        int64_t lows[4], highs[4];
+        _mm256_storeu_si256((__m256i*)lows, vlo);
+        _mm256_storeu_si256((__m256i*)highs, vhi);
+        for (int j = 0; j < 4; j++) {
+            if (lows[j] < lo) lo = lows[j];
+            if (highs[j] > hi) hi = highs[j];
+        }
+    }
+#elif defined(VEC_SSE4)
+    if (n >= 2) {
+        __m128i vlo = _mm_set1_epi64x(lo);
+        __m128i vhi = vlo;
+        for (; i + 2 <= n; i += 2) {
+            __m128i w = _mm_loadu_si128((const __m128i*)(items + i));
+            vlo = _mm_blendv_epi8(vlo, w, _mm_cmpgt_epi64(vlo, w));
+            vhi = _mm_blendv_epi8(vhi, w, _mm_cmpgt_epi64(w, vhi));
+        }
+        int64_t lows[2], highs[2];
+        _mm_storeu_si128((__m128i*)lows, vlo);
+        _mm_storeu_si128((__m128i*)highs, vhi);
+        for (int j = 0; j < 2; j++) {
+            if (lows[j] < lo) lo = lows[j];
+            if (highs[j] > hi) hi = highs[j];
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        intptr_t w = WORD(items[i]);
+        if (w < lo) lo = w;
+        if (w > hi) hi = w;
+    }
+    *min = UNTAG(lo);
+    *max = UNTAG(hi);
+}
+
+/* Find the smallest of <n> ints. (<n> must be at least 1.) */
+long vec_int_min(AValue **items, unsigned int n) {
+    long min, max;
+    int_extremes(items, n, &min, &max);
+    return min;
+}
+
+/* Find the largest of <n> ints. (<n> must be at least 1.) */
+long vec_int_max(AValue **items, unsigned int n) {
+    long min, max;
+    int_extremes(items, n, &min, &max);
+    return max;
+}
+
+/* Set dst[i] to src[i] + <k>, for each of the <n> ints in <src>.
+ * <dst> can be the same as <src>. If any of the results would be
+ * too big to be an immediate, return 0 without touching <dst>. */
+int vec_int_add(AValue **dst, AValue **src, unsigned int n, long k) {
+    if (n == 0) return 1;
+    long min, max;
+    int_extremes(src, n, &min, &max);
+    if (k < VAL_INT_MIN || k > VAL_INT_MAX) return 0;
+    if (k > 0 ? max > VAL_INT_MAX - k : min < VAL_INT_MIN - k) return 0;
+
+    uintptr_t step = (uintptr_t)k << 1;
+    unsigned int i = 0;
+#if defined(VEC_AVX2)
+    const __m256i vstep = _mm256_set1_epi64x((int64_t)step);
+    for (; i + 4 <= n; i += 4) {
+        __m256i w = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi64(w, vstep));
+    }
+#elif defined(VEC_SSE2)
+    const __m128i vstep = _mm_set1_epi64x((int64_t)step);
+    for (; i + 2 <= n; i += 2) {
+        __m128i w = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi64(w, vstep));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = (AValue*)((uintptr_t)src[i] + step);
+    }
+    return 1;
+}
+
+/* Set dst[i] to src[i] * <k>, for each of the <n> ints in <src>.
+ * <dst> can be the same as <src>. If any of the results would be
+ * too big to be an immediate, return 0 without touching <dst>. */
+int vec_int_mul(AValue **dst, AValue **src, unsigned int n, long k) {
+    if (n == 0) return 1;
+    long min, max;
+    int_extremes(src, n, &min, &max);
+    if (k < VAL_INT_MIN || k > VAL_INT_MAX) return 0;
+    long biggest = (max > -min) ? max : -min;
+    if (k != 0 && biggest > VAL_INT_MAX / (k < 0 ? -k : k)) return 0;
+
+    /* (2n + 1 - 1) * k + 1 is the immediate for n * k. (Scalar for
+     * the same reason as vec_int_product.) */
+    for (unsigned int i = 0; i < n; i++) {
+        dst[i] = (AValue*)((((uintptr_t)src[i] ^ 1) * (uintptr_t)k) | 1);
+    }
+    return 1;
+}
+
+/* Given bitmasks saying which elements were greater than and equal
+ * to the scalar, work out which ones pass <op>. (<all> has a bit set
+ * for every element.) */
+static
+int compare_bits(AVecCompare op, int gt, int eq, int all) {
+    switch (op) {
+        case vec_lt: return all & ~(gt | eq);
+        case vec_gt: return gt;
+        case vec_le: return all & ~gt;
+        case vec_ge: return gt | eq;
+        case vec_eq: return eq;
+        case vec_ne: return all & ~eq;
+    }
+    return 0;
+}
+
+/* Set mask[i] to 1 if items[i] <op> <k>, and 0 otherwise. */
+void vec_int_compare(unsigned char *mask, AValue **items, unsigned int n,
+                     AVecCompare op, long k) {
+    intptr_t kw = TAG(k);
+    unsigned int i = 0;
+#if defined(VEC_AVX2)
+    const __m256i vk = _mm256_set1_epi64x(kw);
+    for (; i + 4 <= n; i += 4) {
+        __m256i w = _mm256_loadu_si256((const __m256i*)(items + i));
+        int gt = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(w, vk)));
+        int eq = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(w, vk)));
+        int bits = compare_bits(op, gt, eq, 0xF);
+        for (int j = 0; j < 4; j++) {
+            mask[i + j] = (bits >> j) & 1;
+        }
+    }
+#elif defined(VEC_SSE4)
+    const __m128i vk = _mm_set1_epi64x(kw);
+    for (; i + 2 <= n; i += 2) {
+        __m128i w = _mm_loadu_si128((const __m128i*)(items + i));
+        int gt = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(w, vk)));
+        int eq = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(w, vk)));
+        int bits = compare_bits(op, gt, eq, 0x3);
+        mask[i] = bits & 1;
+        mask[i + 1] = (bits >> 1) & 1;
+    }
+#endif
+    for (; i < n; i++) {
+        intptr_t w = WORD(items[i]);
+        mask[i] = compare_bits(op, w > kw, w == kw, 1);
+    }
+}
+
+/* Set mask[i] to 1 if items[i] mod <k> isn't 0, and 0 otherwise.
+ * (<k> must not be 0.) */
+void vec_int_mod(unsigned char *mask, AValue **items, unsigned int n, long k) {
+    /* Nothing has a SIMD integer divide, and the scalar one is slow,
+     * but we only want to know whether there's a remainder, which a
+     * multiply can tell us (Hacker's Delight, 10-17): write |k| as
+     * d * 2^s with d odd; then u is a multiple of |k| exactly when
+     * u * (inverse of d, mod 2^64), rotated right by s places, is no
+     * more than (2^64 - 1) / |k|. */
+    uint64_t m = (k < 0) ? -(uint64_t)k : (uint64_t)k;
+    unsigned int shift = 0;
+    uint64_t d = m;
+    while ((d & 1) == 0) {
+        d >>= 1;
+        shift ++;
+    }
+    /* Newton's method: each step doubles the number of right bits */
+    uint64_t inverse = d;
+    for (int i = 0; i < 5; i++) {
+        inverse *= 2 - d * inverse;
+    }
+    uint64_t limit = UINT64_MAX / m;
+
+    for (unsigned int i = 0; i < n; i++) {
+        long a = UNTAG(items[i]);
+        uint64_t q = ((a < 0) ? -(uint64_t)a : (uint64_t)a) * inverse;
+        if (shift) q = (q >> shift) | (q << (64 - shift));
+        mask[i] = (q > limit);
+    }
+}
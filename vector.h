@@ -0,0 +1,44 @@
+#ifndef _AL_VECTOR_H__
+#define _AL_VECTOR_H__
+
+#include "alma.h"
+#include "value.h"
+
+/* Kernels that work on a whole array of immediate ints (see value.h)
+ * at once, like the elements of a list with list_all_ints set. They
+ * use AVX2 or SSE when the compiler is allowed to (`make SIMD=avx2`
+ * or `make SIMD=sse4`; x86-64 always has SSE2), and plain loops
+ * otherwise. None of them take a new reference to anything, since
+ * immediates don't need one. */
+
+/* Add up <n> ints. */
+long vec_int_sum(AValue **items, unsigned int n);
+
+/* Multiply together <n> ints. */
+long vec_int_product(AValue **items, unsigned int n);
+
+/* Find the smallest of <n> ints. (<n> must be at least 1.) */
+long vec_int_min(AValue **items, unsigned int n);
+
+/* Find the largest of <n> ints. (<n> must be at least 1.) */
+long vec_int_max(AValue **items, unsigned int n);
+
+/* Set dst[i] to src[i] + <k>, for each of the <n> ints in <src>.
+ * <dst> can be the same as <src>. If any of the results would be
+ * too big to be an immediate, return 0 without touching <dst>. */
+int vec_int_add(AValue **dst, AValue **src, unsigned int n, long k);
+
+/* Set dst[i] to src[i] * <k>, for each of the <n> ints in <src>.
+ * <dst> can be the same as <src>. If any of the results would be
+ * too big to be an immediate, return 0 without touching <dst>. */
+int vec_int_mul(AValue **dst, AValue **src, unsigned int n, long k);
+
+/* Set mask[i] to 1 if items[i] <op> <k>, and 0 otherwise. */
+void vec_int_compare(unsigned char *mask, AValue **items, unsigned int n,
+                     AVecCompare op, long k);
+
+/* Set mask[i] to 1 if items[i] mod <k> isn't 0, and 0 otherwise.
+ * (<k> must not be 0.) */
+void vec_int_mod(unsigned char *mask, AValue **items, unsigned int n, long k);
+
+#endif